@@ -0,0 +1,1322 @@
+/* vim: set sw=2 ts=2 sts=2 et: */
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/*
+ * autoar-archive.c
+ * Read single entries of an archive by their names
+ *
+ * Copyright (C) 2014  Ting-Wei Lan
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ *
+ */
+
+#include "config.h"
+#include "autoar-archive.h"
+
+#include "autoar-misc.h"
+#include "autoar-private.h"
+
+#include <archive.h>
+#include <archive_entry.h>
+#include <gio/gio.h>
+#include <glib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+/**
+ * SECTION:autoar-archive
+ * @Short_description: Read single entries of an archive
+ * @Title: AutoarArchive
+ * @Include: gnome-autoar/autoar.h
+ *
+ * The #AutoarArchive object is used to read the contents of single entries
+ * of an archive without extracting it, for example to show a preview of a
+ * file in a large archive. When the archive is opened, all headers are read
+ * once to build an index of the entries. Zip and 7z archives are indexed from
+ * their central directory or header database, and data of other archives are
+ * skipped without being decoded when the file can be seeked.
+ *
+ * An entry is then read by its path name. Data of regular files which are
+ * stored without compression in tar, cpio and ar archives are read directly
+ * from their offsets recorded in the index. Other entries are located by
+ * skipping the headers before them, which does not decode any data for zip
+ * archives and archives which are not compressed as a whole. Entries of
+ * compressed tar archives and solid 7z blocks still need the data before
+ * them to be decoded.
+ *
+ * The index can also be used to list the archive without extracting it.
+ * Entries are stored in chunks of #AutoarArchive:chunk-size entries, and
+ * #AutoarArchive::entries-indexed is emitted for each chunk while the archive
+ * is being opened, so a huge archive can be shown before all its headers are
+ * read. After the archive is opened, the index is never changed, so entries
+ * can be read from several threads at the same time.
+ **/
+
+G_DEFINE_TYPE (AutoarArchive, autoar_archive, G_TYPE_OBJECT)
+
+#define AUTOAR_ARCHIVE_GET_PRIVATE(o) \
+  (G_TYPE_INSTANCE_GET_PRIVATE ((o), AUTOAR_TYPE_ARCHIVE, AutoarArchivePrivate))
+
+#define BUFFER_SIZE (64 * 1024)
+#define DEFAULT_CHUNK_SIZE 1024
+
+typedef struct _AutoarArchiveEntry AutoarArchiveEntry;
+typedef struct _AutoarArchiveReader AutoarArchiveReader;
+
+struct _AutoarArchivePrivate
+{
+  GFile *file;
+  char  *name;
+
+  int opened    : 1;
+  int is_open   : 1;
+  int in_thread : 1;
+
+  /* Entries are stored in chunks which are never moved, and strings of them
+   * are stored in the string chunk. The lookup table maps path names to
+   * positions plus one. The lock protects the array of chunks, the lookup
+   * table and the number of entries while the archive is being opened. Only
+   * entries before n_entries can be used by other threads. */
+  GRWLock       lock;
+  GPtrArray    *chunks;
+  guint         chunk_size;
+  guint         n_entries;
+  GStringChunk *strings;
+  GHashTable   *lookup;
+
+  AutoarCommonSignalPool signal_pool;
+};
+
+struct _AutoarArchiveEntry
+{
+  AutoarEntryInfo info;
+
+  /* Offset of the data in the file if they are stored contiguously without
+   * compression, or -1 if they must be decoded by libarchive */
+  gint64 data_offset;
+};
+
+struct _AutoarArchiveReader
+{
+  GInputStream *istream;
+  GCancellable *cancellable;
+  GError       *error;
+  void         *buffer;
+  gsize         buffer_size;
+};
+
+enum
+{
+  ENTRIES_INDEXED,
+  LAST_SIGNAL
+};
+
+enum
+{
+  PROP_0,
+  PROP_FILE,
+  PROP_IS_OPEN,
+  PROP_N_ENTRIES,
+  PROP_CHUNK_SIZE
+};
+
+static guint autoar_archive_signals[LAST_SIGNAL] = { 0 };
+
+static void
+autoar_archive_get_property (GObject    *object,
+                             guint       property_id,
+                             GValue     *value,
+                             GParamSpec *pspec)
+{
+  AutoarArchive *archive;
+  AutoarArchivePrivate *priv;
+
+  archive = AUTOAR_ARCHIVE (object);
+  priv = archive->priv;
+
+  switch (property_id) {
+    case PROP_FILE:
+      g_value_set_object (value, priv->file);
+      break;
+    case PROP_IS_OPEN:
+      g_value_set_boolean (value, priv->is_open);
+      break;
+    case PROP_N_ENTRIES:
+      g_value_set_uint (value, autoar_archive_get_n_entries (archive));
+      break;
+    case PROP_CHUNK_SIZE:
+      g_value_set_uint (value, priv->chunk_size);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+static void
+autoar_archive_set_property (GObject      *object,
+                             guint         property_id,
+                             const GValue *value,
+                             GParamSpec   *pspec)
+{
+  AutoarArchive *archive;
+  AutoarArchivePrivate *priv;
+
+  archive = AUTOAR_ARCHIVE (object);
+  priv = archive->priv;
+
+  switch (property_id) {
+    case PROP_FILE:
+      g_clear_object (&(priv->file));
+      priv->file = g_value_dup_object (value);
+      g_free (priv->name);
+      priv->name = priv->file != NULL ?
+                   autoar_common_g_file_get_name (priv->file) : NULL;
+      break;
+    case PROP_CHUNK_SIZE:
+      autoar_archive_set_chunk_size (archive, g_value_get_uint (value));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+/**
+ * autoar_archive_get_file:
+ * @archive: an #AutoarArchive
+ *
+ * Gets the archive file read by @archive.
+ *
+ * Returns: (transfer none): a #GFile
+ **/
+GFile*
+autoar_archive_get_file (AutoarArchive *archive)
+{
+  g_return_val_if_fail (AUTOAR_IS_ARCHIVE (archive), NULL);
+  return archive->priv->file;
+}
+
+/**
+ * autoar_archive_get_is_open:
+ * @archive: an #AutoarArchive
+ *
+ * Checks whether the index of @archive has been built.
+ *
+ * Returns: %TRUE if autoar_archive_open() has succeeded
+ **/
+gboolean
+autoar_archive_get_is_open (AutoarArchive *archive)
+{
+  g_return_val_if_fail (AUTOAR_IS_ARCHIVE (archive), FALSE);
+  return archive->priv->is_open;
+}
+
+/**
+ * autoar_archive_get_chunk_size:
+ * @archive: an #AutoarArchive
+ *
+ * See autoar_archive_set_chunk_size().
+ *
+ * Returns: the number of entries reported by each
+ * #AutoarArchive::entries-indexed signal
+ **/
+guint
+autoar_archive_get_chunk_size (AutoarArchive *archive)
+{
+  g_return_val_if_fail (AUTOAR_IS_ARCHIVE (archive), 0);
+  return archive->priv->chunk_size;
+}
+
+/**
+ * autoar_archive_set_chunk_size:
+ * @archive: an #AutoarArchive
+ * @chunk_size: the number of entries reported by each
+ * #AutoarArchive::entries-indexed signal, which must not be 0
+ *
+ * Entries are reported by #AutoarArchive::entries-indexed in chunks of
+ * @chunk_size entries while the archive is being opened. Smaller chunks show
+ * the first entries of a huge archive earlier, and larger chunks emit fewer
+ * signals. This function should only be called before calling
+ * autoar_archive_open() or autoar_archive_open_async().
+ **/
+void
+autoar_archive_set_chunk_size (AutoarArchive *archive,
+                               guint chunk_size)
+{
+  g_return_if_fail (AUTOAR_IS_ARCHIVE (archive));
+  g_return_if_fail (chunk_size > 0);
+  g_return_if_fail (!(archive->priv->opened));
+  archive->priv->chunk_size = chunk_size;
+}
+
+/**
+ * autoar_archive_get_n_entries:
+ * @archive: an #AutoarArchive
+ *
+ * Gets the number of entries in the index. Entries referring to the top of
+ * the archive itself, such as "./", are not indexed. While the archive is
+ * being opened, only the entries already reported by
+ * #AutoarArchive::entries-indexed are counted.
+ *
+ * Returns: the number of entries, or 0 if @archive is not opened
+ **/
+guint
+autoar_archive_get_n_entries (AutoarArchive *archive)
+{
+  AutoarArchivePrivate *priv;
+  guint n_entries;
+
+  g_return_val_if_fail (AUTOAR_IS_ARCHIVE (archive), 0);
+  priv = archive->priv;
+
+  g_rw_lock_reader_lock (&(priv->lock));
+  n_entries = priv->n_entries;
+  g_rw_lock_reader_unlock (&(priv->lock));
+
+  return n_entries;
+}
+
+static inline AutoarArchiveEntry*
+autoar_archive_do_get_entry (AutoarArchivePrivate *priv,
+                             guint index)
+{
+  AutoarArchiveEntry *chunk;
+
+  chunk = g_ptr_array_index (priv->chunks, index / priv->chunk_size);
+
+  return chunk + index % priv->chunk_size;
+}
+
+/**
+ * autoar_archive_get_entry:
+ * @archive: an #AutoarArchive
+ * @index: position of the entry in the index
+ *
+ * Gets an entry in the index. Entries are in the order they appear in the
+ * archive. This function can be called while the archive is being opened to
+ * get the entries reported by #AutoarArchive::entries-indexed.
+ *
+ * Returns: (transfer none): information about the entry, which is valid as
+ * long as @archive is alive
+ **/
+const AutoarEntryInfo*
+autoar_archive_get_entry (AutoarArchive *archive,
+                          guint index)
+{
+  AutoarArchivePrivate *priv;
+  AutoarArchiveEntry *index_entry;
+
+  g_return_val_if_fail (AUTOAR_IS_ARCHIVE (archive), NULL);
+  priv = archive->priv;
+
+  g_rw_lock_reader_lock (&(priv->lock));
+  index_entry = index < priv->n_entries ?
+                autoar_archive_do_get_entry (priv, index) : NULL;
+  g_rw_lock_reader_unlock (&(priv->lock));
+
+  g_return_val_if_fail (index_entry != NULL, NULL);
+
+  return &(index_entry->info);
+}
+
+static AutoarArchiveEntry*
+autoar_archive_do_lookup (AutoarArchive *archive,
+                          const char *pathname)
+{
+  AutoarArchivePrivate *priv;
+  GString *buffer;
+  AutoarArchiveEntry *index_entry;
+  guint position;
+
+  priv = archive->priv;
+
+  buffer = g_string_new (NULL);
+  g_rw_lock_reader_lock (&(priv->lock));
+  position = GPOINTER_TO_UINT (g_hash_table_lookup (
+    priv->lookup, autoar_common_sanitize_pathname (pathname, FALSE, buffer)));
+  index_entry = position > 0 ?
+                autoar_archive_do_get_entry (priv, position - 1) : NULL;
+  g_rw_lock_reader_unlock (&(priv->lock));
+  g_string_free (buffer, TRUE);
+
+  return index_entry;
+}
+
+/**
+ * autoar_archive_lookup:
+ * @archive: an #AutoarArchive
+ * @pathname: path name of an entry in the archive
+ *
+ * Finds an entry in the index by its path name. Leading "./" and "/" are
+ * ignored, but dots starting a name are kept, so ".config" and "config" are
+ * different entries. If several entries have the same path name, the last one is
+ * returned, which is the one left on the disk if the archive is extracted.
+ * While the archive is being opened, only the entries already reported by
+ * #AutoarArchive::entries-indexed can be found.
+ *
+ * Returns: (transfer none) (allow-none): information about the entry, which
+ * is valid as long as @archive is alive, or %NULL if it is not found
+ **/
+const AutoarEntryInfo*
+autoar_archive_lookup (AutoarArchive *archive,
+                       const char *pathname)
+{
+  AutoarArchiveEntry *index_entry;
+
+  g_return_val_if_fail (AUTOAR_IS_ARCHIVE (archive), NULL);
+  g_return_val_if_fail (pathname != NULL, NULL);
+
+  index_entry = autoar_archive_do_lookup (archive, pathname);
+
+  return index_entry != NULL ? &(index_entry->info) : NULL;
+}
+
+static void
+autoar_archive_dispose (GObject *object)
+{
+  AutoarArchive *archive;
+  AutoarArchivePrivate *priv;
+
+  archive = AUTOAR_ARCHIVE (object);
+  priv = archive->priv;
+
+  g_debug ("AutoarArchive: dispose");
+
+  g_clear_object (&(priv->file));
+
+  G_OBJECT_CLASS (autoar_archive_parent_class)->dispose (object);
+}
+
+static void
+autoar_archive_finalize (GObject *object)
+{
+  AutoarArchive *archive;
+  AutoarArchivePrivate *priv;
+
+  archive = AUTOAR_ARCHIVE (object);
+  priv = archive->priv;
+
+  g_debug ("AutoarArchive: finalize");
+
+  g_free (priv->name);
+  priv->name = NULL;
+
+  g_hash_table_unref (priv->lookup);
+  g_ptr_array_unref (priv->chunks);
+  g_string_chunk_free (priv->strings);
+  g_rw_lock_clear (&(priv->lock));
+
+  autoar_common_signal_pool_clear (&(priv->signal_pool));
+
+  G_OBJECT_CLASS (autoar_archive_parent_class)->finalize (object);
+}
+
+static ssize_t
+libarchive_read_read_cb (struct archive *ar_read,
+                         void *client_data,
+                         const void **buffer)
+{
+  AutoarArchiveReader *reader;
+  gssize read_size;
+
+  reader = (AutoarArchiveReader*)client_data;
+
+  if (reader->error != NULL)
+    return -1;
+
+  *buffer = reader->buffer;
+  read_size = g_input_stream_read (reader->istream,
+                                   reader->buffer,
+                                   reader->buffer_size,
+                                   reader->cancellable,
+                                   &(reader->error));
+  if (reader->error != NULL)
+    return -1;
+
+  return read_size;
+}
+
+static gint64
+libarchive_read_seek_cb (struct archive *ar_read,
+                         void *client_data,
+                         gint64 request,
+                         int whence)
+{
+  AutoarArchiveReader *reader;
+  GSeekable *seekable;
+  GSeekType seektype;
+
+  reader = (AutoarArchiveReader*)client_data;
+  seekable = G_SEEKABLE (reader->istream);
+
+  if (reader->error != NULL)
+    return -1;
+
+  switch (whence) {
+    case SEEK_SET:
+      seektype = G_SEEK_SET;
+      break;
+    case SEEK_CUR:
+      seektype = G_SEEK_CUR;
+      break;
+    case SEEK_END:
+      seektype = G_SEEK_END;
+      break;
+    default:
+      return -1;
+  }
+
+  if (!g_seekable_seek (seekable, request, seektype,
+                        reader->cancellable, &(reader->error)))
+    return -1;
+
+  return g_seekable_tell (seekable);
+}
+
+static gint64
+libarchive_read_skip_cb (struct archive *ar_read,
+                         void *client_data,
+                         gint64 request)
+{
+  AutoarArchiveReader *reader;
+  GSeekable *seekable;
+  goffset old_offset;
+
+  reader = (AutoarArchiveReader*)client_data;
+  seekable = G_SEEKABLE (reader->istream);
+
+  if (reader->error != NULL)
+    return -1;
+
+  /* libarchive reads the data instead if nothing is skipped */
+  old_offset = g_seekable_tell (seekable);
+  if (!g_seekable_seek (seekable, request, G_SEEK_CUR,
+                        reader->cancellable, NULL))
+    return 0;
+
+  return g_seekable_tell (seekable) - old_offset;
+}
+
+static void
+autoar_archive_do_reader_clear (AutoarArchiveReader *reader)
+{
+  if (reader->istream != NULL) {
+    g_input_stream_close (reader->istream, NULL, NULL);
+    g_object_unref (reader->istream);
+    reader->istream = NULL;
+  }
+
+  g_clear_error (&(reader->error));
+
+  g_free (reader->buffer);
+  reader->buffer = NULL;
+}
+
+static void
+autoar_archive_do_reader_error (AutoarArchive *archive,
+                                AutoarArchiveReader *reader,
+                                struct archive *a,
+                                GError **error)
+{
+  /* Errors of GIO are reported instead of the errors they cause in
+   * libarchive */
+  if (reader->error != NULL) {
+    g_propagate_error (error, reader->error);
+    reader->error = NULL;
+  } else {
+    g_propagate_error (error,
+                       autoar_common_g_error_new_a (a, archive->priv->name));
+  }
+}
+
+static struct archive*
+autoar_archive_do_open_reader (AutoarArchive *archive,
+                               AutoarArchiveReader *reader,
+                               GCancellable *cancellable,
+                               GError **error)
+{
+  GFileInputStream *istream;
+  struct archive *a;
+
+  istream = g_file_read (archive->priv->file, cancellable, error);
+  if (istream == NULL)
+    return NULL;
+
+  reader->istream = G_INPUT_STREAM (istream);
+  reader->cancellable = cancellable;
+  reader->error = NULL;
+  reader->buffer_size = BUFFER_SIZE;
+  reader->buffer = g_malloc (reader->buffer_size);
+
+  a = archive_read_new ();
+  archive_read_support_filter_all (a);
+  archive_read_support_format_all (a);
+  archive_read_set_read_callback (a, libarchive_read_read_cb);
+  /* With these callbacks, zip archives are read from the central directory
+   * and data of other formats are skipped instead of being read */
+  if (g_seekable_can_seek (G_SEEKABLE (istream))) {
+    archive_read_set_seek_callback (a, libarchive_read_seek_cb);
+    archive_read_set_skip_callback (a, libarchive_read_skip_cb);
+  }
+  archive_read_set_callback_data (a, reader);
+
+  if (archive_read_open1 (a) != ARCHIVE_OK) {
+    autoar_archive_do_reader_error (archive, reader, a, error);
+    archive_read_free (a);
+    autoar_archive_do_reader_clear (reader);
+    return NULL;
+  }
+
+  return a;
+}
+
+static gint64
+autoar_archive_do_get_data_offset (struct archive *a,
+                                   struct archive_entry *entry)
+{
+  /* Data of regular files are stored contiguously in uncompressed tar, cpio
+   * and ar archives, and libarchive has just consumed the header when this
+   * is called. */
+
+  int format;
+
+  if (archive_filter_count (a) != 1)
+    return -1;
+
+  format = archive_format (a) & ARCHIVE_FORMAT_BASE_MASK;
+  if (format != ARCHIVE_FORMAT_TAR &&
+      format != ARCHIVE_FORMAT_CPIO &&
+      format != ARCHIVE_FORMAT_AR)
+    return -1;
+
+  if (archive_entry_filetype (entry) != AE_IFREG ||
+      archive_entry_hardlink (entry) != NULL ||
+      !archive_entry_size_is_set (entry) ||
+      archive_entry_sparse_count (entry) > 0)
+    return -1;
+
+  return archive_filter_bytes (a, 0);
+}
+
+static void
+autoar_archive_do_report (AutoarArchive *archive,
+                          guint n_entries)
+{
+  /* Makes entries indexed since the last call visible to other threads */
+
+  AutoarArchivePrivate *priv;
+  guint first, i;
+
+  priv = archive->priv;
+  first = priv->n_entries;
+  if (n_entries == first)
+    return;
+
+  g_rw_lock_writer_lock (&(priv->lock));
+  for (i = first; i < n_entries; i++) {
+    AutoarArchiveEntry *index_entry = autoar_archive_do_get_entry (priv, i);
+    g_hash_table_replace (priv->lookup, (char*)(index_entry->info.pathname),
+                          GUINT_TO_POINTER (i + 1));
+  }
+  priv->n_entries = n_entries;
+  g_rw_lock_writer_unlock (&(priv->lock));
+
+  autoar_common_g_signal_emit (archive, &(priv->signal_pool),
+                               priv->in_thread,
+                               autoar_archive_signals[ENTRIES_INDEXED], 0,
+                               first, n_entries - first);
+}
+
+/**
+ * autoar_archive_open:
+ * @archive: an #AutoarArchive
+ * @cancellable: optional #GCancellable object, or %NULL to ignore
+ * @error: return location for a #GError, or %NULL
+ *
+ * Reads all headers of the archive and builds the index of entries. Data of
+ * the entries are not read, and nothing is written to the file system. This
+ * function should be called only once, and no entry can be read before it
+ * succeeds. If it fails, entries indexed before the failure are kept, so
+ * they can still be listed.
+ *
+ * Returns: %TRUE on success, %FALSE if @error is set
+ **/
+gboolean
+autoar_archive_open (AutoarArchive *archive,
+                     GCancellable *cancellable,
+                     GError **error)
+{
+  AutoarArchivePrivate *priv;
+  AutoarArchiveReader reader;
+  struct archive *a;
+  struct archive_entry *entry;
+  GString *pathname_buffer;
+  GString *hardlink_buffer;
+  gboolean can_seek;
+  guint n_entries;
+  guint ordinal;
+  int r;
+
+  g_return_val_if_fail (AUTOAR_IS_ARCHIVE (archive), FALSE);
+  priv = archive->priv;
+  g_return_val_if_fail (!(priv->opened), FALSE);
+
+  g_debug ("autoar_archive_open: called");
+
+  priv->opened = TRUE;
+
+  a = autoar_archive_do_open_reader (archive, &reader, cancellable, error);
+  if (a == NULL)
+    return FALSE;
+
+  n_entries = 0;
+
+  can_seek = g_seekable_can_seek (G_SEEKABLE (reader.istream));
+  pathname_buffer = g_string_new (NULL);
+  hardlink_buffer = g_string_new (NULL);
+
+  for (ordinal = 0; (r = archive_read_next_header (a, &entry)) == ARCHIVE_OK; ordinal++) {
+    AutoarArchiveEntry *index_entry;
+    const char *pathname;
+    const char *hardlink;
+    const char *symlink;
+
+    if (g_cancellable_is_cancelled (cancellable))
+      break;
+
+    pathname = archive_entry_pathname (entry);
+    if (pathname == NULL)
+      continue;
+
+    pathname = autoar_common_sanitize_pathname (pathname, FALSE, pathname_buffer);
+    if (*pathname == '\0')
+      continue;
+
+    hardlink = archive_entry_hardlink (entry);
+    if (hardlink != NULL)
+      hardlink = g_string_chunk_insert (priv->strings,
+        autoar_common_sanitize_pathname (hardlink, FALSE, hardlink_buffer));
+    pathname = g_string_chunk_insert (priv->strings, pathname);
+
+    if (n_entries % priv->chunk_size == 0) {
+      g_rw_lock_writer_lock (&(priv->lock));
+      g_ptr_array_add (priv->chunks, g_new (AutoarArchiveEntry, priv->chunk_size));
+      g_rw_lock_writer_unlock (&(priv->lock));
+    }
+
+    index_entry = autoar_archive_do_get_entry (priv, n_entries);
+    autoar_common_entry_info_fill (&(index_entry->info), entry,
+                                   pathname, hardlink, ordinal);
+    symlink = index_entry->info.symlink;
+    if (symlink != NULL)
+      index_entry->info.symlink = g_string_chunk_insert (priv->strings, symlink);
+    index_entry->data_offset = can_seek ?
+                               autoar_archive_do_get_data_offset (a, entry) : -1;
+
+    if (++n_entries % priv->chunk_size == 0)
+      autoar_archive_do_report (archive, n_entries);
+  }
+
+  g_string_free (pathname_buffer, TRUE);
+  g_string_free (hardlink_buffer, TRUE);
+
+  autoar_archive_do_report (archive, n_entries);
+
+  if (g_cancellable_set_error_if_cancelled (cancellable, error)) {
+    archive_read_free (a);
+    autoar_archive_do_reader_clear (&reader);
+    return FALSE;
+  }
+
+  if (r != ARCHIVE_EOF) {
+    autoar_archive_do_reader_error (archive, &reader, a, error);
+    archive_read_free (a);
+    autoar_archive_do_reader_clear (&reader);
+    return FALSE;
+  }
+
+  archive_read_free (a);
+  autoar_archive_do_reader_clear (&reader);
+
+  g_debug ("autoar_archive_open: %u entries", n_entries);
+  priv->is_open = TRUE;
+
+  return TRUE;
+}
+
+static void
+autoar_archive_open_thread (GTask *task,
+                            gpointer source_object,
+                            gpointer task_data,
+                            GCancellable *cancellable)
+{
+  AutoarArchive *archive = source_object;
+  GError *error = NULL;
+
+  archive->priv->in_thread = TRUE;
+  if (autoar_archive_open (archive, cancellable, &error))
+    g_task_return_boolean (task, TRUE);
+  else
+    g_task_return_error (task, error);
+}
+
+/**
+ * autoar_archive_open_async:
+ * @archive: an #AutoarArchive
+ * @cancellable: optional #GCancellable object, or %NULL to ignore
+ * @callback: a #GAsyncReadyCallback to call when the index is built
+ * @user_data: data passed to @callback
+ *
+ * Asynchronously runs autoar_archive_open() in a thread. Call
+ * autoar_archive_open_finish() in @callback to get the result.
+ * #AutoarArchive::entries-indexed is emitted in the main thread, and all of
+ * them are emitted before @callback is called.
+ **/
+void
+autoar_archive_open_async (AutoarArchive *archive,
+                           GCancellable *cancellable,
+                           GAsyncReadyCallback callback,
+                           gpointer user_data)
+{
+  GTask *task;
+
+  g_return_if_fail (AUTOAR_IS_ARCHIVE (archive));
+
+  task = g_task_new (archive, cancellable, callback, user_data);
+  g_task_run_in_thread (task, autoar_archive_open_thread);
+  g_object_unref (task);
+}
+
+/**
+ * autoar_archive_open_finish:
+ * @archive: an #AutoarArchive
+ * @result: the #GAsyncResult passed to the callback
+ * @error: return location for a #GError, or %NULL
+ *
+ * Finishes an operation started with autoar_archive_open_async().
+ *
+ * Returns: %TRUE on success, %FALSE if @error is set
+ **/
+gboolean
+autoar_archive_open_finish (AutoarArchive *archive,
+                            GAsyncResult *result,
+                            GError **error)
+{
+  g_return_val_if_fail (g_task_is_valid (result, archive), FALSE);
+  return g_task_propagate_boolean (G_TASK (result), error);
+}
+
+static AutoarArchiveEntry*
+autoar_archive_do_find_file (AutoarArchive *archive,
+                             const char *pathname,
+                             GError **error)
+{
+  AutoarArchiveEntry *index_entry;
+  guint links;
+
+  index_entry = autoar_archive_do_lookup (archive, pathname);
+
+  /* A hard link refers to an earlier entry, so there cannot be more links
+   * than entries unless the archive is broken */
+  for (links = 0; index_entry != NULL && index_entry->info.hardlink != NULL &&
+                  links < archive->priv->n_entries; links++)
+    index_entry = autoar_archive_do_lookup (archive, index_entry->info.hardlink);
+
+  if (index_entry == NULL) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND,
+                 "\'%s\': %s", pathname, "no such entry in the archive");
+    return NULL;
+  }
+
+  if (S_ISDIR (index_entry->info.mode)) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_IS_DIRECTORY,
+                 "\'%s\': %s", pathname, "is a directory");
+    return NULL;
+  }
+
+  if (!S_ISREG (index_entry->info.mode) || index_entry->info.hardlink != NULL) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_REGULAR_FILE,
+                 "\'%s\': %s", pathname, "not a regular file");
+    return NULL;
+  }
+
+  return index_entry;
+}
+
+static void
+autoar_archive_do_set_too_large (AutoarArchiveEntry *index_entry,
+                                 GError **error)
+{
+  g_set_error (error, G_IO_ERROR, G_IO_ERROR_NO_SPACE,
+               "\'%s\': %s", index_entry->info.pathname,
+               "too large to be stored in memory");
+}
+
+static gboolean
+autoar_archive_do_reserve (guchar **data,
+                           gsize *allocated,
+                           guint64 needed)
+{
+  /* Sizes come from the archive, which cannot be trusted, so allocation
+   * failures are reported instead of aborting */
+
+  gpointer new_data;
+  gsize new_size;
+
+  if (needed <= *allocated)
+    return TRUE;
+  if (needed > G_MAXSSIZE)
+    return FALSE;
+
+  new_size = MAX (*allocated, BUFFER_SIZE);
+  while (new_size < needed)
+    new_size = new_size > G_MAXSSIZE / 2 ? needed : new_size * 2;
+
+  new_data = g_try_realloc (*data, new_size);
+  if (new_data == NULL)
+    return FALSE;
+
+  *data = new_data;
+  *allocated = new_size;
+
+  return TRUE;
+}
+
+static GBytes*
+autoar_archive_do_read_stored (AutoarArchive *archive,
+                               AutoarArchiveEntry *index_entry,
+                               GCancellable *cancellable,
+                               GError **error)
+{
+  /* The data are read directly from the file without libarchive */
+
+  GFileInputStream *istream;
+  GFileInfo *info;
+  guint64 file_size;
+  gsize size, bytes_read;
+  char *data;
+
+  if (index_entry->info.size > G_MAXSSIZE) {
+    autoar_archive_do_set_too_large (index_entry, error);
+    return NULL;
+  }
+
+  istream = g_file_read (archive->priv->file, cancellable, error);
+  if (istream == NULL)
+    return NULL;
+
+  /* A broken header must not make us allocate more than the file holds */
+  info = g_file_input_stream_query_info (istream, G_FILE_ATTRIBUTE_STANDARD_SIZE,
+                                         cancellable, error);
+  if (info == NULL) {
+    g_object_unref (istream);
+    return NULL;
+  }
+  file_size = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_STANDARD_SIZE);
+  g_object_unref (info);
+
+  size = index_entry->info.size;
+  if ((guint64)(index_entry->data_offset) > file_size ||
+      size > file_size - index_entry->data_offset) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_PARTIAL_INPUT,
+                 "\'%s\': %s", index_entry->info.pathname, "truncated data");
+    g_object_unref (istream);
+    return NULL;
+  }
+
+  data = NULL;
+  if (size > 0 && (data = g_try_malloc (size)) == NULL) {
+    autoar_archive_do_set_too_large (index_entry, error);
+    g_object_unref (istream);
+    return NULL;
+  }
+
+  if (!g_seekable_seek (G_SEEKABLE (istream), index_entry->data_offset,
+                        G_SEEK_SET, cancellable, error) ||
+      !g_input_stream_read_all (G_INPUT_STREAM (istream), data, size,
+                                &bytes_read, cancellable, error)) {
+    g_free (data);
+    g_object_unref (istream);
+    return NULL;
+  }
+
+  g_input_stream_close (G_INPUT_STREAM (istream), NULL, NULL);
+  g_object_unref (istream);
+
+  if (bytes_read < size) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_PARTIAL_INPUT,
+                 "\'%s\': %s", index_entry->info.pathname, "truncated data");
+    g_free (data);
+    return NULL;
+  }
+
+  return g_bytes_new_take (data, size);
+}
+
+static GBytes*
+autoar_archive_do_read_decoded (AutoarArchive *archive,
+                                AutoarArchiveEntry *index_entry,
+                                GCancellable *cancellable,
+                                GError **error)
+{
+  /* Headers before the entry are skipped, which does not decode their data
+   * unless the archive is compressed as a whole */
+
+  AutoarArchiveReader reader;
+  struct archive *a;
+  struct archive_entry *entry;
+  guchar *data;
+  gsize len, allocated;
+  GString *buffer;
+  const void *block;
+  size_t size;
+  gint64 offset;
+  gboolean found;
+  guint ordinal;
+  int r;
+
+  a = autoar_archive_do_open_reader (archive, &reader, cancellable, error);
+  if (a == NULL)
+    return NULL;
+
+  for (ordinal = 0; (r = archive_read_next_header (a, &entry)) == ARCHIVE_OK &&
+                    ordinal < index_entry->info.ordinal; ordinal++) {
+    if (g_cancellable_is_cancelled (cancellable))
+      break;
+  }
+
+  if (g_cancellable_set_error_if_cancelled (cancellable, error)) {
+    archive_read_free (a);
+    autoar_archive_do_reader_clear (&reader);
+    return NULL;
+  }
+
+  if (r != ARCHIVE_OK && r != ARCHIVE_EOF) {
+    autoar_archive_do_reader_error (archive, &reader, a, error);
+    archive_read_free (a);
+    autoar_archive_do_reader_clear (&reader);
+    return NULL;
+  }
+
+  found = FALSE;
+  if (r == ARCHIVE_OK && archive_entry_pathname (entry) != NULL) {
+    buffer = g_string_new (NULL);
+    found = g_strcmp0 (autoar_common_sanitize_pathname (archive_entry_pathname (entry),
+                                                        FALSE, buffer),
+                       index_entry->info.pathname) == 0;
+    g_string_free (buffer, TRUE);
+  }
+
+  if (!found) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                 "\'%s\': %s", archive->priv->name,
+                 "the archive has changed since it was opened");
+    archive_read_free (a);
+    autoar_archive_do_reader_clear (&reader);
+    return NULL;
+  }
+
+  /* The buffer grows with the data actually read instead of being sized from
+   * the header */
+  data = NULL;
+  len = 0;
+  allocated = 0;
+
+  while ((r = archive_read_data_block (a, &block, &size, &offset)) == ARCHIVE_OK) {
+    if (block == NULL)
+      continue;
+
+    if (g_cancellable_is_cancelled (cancellable))
+      break;
+
+    if (offset < 0 || !autoar_archive_do_reserve (&data, &allocated,
+                                                  (guint64)offset + size)) {
+      autoar_archive_do_set_too_large (index_entry, error);
+      g_free (data);
+      archive_read_free (a);
+      autoar_archive_do_reader_clear (&reader);
+      return NULL;
+    }
+
+    /* Holes of sparse files are filled with zeros */
+    if (offset > len)
+      memset (data + len, 0, offset - len);
+    if (size > 0)
+      memcpy (data + offset, block, size);
+    len = MAX (len, (gsize)offset + size);
+  }
+
+  if (g_cancellable_set_error_if_cancelled (cancellable, error)) {
+    g_free (data);
+    archive_read_free (a);
+    autoar_archive_do_reader_clear (&reader);
+    return NULL;
+  }
+
+  if (r != ARCHIVE_EOF) {
+    autoar_archive_do_reader_error (archive, &reader, a, error);
+    g_free (data);
+    archive_read_free (a);
+    autoar_archive_do_reader_clear (&reader);
+    return NULL;
+  }
+
+  /* The last hole of a sparse file is not returned as data. Other files are
+   * not padded, so truncated data are not hidden behind zeros. */
+  if (archive_entry_sparse_count (entry) > 0 && index_entry->info.size > 0 &&
+      (guint64)(index_entry->info.size) > len) {
+    if (!autoar_archive_do_reserve (&data, &allocated, index_entry->info.size)) {
+      autoar_archive_do_set_too_large (index_entry, error);
+      g_free (data);
+      archive_read_free (a);
+      autoar_archive_do_reader_clear (&reader);
+      return NULL;
+    }
+    memset (data + len, 0, index_entry->info.size - len);
+    len = index_entry->info.size;
+  }
+
+  archive_read_free (a);
+  autoar_archive_do_reader_clear (&reader);
+
+  return g_bytes_new_take (data, len);
+}
+
+/**
+ * autoar_archive_read_entry:
+ * @archive: an #AutoarArchive
+ * @pathname: path name of a regular file in the archive
+ * @cancellable: optional #GCancellable object, or %NULL to ignore
+ * @error: return location for a #GError, or %NULL
+ *
+ * Reads the whole content of a regular file in the archive. The entry is
+ * found as autoar_archive_lookup() does, and hard links are followed. The
+ * archive file is opened again for each call, so this function can be called
+ * from several threads at the same time after @archive is opened.
+ *
+ * Returns: (transfer full): the content of the file, or %NULL if @error is
+ * set
+ **/
+GBytes*
+autoar_archive_read_entry (AutoarArchive *archive,
+                           const char *pathname,
+                           GCancellable *cancellable,
+                           GError **error)
+{
+  AutoarArchiveEntry *index_entry;
+
+  g_return_val_if_fail (AUTOAR_IS_ARCHIVE (archive), NULL);
+  g_return_val_if_fail (archive->priv->is_open, NULL);
+  g_return_val_if_fail (pathname != NULL, NULL);
+
+  g_debug ("autoar_archive_read_entry: %s", pathname);
+
+  index_entry = autoar_archive_do_find_file (archive, pathname, error);
+  if (index_entry == NULL)
+    return NULL;
+
+  if (index_entry->data_offset >= 0)
+    return autoar_archive_do_read_stored (archive, index_entry,
+                                          cancellable, error);
+
+  return autoar_archive_do_read_decoded (archive, index_entry,
+                                         cancellable, error);
+}
+
+static void
+autoar_archive_read_entry_thread (GTask *task,
+                                  gpointer source_object,
+                                  gpointer task_data,
+                                  GCancellable *cancellable)
+{
+  GBytes *bytes;
+  GError *error = NULL;
+
+  bytes = autoar_archive_read_entry (source_object, task_data,
+                                     cancellable, &error);
+  if (bytes != NULL)
+    g_task_return_pointer (task, bytes, (GDestroyNotify)g_bytes_unref);
+  else
+    g_task_return_error (task, error);
+}
+
+/**
+ * autoar_archive_read_entry_async:
+ * @archive: an #AutoarArchive
+ * @pathname: path name of a regular file in the archive
+ * @cancellable: optional #GCancellable object, or %NULL to ignore
+ * @callback: a #GAsyncReadyCallback to call when the file is read
+ * @user_data: data passed to @callback
+ *
+ * Asynchronously runs autoar_archive_read_entry() in a thread. Call
+ * autoar_archive_read_entry_finish() in @callback to get the result.
+ **/
+void
+autoar_archive_read_entry_async (AutoarArchive *archive,
+                                 const char *pathname,
+                                 GCancellable *cancellable,
+                                 GAsyncReadyCallback callback,
+                                 gpointer user_data)
+{
+  GTask *task;
+
+  g_return_if_fail (AUTOAR_IS_ARCHIVE (archive));
+  g_return_if_fail (archive->priv->is_open);
+  g_return_if_fail (pathname != NULL);
+
+  task = g_task_new (archive, cancellable, callback, user_data);
+  g_task_set_task_data (task, g_strdup (pathname), g_free);
+  g_task_run_in_thread (task, autoar_archive_read_entry_thread);
+  g_object_unref (task);
+}
+
+/**
+ * autoar_archive_read_entry_finish:
+ * @archive: an #AutoarArchive
+ * @result: the #GAsyncResult passed to the callback
+ * @error: return location for a #GError, or %NULL
+ *
+ * Finishes an operation started with autoar_archive_read_entry_async().
+ *
+ * Returns: (transfer full): the content of the file, or %NULL if @error is
+ * set
+ **/
+GBytes*
+autoar_archive_read_entry_finish (AutoarArchive *archive,
+                                  GAsyncResult *result,
+                                  GError **error)
+{
+  g_return_val_if_fail (g_task_is_valid (result, archive), NULL);
+  return g_task_propagate_pointer (G_TASK (result), error);
+}
+
+static void
+autoar_archive_class_init (AutoarArchiveClass *klass)
+{
+  GObjectClass *object_class;
+  GType type;
+
+  object_class = G_OBJECT_CLASS (klass);
+  type = G_TYPE_FROM_CLASS (klass);
+
+  g_type_class_add_private (klass, sizeof (AutoarArchivePrivate));
+
+  object_class->get_property = autoar_archive_get_property;
+  object_class->set_property = autoar_archive_set_property;
+  object_class->dispose = autoar_archive_dispose;
+  object_class->finalize = autoar_archive_finalize;
+
+  g_object_class_install_property (object_class, PROP_FILE,
+                                   g_param_spec_object ("file",
+                                                        "Archive GFile",
+                                                        "The archive GFile to be read",
+                                                        G_TYPE_FILE,
+                                                        G_PARAM_READWRITE |
+                                                        G_PARAM_CONSTRUCT_ONLY |
+                                                        G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class, PROP_IS_OPEN,
+                                   g_param_spec_boolean ("is-open",
+                                                         "Is open",
+                                                         "Whether the index of entries is built",
+                                                         FALSE,
+                                                         G_PARAM_READABLE |
+                                                         G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class, PROP_N_ENTRIES,
+                                   g_param_spec_uint ("n-entries",
+                                                      "Number of entries",
+                                                      "Number of entries in the index",
+                                                      0, G_MAXUINT, 0,
+                                                      G_PARAM_READABLE |
+                                                      G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class, PROP_CHUNK_SIZE,
+                                   g_param_spec_uint ("chunk-size",
+                                                      "Chunk size",
+                                                      "Number of entries reported by each entries-indexed signal",
+                                                      1, G_MAXUINT, DEFAULT_CHUNK_SIZE,
+                                                      G_PARAM_READWRITE |
+                                                      G_PARAM_STATIC_STRINGS));
+
+/**
+ * AutoarArchive::entries-indexed:
+ * @archive: the #AutoarArchive
+ * @first: position of the first entry indexed since the last emission
+ * @n_entries: the number of entries indexed since the last emission
+ *
+ * This signal is emitted while the archive is being opened, each time
+ * #AutoarArchive:chunk-size entries are indexed and once more for the
+ * remaining entries. The entries can be got with autoar_archive_get_entry()
+ * as soon as this signal is emitted.
+ **/
+  autoar_archive_signals[ENTRIES_INDEXED] =
+    g_signal_new ("entries-indexed",
+                  type,
+                  G_SIGNAL_RUN_LAST,
+                  0, NULL, NULL,
+                  g_cclosure_marshal_generic,
+                  G_TYPE_NONE,
+                  2,
+                  G_TYPE_UINT,
+                  G_TYPE_UINT);
+
+  autoar_common_g_signal_cache (autoar_archive_signals, LAST_SIGNAL);
+}
+
+static void
+autoar_archive_init (AutoarArchive *archive)
+{
+  AutoarArchivePrivate *priv;
+
+  priv = AUTOAR_ARCHIVE_GET_PRIVATE (archive);
+  archive->priv = priv;
+
+  priv->file = NULL;
+  priv->name = NULL;
+
+  priv->opened = FALSE;
+  priv->is_open = FALSE;
+  priv->in_thread = FALSE;
+
+  g_rw_lock_init (&(priv->lock));
+  priv->chunks = g_ptr_array_new_with_free_func (g_free);
+  priv->chunk_size = DEFAULT_CHUNK_SIZE;
+  priv->n_entries = 0;
+  priv->strings = g_string_chunk_new (4096);
+  priv->lookup = g_hash_table_new (g_str_hash, g_str_equal);
+
+  autoar_common_signal_pool_init (&(priv->signal_pool));
+}
+
+/**
+ * autoar_archive_new:
+ * @file: the archive file to be read
+ *
+ * Create a new #AutoarArchive object. Call autoar_archive_open() or
+ * autoar_archive_open_async() to build the index before reading entries.
+ *
+ * Returns: (transfer full): a new #AutoarArchive object
+ **/
+AutoarArchive*
+autoar_archive_new (GFile *file)
+{
+  g_return_val_if_fail (G_IS_FILE (file), NULL);
+
+  return g_object_new (AUTOAR_TYPE_ARCHIVE, "file", file, NULL);
+}
@@ -0,0 +1,101 @@
+/* vim: set sw=2 ts=2 sts=2 et: */
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/*
+ * autoar-archive.h
+ * Read single entries of an archive by their names
+ *
+ * Copyright (C) 2014  Ting-Wei Lan
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ *
+ */
+
+#ifndef AUTOAR_ARCHIVE_H
+#define AUTOAR_ARCHIVE_H
+
+#include <glib-object.h>
+#include <gio/gio.h>
+
+#include "autoar-misc.h"
+
+G_BEGIN_DECLS
+
+#define AUTOAR_TYPE_ARCHIVE             autoar_archive_get_type ()
+#define AUTOAR_ARCHIVE(obj)             (G_TYPE_CHECK_INSTANCE_CAST ((obj), AUTOAR_TYPE_ARCHIVE, AutoarArchive))
+#define AUTOAR_ARCHIVE_CLASS(klass)     (G_TYPE_CHECK_CLASS_CAST ((klass), AUTOAR_TYPE_ARCHIVE, AutoarArchiveClass))
+#define AUTOAR_IS_ARCHIVE(obj)          (G_TYPE_CHECK_INSTANCE_TYPE ((obj), AUTOAR_TYPE_ARCHIVE))
+#define AUTOAR_IS_ARCHIVE_CLASS(klass)  (G_TYPE_CHECK_CLASS_TYPE ((klass), AUTOAR_TYPE_ARCHIVE))
+#define AUTOAR_ARCHIVE_GET_CLASS(obj)   (G_TYPE_INSTANCE_GET_CLASS ((obj), AUTOAR_TYPE_ARCHIVE, AutoarArchiveClass))
+
+typedef struct _AutoarArchive AutoarArchive;
+typedef struct _AutoarArchiveClass AutoarArchiveClass;
+typedef struct _AutoarArchivePrivate AutoarArchivePrivate;
+
+struct _AutoarArchive
+{
+  GObject parent;
+
+  AutoarArchivePrivate *priv;
+};
+
+struct _AutoarArchiveClass
+{
+  GObjectClass parent_class;
+};
+
+GType                  autoar_archive_get_type          (void) G_GNUC_CONST;
+
+AutoarArchive         *autoar_archive_new               (GFile *file);
+
+gboolean               autoar_archive_open              (AutoarArchive *archive,
+                                                         GCancellable *cancellable,
+                                                         GError **error);
+void                   autoar_archive_open_async        (AutoarArchive *archive,
+                                                         GCancellable *cancellable,
+                                                         GAsyncReadyCallback callback,
+                                                         gpointer user_data);
+gboolean               autoar_archive_open_finish       (AutoarArchive *archive,
+                                                         GAsyncResult *result,
+                                                         GError **error);
+
+GFile                 *autoar_archive_get_file          (AutoarArchive *archive);
+gboolean               autoar_archive_get_is_open       (AutoarArchive *archive);
+guint                  autoar_archive_get_chunk_size    (AutoarArchive *archive);
+guint                  autoar_archive_get_n_entries     (AutoarArchive *archive);
+const AutoarEntryInfo *autoar_archive_get_entry         (AutoarArchive *archive,
+                                                         guint index);
+const AutoarEntryInfo *autoar_archive_lookup            (AutoarArchive *archive,
+                                                         const char *pathname);
+
+void                   autoar_archive_set_chunk_size    (AutoarArchive *archive,
+                                                         guint chunk_size);
+
+GBytes                *autoar_archive_read_entry        (AutoarArchive *archive,
+                                                         const char *pathname,
+                                                         GCancellable *cancellable,
+                                                         GError **error);
+void                   autoar_archive_read_entry_async  (AutoarArchive *archive,
+                                                         const char *pathname,
+                                                         GCancellable *cancellable,
+                                                         GAsyncReadyCallback callback,
+                                                         gpointer user_data);
+GBytes                *autoar_archive_read_entry_finish (AutoarArchive *archive,
+                                                         GAsyncResult *result,
+                                                         GError **error);
+
+G_END_DECLS
+
+#endif /* AUTOAR_ARCHIVE_H */
@@ -92,12 +92,10 @@ struct _AutoarCreatePrivate
   int output_is_dest : 1;
 
   guint64 size; /* This field is currently unused */
-  guint64 completed_size;
-
   guint files;
-  guint completed_files;
+  AutoarCommonProgress progress;
+  AutoarCommonSignalPool signal_pool;
 
-  gint64 notify_last;
   gint64 notify_interval;
   AutoarPref *arpref;
 
@@ -176,13 +174,13 @@ autoar_create_get_property (GObject    *object,
       g_value_set_uint64 (value, priv->size);
       break;
     case PROP_COMPLETED_SIZE:
-      g_value_set_uint64 (value, priv->completed_size);
+      g_value_set_uint64 (value, autoar_common_progress_get_size (&(priv->progress)));
       break;
     case PROP_FILES:
       g_value_set_uint (value, priv->files);
       break;
     case PROP_COMPLETED_FILES:
-      g_value_set_uint (value, priv->completed_files);
+      g_value_set_uint (value, autoar_common_progress_get_files (&(priv->progress)));
       break;
     case PROP_OUTPUT_IS_DEST:
       g_value_set_boolean (value, priv->output_is_dest);
@@ -332,7 +330,7 @@ guint64
 autoar_create_get_completed_size (AutoarCreate *arcreate)
 {
   g_return_val_if_fail (AUTOAR_IS_CREATE (arcreate), 0);
-  return arcreate->priv->completed_size;
+  return autoar_common_progress_get_size (&(arcreate->priv->progress));
 }
 
 /**
@@ -363,7 +361,7 @@ guint
 autoar_create_get_completed_files (AutoarCreate *arcreate)
 {
   g_return_val_if_fail (AUTOAR_IS_CREATE (arcreate), 0);
-  return arcreate->priv->completed_files;
+  return autoar_common_progress_get_files (&(arcreate->priv->progress));
 }
 
 /**
@@ -531,6 +529,8 @@ autoar_create_finalize (GObject *object)
   g_free (priv->extension);
   priv->extension = NULL;
 
+  autoar_common_signal_pool_clear (&(priv->signal_pool));
+
   G_OBJECT_CLASS (autoar_create_parent_class)->finalize (object);
 }
 
@@ -619,7 +619,8 @@ libarchive_write_write_cb (struct archive *ar_write,
 static inline void
 autoar_create_signal_decide_dest (AutoarCreate *arcreate)
 {
-  autoar_common_g_signal_emit (arcreate, arcreate->priv->in_thread,
+  autoar_common_g_signal_emit (arcreate, &(arcreate->priv->signal_pool),
+                               arcreate->priv->in_thread,
                                autoar_create_signals[DECIDE_DEST], 0,
                                arcreate->priv->dest);
 }
@@ -627,21 +628,14 @@ autoar_create_signal_decide_dest (AutoarCreate *arcreate)
 static inline void
 autoar_create_signal_progress (AutoarCreate *arcreate)
 {
-  gint64 mtime;
-  mtime = g_get_monotonic_time ();
-  if (mtime - arcreate->priv->notify_last >= arcreate->priv->notify_interval) {
-    autoar_common_g_signal_emit (arcreate, arcreate->priv->in_thread,
-                                 autoar_create_signals[PROGRESS], 0,
-                                 arcreate->priv->completed_size,
-                                 arcreate->priv->completed_files);
-    arcreate->priv->notify_last = mtime;
-  }
+  autoar_common_progress_notify (&(arcreate->priv->progress), FALSE);
 }
 
 static inline void
 autoar_create_signal_cancelled (AutoarCreate *arcreate)
 {
-  autoar_common_g_signal_emit (arcreate, arcreate->priv->in_thread,
+  autoar_common_g_signal_emit (arcreate, &(arcreate->priv->signal_pool),
+                               arcreate->priv->in_thread,
                                autoar_create_signals[CANCELLED], 0);
 
 }
@@ -649,7 +643,8 @@ autoar_create_signal_cancelled (AutoarCreate *arcreate)
 static inline void
 autoar_create_signal_completed (AutoarCreate *arcreate)
 {
-  autoar_common_g_signal_emit (arcreate, arcreate->priv->in_thread,
+  autoar_common_g_signal_emit (arcreate, &(arcreate->priv->signal_pool),
+                               arcreate->priv->in_thread,
                                autoar_create_signals[COMPLETED], 0);
 
 }
@@ -664,7 +659,8 @@ autoar_create_signal_error (AutoarCreate *arcreate)
       arcreate->priv->error = NULL;
       autoar_create_signal_cancelled (arcreate);
     } else {
-      autoar_common_g_signal_emit (arcreate, arcreate->priv->in_thread,
+      autoar_common_g_signal_emit (arcreate, &(arcreate->priv->signal_pool),
+                                   arcreate->priv->in_thread,
                                    autoar_create_signals[AR_ERROR], 0,
                                    arcreate->priv->error);
     }
@@ -714,7 +710,7 @@ autoar_create_do_write_data (AutoarCreate *arcreate,
     if (istream == NULL)
       return;
 
-    priv->completed_files++;
+    autoar_common_progress_add (&(priv->progress), 0, 1);
 
     do {
       read_actual = g_input_stream_read (istream,
@@ -722,7 +718,8 @@ autoar_create_do_write_data (AutoarCreate *arcreate,
                                          priv->buffer_size,
                                          priv->cancellable,
                                          &(priv->error));
-      priv->completed_size += read_actual > 0 ? read_actual : 0;
+      if (read_actual > 0)
+        autoar_common_progress_add (&(priv->progress), read_actual, 0);
       autoar_create_signal_progress (arcreate);
       if (read_actual > 0) {
         written_acc = 0;
@@ -752,7 +749,7 @@ autoar_create_do_write_data (AutoarCreate *arcreate,
     g_debug ("autoar_create_do_write_data: write data OK");
   } else {
     g_debug ("autoar_create_do_write_data: no data, return now!");
-    priv->completed_files++;
+    autoar_common_progress_add (&(priv->progress), 0, 1);
     autoar_create_signal_progress (arcreate);
   }
 }
@@ -775,7 +772,13 @@ autoar_create_do_add_to_archive (AutoarCreate *arcreate,
     return;
 
   archive_entry_clear (priv->entry);
-  info = g_file_query_info (file, "*", G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+  /* Owner names of local files are resolved through the shared cache in
+   * autoar-private.c instead of by GIO, which looks them up for each file. */
+  info = g_file_query_info (file,
+                            g_file_is_native (file) ?
+                              "standard::*,time::*,unix::*" :
+                              "standard::*,time::*,unix::*,owner::*",
+                            G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
                             priv->cancellable, &(priv->error));
   if (info == NULL)
     return;
@@ -859,8 +862,17 @@ autoar_create_do_add_to_archive (AutoarCreate *arcreate,
 
     archive_entry_set_uid (priv->entry, g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_UID));
     archive_entry_set_gid (priv->entry, g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_GID));
-    archive_entry_set_uname (priv->entry, g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_OWNER_USER));
-    archive_entry_set_gname (priv->entry, g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_OWNER_GROUP));
+
+    if (g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_OWNER_USER))
+      archive_entry_set_uname (priv->entry, g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_OWNER_USER));
+    else if (g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_UNIX_UID))
+      archive_entry_set_uname (priv->entry, autoar_common_get_user_name (g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_UID)));
+
+    if (g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_OWNER_GROUP))
+      archive_entry_set_gname (priv->entry, g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_OWNER_GROUP));
+    else if (g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_UNIX_GID))
+      archive_entry_set_gname (priv->entry, autoar_common_get_group_name (g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_GID)));
+
     archive_entry_set_mode (priv->entry, g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_MODE));
   }
 
@@ -1199,6 +1211,8 @@ autoar_create_class_init (AutoarCreateClass *klass)
                   G_TYPE_NONE,
                   1,
                   G_TYPE_ERROR);
+
+  autoar_common_g_signal_cache (autoar_create_signals, LAST_SIGNAL);
 }
 
 static void
@@ -1210,11 +1224,11 @@ autoar_create_init (AutoarCreate *arcreate)
   arcreate->priv = priv;
 
   priv->size = 0;
-  priv->completed_size = 0;
   priv->files = 0;
-  priv->completed_files = 0;
-
-  priv->notify_last = 0;
+  autoar_common_signal_pool_init (&(priv->signal_pool));
+  autoar_common_progress_init (&(priv->progress), arcreate,
+                               &(priv->signal_pool),
+                               autoar_create_signals[PROGRESS]);
 
   priv->ostream = NULL;
   priv->buffer_size = BUFFER_SIZE;
@@ -1638,8 +1652,7 @@ autoar_create_step_cleanup (AutoarCreate *arcreate)
    * and finalize functions. */
   AutoarCreatePrivate *priv;
   priv = arcreate->priv;
-  priv->notify_last = 0;
-  autoar_create_signal_progress (arcreate);
+  autoar_common_progress_notify (&(priv->progress), TRUE);
   if (archive_write_close (priv->a) != ARCHIVE_OK) {
     if (priv->error == NULL)
       priv->error = autoar_common_g_error_new_a (priv->a, priv->output);
@@ -1671,6 +1684,9 @@ autoar_create_run (AutoarCreate *arcreate)
     return;
   }
 
+  autoar_common_progress_start (&(priv->progress), priv->in_thread,
+                                priv->notify_interval);
+
   i = 0;
   steps[i++] = autoar_create_step_initialize_object;
   steps[i++] = priv->output_is_dest ?
@@ -1685,15 +1701,18 @@ autoar_create_run (AutoarCreate *arcreate)
     (*steps[i])(arcreate);
     g_debug ("autoar_create_run: Step %d End", i);
     if (priv->error != NULL) {
+      autoar_common_progress_stop (&(priv->progress));
       autoar_create_signal_error (arcreate);
       return;
     }
     if (g_cancellable_is_cancelled (priv->cancellable)) {
+      autoar_common_progress_stop (&(priv->progress));
       autoar_create_signal_cancelled (arcreate);
       return;
     }
   }
 
+  autoar_common_progress_stop (&(priv->progress));
   autoar_create_signal_completed (arcreate);
 }
 
@@ -32,7 +32,10 @@
 
 #include <archive.h>
 #include <archive_entry.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <gio/gio.h>
+#include <glib/gstdio.h>
 #include <gobject/gvaluecollector.h>
 #include <stdarg.h>
 #include <string.h>
@@ -40,16 +43,25 @@
 #include <sys/types.h>
 #include <unistd.h>
 
-#if defined HAVE_MKFIFO || defined HAVE_MKNOD
-# include <fcntl.h>
+#ifdef HAVE_SYS_SENDFILE_H
+# include <sys/sendfile.h>
 #endif
 
-#ifdef HAVE_GETPWNAM
-# include <pwd.h>
+#ifndef O_CLOEXEC
+# define O_CLOEXEC 0
 #endif
 
-#ifdef HAVE_GETGRNAM
-# include <grp.h>
+#if defined HAVE_OPENAT && defined HAVE_MKDIRAT
+# define USE_DIR_FD_CACHE 1
+# ifndef O_DIRECTORY
+#  define O_DIRECTORY 0
+# endif
+# ifndef O_NOFOLLOW
+#  define O_NOFOLLOW 0
+# endif
+# if defined HAVE_FUTIMENS && defined HAVE_FCHMOD
+#  define USE_NATIVE_BACKEND 1
+# endif
 #endif
 
 /**
@@ -72,6 +84,11 @@
  * when extrating, or delete the source archive after extracting, depending on
  * the settings provided by the #AutoarPref object.
  *
+ * #AutoarExtract can also test an archive without extracting it. If
+ * #AutoarExtract:verify is %TRUE, the data of all entries are decoded and
+ * checked by libarchive, and then discarded, so nothing is written to the
+ * output directory.
+ *
  * When #AutoarExtract stop all work, it will emit one of the three signals:
  * #AutoarExtract::cancelled, #AutoarExtract::error, and
  * #AutoarExtract::completed. After one of these signals is received,
@@ -95,9 +112,58 @@ G_DEFINE_QUARK (autoar-extract, autoar_extract)
   (G_TYPE_INSTANCE_GET_PRIVATE ((o), AUTOAR_TYPE_EXTRACT, AutoarExtractPrivate))
 
 #define BUFFER_SIZE (64 * 1024)
+#define LOCAL_BUFFER_SIZE (1024 * 1024)
+#define COPY_CHUNK_SIZE (16 * 1024 * 1024)
+#define PIPELINE_SIZE 32
+#define DIR_FD_CACHE_SIZE 16
 #define NOT_AN_ARCHIVE_ERRNO 2013
-
-typedef struct _GFileAndInfo GFileAndInfo;
+#define SINK_FAILED_ERRNO 2014
+#define VERIFY_FAILED_ERRNO 2015
+
+#define SCAN_CACHE_VERSION 4
+#define SCAN_CACHE_GROUP "Scan"
+#define SCAN_CACHE_ATTRIBUTES \
+  G_FILE_ATTRIBUTE_STANDARD_SIZE "," \
+  G_FILE_ATTRIBUTE_TIME_MODIFIED "," \
+  G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC "," \
+  G_FILE_ATTRIBUTE_UNIX_DEVICE "," \
+  G_FILE_ATTRIBUTE_UNIX_INODE
+
+typedef struct _AutoarExtractMeta AutoarExtractMeta;
+typedef struct _AutoarExtractDirMeta AutoarExtractDirMeta;
+typedef struct _AutoarExtractReader AutoarExtractReader;
+typedef struct _AutoarExtractWorker AutoarExtractWorker;
+typedef struct _AutoarExtractBlock AutoarExtractBlock;
+typedef struct _AutoarExtractPipeline AutoarExtractPipeline;
+typedef struct _AutoarExtractPool AutoarExtractPool;
+typedef struct _AutoarExtractDirFd AutoarExtractDirFd;
+typedef struct _AutoarExtractSlice AutoarExtractSlice;
+typedef struct _AutoarExtractMatcher AutoarExtractMatcher;
+typedef struct _AutoarExtractInclude AutoarExtractInclude;
+
+struct _AutoarExtractReader
+{
+  AutoarExtract *arextract;
+  GInputStream  *istream;
+  void          *buffer;
+  gssize         buffer_size;
+  GError       **error;
+
+  /* Used instead of the stream if the whole archive is in memory */
+  const char    *mem;
+  gsize          mem_size;
+  gint64         mem_offset;
+
+  /* Used instead of the stream for local files */
+  int            fd;
+
+  /* Data read from a source stream while the format is detected. A stream
+   * cannot be read again, so they are replayed if the archive is opened
+   * again with the raw format. */
+  GByteArray    *replay;
+  gsize          replay_offset;
+  gboolean       replay_done;
+};
 
 struct _AutoarExtractPrivate
 {
@@ -110,52 +176,218 @@ struct _AutoarExtractPrivate
 
   int source_is_mem  : 1;
   int output_is_dest : 1;
+  int single_pass    : 1;
+  int use_scan_cache : 1;
+  int preallocate    : 1;
+  int use_sink       : 1;
+  int verify         : 1;
 
   AutoarPref *arpref;
 
+  /* Receives the entries instead of the file system if use_sink is set */
+  AutoarExtractSink sink;
+  gpointer          sink_data;
+  GDestroyNotify    sink_data_free;
+
+  /* Used by the built-in sink. Keys are path names and values are GBytes. */
+  GHashTable *sink_bytes;
+  GByteArray *sink_current;
+
+  /* Results of the verify mode */
+  guint   verify_failed;
+  guint64 verify_size;
+  gint64  verify_time;
+
   const void *source_buffer;
   gsize source_buffer_size;
+  GBytes *source_bytes;
+  GInputStream *source_stream;
 
   GCancellable *cancellable;
 
   gint64 notify_interval;
 
+  guint n_threads;
+  guint64 small_file_size;
+
   /* Variables used to show progess */
   guint64 size;
-  guint64 completed_size;
-
   guint files;
-  guint completed_files;
-
-  gint64 notify_last;
+  AutoarCommonProgress progress;
+  AutoarCommonSignalPool signal_pool;
 
   /* Internal variables */
-  GInputStream *istream;
-  void         *buffer;
-  gssize        buffer_size;
-  GError       *error;
+  AutoarExtractReader reader;
+  GError             *error;
+
+  /* Protect progress counters and shared tables while the parallel engine
+   * is running */
+  GMutex  mutex;
+  GCond   cond;
+  int     parallel_next;
+  int     parallel_failed;
+  guint   parallel_running;
+  GArray *parallel_deferred;
+  GHashTable *parallel_paths;
+
+  AutoarExtractPipeline *pipeline;
+  AutoarExtractPool     *pool;
 
-  GHashTable *userhash;
-  GHashTable *grouphash;
   GHashTable *bad_filename;
-  GPtrArray  *pattern_compiled;
+  GArray     *bad_entries;
+  AutoarExtractMatcher *pattern_matcher;
+
+  /* Only entries matching these patterns are extracted if it is not NULL.
+   * Literal paths are keyed by AutoarExtractSlice. */
+  char      **include_patterns;
+  GHashTable *include_literals;
+  GPtrArray  *include_wildcards;
+  guint       include_pending;  /* Literal paths not found yet */
+  guint       entries_end;      /* Ordinal of the first entry not needed */
   GArray     *extracted_dir_list;
+
+  /* Directories known to exist and the most recently used file descriptors
+   * of them. Protected by the mutex. */
+  GHashTable *dir_known;
+  GHashTable *dir_fds;
+  GQueue      dir_lru;
   GFile      *top_level_dir;
+  GFile      *staging_dir;
+  GFile      *staged_first;
 
   int   pathname_prefix_len;
+  char *pathname_prefix;
   char *pathname_basename;
   char *suggested_destname;
 
+  int archive_format;
+  int archive_filter;
+
   int in_thread         : 1;
+  int in_parallel       : 1;
   int use_raw_format    : 1;
   int has_top_level_dir : 1;
   int has_only_one_file : 1;
+  int can_chown         : 1;
+
+  /* Owner of the process, detected once when extracting starts */
+  guint32 euid;
+};
+
+struct _AutoarExtractSlice
+{
+  const char *str;
+  gsize       len;
+};
+
+struct _AutoarExtractInclude
+{
+  AutoarExtractSlice slice;
+  gboolean found;
+};
+
+struct _AutoarExtractMatcher
+{
+  /* Patterns are sorted by their shapes, so most of them can be matched by
+   * hashing a part of a path component. Keys are AutoarExtractSlice. */
+  GHashTable *literals;         /* "name" */
+  GHashTable *prefixes;         /* "name*" without the star */
+  GHashTable *suffixes;         /* "*.ext" without the star */
+  GArray     *prefix_lengths;   /* Distinct lengths of prefixes */
+  GArray     *suffix_lengths;   /* Distinct lengths of suffixes */
+  GPtrArray  *wildcards;        /* Other patterns */
 };
 
-struct _GFileAndInfo
+struct _AutoarExtractMeta
+{
+  /* Metadata applied to an extracted file. Owners are only set if they
+   * differ from the owner of the process and the process can change them. */
+  gint64  atime;
+  gint64  mtime;
+  guint32 atime_nsec;
+  guint32 mtime_nsec;
+  guint32 uid;
+  guint32 gid;
+  guint32 mode;
+
+  int has_atime : 1;
+  int has_mtime : 1;
+  int has_uid   : 1;
+  int has_gid   : 1;
+};
+
+struct _AutoarExtractDirMeta
 {
   GFile *file;
-  GFileInfo *info;
+  AutoarExtractMeta meta;
+};
+
+struct _AutoarExtractDirFd
+{
+  char *path;
+  int   fd;
+  int   users;
+  int   evicted;
+};
+
+struct _AutoarExtractWorker
+{
+  AutoarExtractReader reader;
+  GError  *error;
+  GThread *thread;
+};
+
+typedef enum
+{
+  AUTOAR_EXTRACT_BLOCK_ENTRY,   /* Header of an entry */
+  AUTOAR_EXTRACT_BLOCK_DATA,    /* Data of the previous entry */
+  AUTOAR_EXTRACT_BLOCK_COPY,    /* Data of the previous entry in the source */
+  AUTOAR_EXTRACT_BLOCK_END,     /* No more data for the previous entry */
+  AUTOAR_EXTRACT_BLOCK_FINISH   /* No more entries */
+} AutoarExtractBlockType;
+
+struct _AutoarExtractBlock
+{
+  AutoarExtractBlockType type;
+  struct archive_entry *entry;
+  GFile  *dest;
+  void   *buffer;
+  size_t  buffer_size;
+  size_t  size;
+  gint64  offset;
+  gint64  source_offset;
+};
+
+struct _AutoarExtractPipeline
+{
+  /* Single-producer single-consumer ring. The decoding thread only moves the
+   * head and the writing thread only moves the tail. The mutex and the
+   * condition are only used to sleep when the ring is full or empty. */
+  AutoarExtractBlock blocks[PIPELINE_SIZE];
+  int head;
+  int tail;
+  int producer_waiting;
+  int consumer_waiting;
+  int aborted;
+  int holding;
+
+  GMutex   mutex;
+  GCond    cond;
+  GThread *thread;
+  GError  *error;
+};
+
+struct _AutoarExtractPool
+{
+  /* Small files waiting for writer threads. All fields except for the
+   * thread pool itself are protected by priv->mutex. */
+  GThreadPool *threads;
+  GHashTable  *paths;
+  GSList      *free_blocks;
+  guint        pending;
+  guint        max_pending;
+  GError      *error;
+  int          failed;
 };
 
 enum
@@ -166,6 +398,7 @@ enum
   CANCELLED,
   COMPLETED,
   AR_ERROR,
+  ENTRY_FAILED,
   LAST_SIGNAL
 };
 
@@ -182,7 +415,14 @@ enum
   PROP_COMPLETED_FILES,
   PROP_SOURCE_IS_MEM,    /* Must be set when constructing object */
   PROP_OUTPUT_IS_DEST,
-  PROP_NOTIFY_INTERVAL
+  PROP_NOTIFY_INTERVAL,
+  PROP_SINGLE_PASS,
+  PROP_USE_SCAN_CACHE,
+  PROP_N_THREADS,
+  PROP_SMALL_FILE_SIZE,
+  PROP_PREALLOCATE,
+  PROP_INCLUDE_PATTERNS,
+  PROP_VERIFY
 };
 
 static guint autoar_extract_signals[LAST_SIGNAL] = { 0 };
@@ -216,13 +456,13 @@ autoar_extract_get_property (GObject    *object,
       g_value_set_uint64 (value, priv->size);
       break;
     case PROP_COMPLETED_SIZE:
-      g_value_set_uint64 (value, priv->completed_size);
+      g_value_set_uint64 (value, autoar_common_progress_get_size (&(priv->progress)));
       break;
     case PROP_FILES:
       g_value_set_uint (value, priv->files);
       break;
     case PROP_COMPLETED_FILES:
-      g_value_set_uint (value, priv->completed_files);
+      g_value_set_uint (value, autoar_common_progress_get_files (&(priv->progress)));
       break;
     case PROP_SOURCE_IS_MEM:
       g_value_set_boolean (value, priv->source_is_mem);
@@ -233,6 +473,27 @@ autoar_extract_get_property (GObject    *object,
     case PROP_NOTIFY_INTERVAL:
       g_value_set_int64 (value, priv->notify_interval);
       break;
+    case PROP_SINGLE_PASS:
+      g_value_set_boolean (value, priv->single_pass);
+      break;
+    case PROP_USE_SCAN_CACHE:
+      g_value_set_boolean (value, priv->use_scan_cache);
+      break;
+    case PROP_N_THREADS:
+      g_value_set_uint (value, priv->n_threads);
+      break;
+    case PROP_SMALL_FILE_SIZE:
+      g_value_set_uint64 (value, priv->small_file_size);
+      break;
+    case PROP_PREALLOCATE:
+      g_value_set_boolean (value, priv->preallocate);
+      break;
+    case PROP_INCLUDE_PATTERNS:
+      g_value_set_boxed (value, priv->include_patterns);
+      break;
+    case PROP_VERIFY:
+      g_value_set_boolean (value, priv->verify);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -277,6 +538,27 @@ autoar_extract_set_property (GObject      *object,
     case PROP_NOTIFY_INTERVAL:
       autoar_extract_set_notify_interval (arextract, g_value_get_int64 (value));
       break;
+    case PROP_SINGLE_PASS:
+      autoar_extract_set_single_pass (arextract, g_value_get_boolean (value));
+      break;
+    case PROP_USE_SCAN_CACHE:
+      autoar_extract_set_use_scan_cache (arextract, g_value_get_boolean (value));
+      break;
+    case PROP_N_THREADS:
+      autoar_extract_set_n_threads (arextract, g_value_get_uint (value));
+      break;
+    case PROP_SMALL_FILE_SIZE:
+      autoar_extract_set_small_file_size (arextract, g_value_get_uint64 (value));
+      break;
+    case PROP_PREALLOCATE:
+      autoar_extract_set_preallocate (arextract, g_value_get_boolean (value));
+      break;
+    case PROP_INCLUDE_PATTERNS:
+      autoar_extract_set_include_patterns (arextract, g_value_get_boxed (value));
+      break;
+    case PROP_VERIFY:
+      autoar_extract_set_verify (arextract, g_value_get_boolean (value));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -378,7 +660,7 @@ guint64
 autoar_extract_get_completed_size (AutoarExtract *arextract)
 {
   g_return_val_if_fail (AUTOAR_IS_EXTRACT (arextract), 0);
-  return arextract->priv->completed_size;
+  return autoar_common_progress_get_size (&(arextract->priv->progress));
 }
 
 /**
@@ -409,7 +691,7 @@ guint
 autoar_extract_get_completed_files (AutoarExtract *arextract)
 {
   g_return_val_if_fail (AUTOAR_IS_EXTRACT (arextract), 0);
-  return arextract->priv->completed_files;
+  return autoar_common_progress_get_files (&(arextract->priv->progress));
 }
 
 /**
@@ -459,6 +741,170 @@ autoar_extract_get_notify_interval (AutoarExtract *arextract)
   return arextract->priv->notify_interval;
 }
 
+/**
+ * autoar_extract_get_single_pass:
+ * @arextract: an #AutoarExtract
+ *
+ * See autoar_extract_set_single_pass().
+ *
+ * Returns: %TRUE if the archive is decoded only once
+ **/
+gboolean
+autoar_extract_get_single_pass (AutoarExtract *arextract)
+{
+  g_return_val_if_fail (AUTOAR_IS_EXTRACT (arextract), FALSE);
+  return arextract->priv->single_pass;
+}
+
+/**
+ * autoar_extract_get_use_scan_cache:
+ * @arextract: an #AutoarExtract
+ *
+ * See autoar_extract_set_use_scan_cache().
+ *
+ * Returns: %TRUE if the results of scanning are cached on disk
+ **/
+gboolean
+autoar_extract_get_use_scan_cache (AutoarExtract *arextract)
+{
+  g_return_val_if_fail (AUTOAR_IS_EXTRACT (arextract), FALSE);
+  return arextract->priv->use_scan_cache;
+}
+
+/**
+ * autoar_extract_get_n_threads:
+ * @arextract: an #AutoarExtract
+ *
+ * See autoar_extract_set_n_threads().
+ *
+ * Returns: the maximal number of threads used to extract files, or 0 if the
+ * number of processors is used
+ **/
+guint
+autoar_extract_get_n_threads (AutoarExtract *arextract)
+{
+  g_return_val_if_fail (AUTOAR_IS_EXTRACT (arextract), 1);
+  return arextract->priv->n_threads;
+}
+
+/**
+ * autoar_extract_get_small_file_size:
+ * @arextract: an #AutoarExtract
+ *
+ * See autoar_extract_set_small_file_size().
+ *
+ * Returns: the maximal size of files written by the writer threads
+ **/
+guint64
+autoar_extract_get_small_file_size (AutoarExtract *arextract)
+{
+  g_return_val_if_fail (AUTOAR_IS_EXTRACT (arextract), 0);
+  return arextract->priv->small_file_size;
+}
+
+/**
+ * autoar_extract_get_preallocate:
+ * @arextract: an #AutoarExtract
+ *
+ * See autoar_extract_set_preallocate().
+ *
+ * Returns: %TRUE if disk space is allocated before writing regular files
+ **/
+gboolean
+autoar_extract_get_preallocate (AutoarExtract *arextract)
+{
+  g_return_val_if_fail (AUTOAR_IS_EXTRACT (arextract), FALSE);
+  return arextract->priv->preallocate;
+}
+
+/**
+ * autoar_extract_get_include_patterns:
+ * @arextract: an #AutoarExtract
+ *
+ * See autoar_extract_set_include_patterns().
+ *
+ * Returns: (transfer none) (allow-none): a %NULL-terminated array of
+ * patterns, or %NULL if all entries are extracted
+ **/
+const char**
+autoar_extract_get_include_patterns (AutoarExtract *arextract)
+{
+  g_return_val_if_fail (AUTOAR_IS_EXTRACT (arextract), NULL);
+  return (const char**)(arextract->priv->include_patterns);
+}
+
+/**
+ * autoar_extract_get_sink_bytes:
+ * @arextract: an #AutoarExtract
+ *
+ * Gets the contents of the regular files collected after
+ * autoar_extract_set_sink_bytes() is called. The table should only be read
+ * after #AutoarExtract::completed is emitted.
+ *
+ * Returns: (transfer none) (element-type utf8 GBytes) (allow-none): a
+ * #GHashTable mapping path names in the archive to #GBytes, or %NULL if the
+ * built-in sink is not used
+ **/
+GHashTable*
+autoar_extract_get_sink_bytes (AutoarExtract *arextract)
+{
+  g_return_val_if_fail (AUTOAR_IS_EXTRACT (arextract), NULL);
+  return arextract->priv->sink_bytes;
+}
+
+/**
+ * autoar_extract_get_verify:
+ * @arextract: an #AutoarExtract
+ *
+ * See autoar_extract_set_verify().
+ *
+ * Returns: %TRUE if the archive is tested instead of extracted
+ **/
+gboolean
+autoar_extract_get_verify (AutoarExtract *arextract)
+{
+  g_return_val_if_fail (AUTOAR_IS_EXTRACT (arextract), FALSE);
+  return arextract->priv->verify;
+}
+
+/**
+ * autoar_extract_get_failed_entries:
+ * @arextract: an #AutoarExtract
+ *
+ * Gets the number of entries reported by #AutoarExtract::entry-failed.
+ *
+ * Returns: the number of entries which cannot be decoded
+ **/
+guint
+autoar_extract_get_failed_entries (AutoarExtract *arextract)
+{
+  g_return_val_if_fail (AUTOAR_IS_EXTRACT (arextract), 0);
+  return arextract->priv->verify_failed;
+}
+
+/**
+ * autoar_extract_get_throughput:
+ * @arextract: an #AutoarExtract
+ *
+ * Gets the speed of decoding in verify mode, which should be read after
+ * #AutoarExtract::completed or #AutoarExtract::error is emitted.
+ *
+ * Returns: decoded bytes per second, or 0 if the archive is not tested
+ **/
+gdouble
+autoar_extract_get_throughput (AutoarExtract *arextract)
+{
+  AutoarExtractPrivate *priv;
+
+  g_return_val_if_fail (AUTOAR_IS_EXTRACT (arextract), 0);
+  priv = arextract->priv;
+
+  if (priv->verify_time <= 0)
+    return 0;
+
+  return priv->verify_size * (gdouble)G_USEC_PER_SEC / priv->verify_time;
+}
+
 /**
  * autoar_extract_set_output_is_dest:
  * @arextract: an #AutoarExtract
@@ -505,57 +951,525 @@ autoar_extract_set_notify_interval (AutoarExtract *arextract,
   arextract->priv->notify_interval = notify_interval;
 }
 
-static void
-autoar_extract_dispose (GObject *object)
+/**
+ * autoar_extract_set_single_pass:
+ * @arextract: an #AutoarExtract
+ * @single_pass: %TRUE if the archive should be decoded only once
+ *
+ * By default #AutoarExtract reads the source archive twice. The first pass
+ * only scans file names to decide whether the archive has a top-level
+ * directory, and the second pass writes the files. If
+ * #AutoarExtract:single-pass is %TRUE, files are written to a hidden staging
+ * directory next to the destination in the only pass, and they are moved to
+ * the final location after the layout is decided. #AutoarExtract::scanned and
+ * #AutoarExtract::decide-dest are emitted after all files are written in this
+ * mode, so #AutoarExtract:size and #AutoarExtract:files only count the entries
+ * read so far until #AutoarExtract::scanned is emitted. This function should only be called
+ * before calling autoar_extract_start() or autoar_extract_start_async().
+ **/
+void
+autoar_extract_set_single_pass (AutoarExtract *arextract,
+                                gboolean single_pass)
 {
-  AutoarExtract *arextract;
-  AutoarExtractPrivate *priv;
+  g_return_if_fail (AUTOAR_IS_EXTRACT (arextract));
+  arextract->priv->single_pass = single_pass;
+}
 
-  arextract = AUTOAR_EXTRACT (object);
-  priv = arextract->priv;
+/**
+ * autoar_extract_set_use_scan_cache:
+ * @arextract: an #AutoarExtract
+ * @use_scan_cache: %TRUE if the results of scanning should be cached on disk
+ *
+ * Scanning file names in the source archive requires reading the whole
+ * archive. If #AutoarExtract:use-scan-cache is %TRUE, the results of scanning
+ * are saved in the user cache directory, so extracting the same archive again
+ * can skip the scanning. The cached results are identified by the URI, size,
+ * modification time and inode of the source archive, and they are discarded
+ * when any of them changes or the patterns to ignore are changed. The cache is
+ * not used if the source archive is a memory buffer or
+ * #AutoarExtract:single-pass is %TRUE. This function should only be called
+ * before calling autoar_extract_start() or autoar_extract_start_async().
+ **/
+void
+autoar_extract_set_use_scan_cache (AutoarExtract *arextract,
+                                   gboolean use_scan_cache)
+{
+  g_return_if_fail (AUTOAR_IS_EXTRACT (arextract));
+  arextract->priv->use_scan_cache = use_scan_cache;
+}
 
-  g_debug ("AutoarExtract: dispose");
+/**
+ * autoar_extract_set_n_threads:
+ * @arextract: an #AutoarExtract
+ * @n_threads: the maximal number of threads used to extract files, or 0 to
+ * use the number of processors
+ *
+ * Entries in zip archives can be located without decoding other entries. If
+ * @n_threads is not 1 and the source archive is a zip archive, several
+ * readers are opened on the source archive and entries are extracted in
+ * parallel. Other archives are always extracted in the thread running the
+ * extracting work. This function should only be called before
+ * calling autoar_extract_start() or autoar_extract_start_async().
+ **/
+void
+autoar_extract_set_n_threads (AutoarExtract *arextract,
+                              guint n_threads)
+{
+  g_return_if_fail (AUTOAR_IS_EXTRACT (arextract));
+  arextract->priv->n_threads = n_threads;
+}
 
-  if (priv->istream != NULL) {
-    if (!g_input_stream_is_closed (priv->istream)) {
-      g_input_stream_close (priv->istream, priv->cancellable, NULL);
-    }
-    g_object_unref (priv->istream);
-    priv->istream = NULL;
-  }
+/**
+ * autoar_extract_set_small_file_size:
+ * @arextract: an #AutoarExtract
+ * @small_file_size: the maximal size of files written by the writer threads,
+ * or 0 to disable the writer threads
+ *
+ * If the archive cannot be extracted in parallel and
+ * #AutoarExtract:n-threads is not 1, regular files not larger than
+ * @small_file_size are read into memory and written by a pool of writer
+ * threads, so the latency of creating many small files is overlapped. Other
+ * entries are still written in the order they appear in the archive. This
+ * function should only be called before calling autoar_extract_start() or
+ * autoar_extract_start_async().
+ **/
+void
+autoar_extract_set_small_file_size (AutoarExtract *arextract,
+                                    guint64 small_file_size)
+{
+  g_return_if_fail (AUTOAR_IS_EXTRACT (arextract));
+  arextract->priv->small_file_size = small_file_size;
+}
 
-  g_clear_object (&(priv->source_file));
-  g_clear_object (&(priv->output_file));
-  g_clear_object (&(priv->arpref));
-  g_clear_object (&(priv->top_level_dir));
-  g_clear_object (&(priv->cancellable));
+/**
+ * autoar_extract_set_preallocate:
+ * @arextract: an #AutoarExtract
+ * @preallocate: %TRUE if disk space should be allocated before writing
+ * regular files
+ *
+ * If #AutoarExtract:preallocate is %TRUE, disk space for regular files larger
+ * than the read buffer is allocated according to the size recorded in the
+ * archive before any data are written, which reduces fragmentation of large
+ * files. Files are truncated if the archive contains less data than recorded.
+ * Sparse files, files written with raw format and files on locations which are
+ * not local are not preallocated. This function should only be called before
+ * calling autoar_extract_start() or autoar_extract_start_async().
+ **/
+void
+autoar_extract_set_preallocate (AutoarExtract *arextract,
+                                gboolean preallocate)
+{
+  g_return_if_fail (AUTOAR_IS_EXTRACT (arextract));
+  arextract->priv->preallocate = preallocate;
+}
 
-  if (priv->userhash != NULL) {
-    g_hash_table_unref (priv->userhash);
-    priv->userhash = NULL;
-  }
+/**
+ * autoar_extract_set_include_patterns:
+ * @arextract: an #AutoarExtract
+ * @patterns: (allow-none): a %NULL-terminated array of patterns, or %NULL
+ * to extract all entries
+ *
+ * Extracts only the entries whose path in the archive, or the path of one of
+ * their parent directories, matches one of @patterns. A pattern is either a
+ * literal path, such as "etc/app.conf" or "doc", or a pattern accepted by
+ * #GPatternSpec, in which "*" also matches "/". Leading "./" and "/" are
+ * ignored in both patterns and path names. Entries matching
+ * #AutoarPref:pattern-to-ignore are still skipped.
+ *
+ * The data of other entries are skipped without being decoded when the format
+ * allows it, and zip archives seek to the wanted entries directly. If all
+ * patterns are literal paths, reading stops as soon as each of them is found
+ * as an entry which is not a directory, so later entries with the same path
+ * are not extracted. This function should only be called before calling
+ * autoar_extract_start() or autoar_extract_start_async().
+ **/
+void
+autoar_extract_set_include_patterns (AutoarExtract *arextract,
+                                     const char **patterns)
+{
+  g_return_if_fail (AUTOAR_IS_EXTRACT (arextract));
+  g_strfreev (arextract->priv->include_patterns);
+  arextract->priv->include_patterns = g_strdupv ((char**)patterns);
+}
 
-  if (priv->grouphash != NULL) {
-    g_hash_table_unref (priv->grouphash);
-    priv->grouphash = NULL;
-  }
+/**
+ * autoar_extract_set_verify:
+ * @arextract: an #AutoarExtract
+ * @verify: %TRUE if the archive should be tested instead of extracted
+ *
+ * If #AutoarExtract:verify is %TRUE, the data of every entry are decoded, so
+ * checksums recorded in the archive are checked by libarchive, and then
+ * discarded. No file or directory is created, no metadata are applied and
+ * the source archive is never deleted, so #AutoarExtract::decide-dest is not
+ * emitted. An entry whose data cannot be decoded is reported by
+ * #AutoarExtract::entry-failed and the remaining entries are still tested.
+ * If any entry fails, #AutoarExtract::error is emitted at the end instead of
+ * #AutoarExtract::completed. Include patterns and
+ * #AutoarPref:pattern-to-ignore are applied, and the sink set by
+ * autoar_extract_set_sink() is not used. This function should only be called
+ * before calling autoar_extract_start() or autoar_extract_start_async().
+ **/
+void
+autoar_extract_set_verify (AutoarExtract *arextract,
+                           gboolean verify)
+{
+  g_return_if_fail (AUTOAR_IS_EXTRACT (arextract));
+  arextract->priv->verify = verify;
+}
 
-  if (priv->bad_filename != NULL) {
-    g_hash_table_unref (priv->bad_filename);
-    priv->bad_filename = NULL;
-  }
+/**
+ * autoar_extract_set_sink:
+ * @arextract: an #AutoarExtract
+ * @sink: (allow-none): callbacks receiving the entries, or %NULL to write
+ * them to the file system
+ * @user_data: data passed to the callbacks
+ * @user_data_free: (allow-none): function to free @user_data, or %NULL
+ *
+ * Passes the entries of the archive to @sink instead of writing them to the
+ * file system. Entries are passed in the order they appear in the archive,
+ * and the callbacks are called in the thread running the extracting work.
+ * Include patterns and #AutoarPref:pattern-to-ignore are still applied, but
+ * no file or directory is created in the output directory, so
+ * #AutoarExtract::decide-dest is not emitted. The content of @sink is copied.
+ * This function should only be called before calling autoar_extract_start()
+ * or autoar_extract_start_async().
+ **/
+void
+autoar_extract_set_sink (AutoarExtract *arextract,
+                         const AutoarExtractSink *sink,
+                         gpointer user_data,
+                         GDestroyNotify user_data_free)
+{
+  AutoarExtractPrivate *priv;
 
-  if (priv->pattern_compiled != NULL) {
-    g_ptr_array_unref (priv->pattern_compiled);
-    priv->pattern_compiled = NULL;
-  }
+  g_return_if_fail (AUTOAR_IS_EXTRACT (arextract));
+  priv = arextract->priv;
 
-  if (priv->extracted_dir_list != NULL) {
-    g_array_unref (priv->extracted_dir_list);
-    priv->extracted_dir_list = NULL;
-  }
+  if (priv->sink_data_free != NULL)
+    (*(priv->sink_data_free))(priv->sink_data);
 
-  G_OBJECT_CLASS (autoar_extract_parent_class)->dispose (object);
+  priv->use_sink = sink != NULL;
+  if (sink != NULL)
+    priv->sink = *sink;
+  priv->sink_data = user_data;
+  priv->sink_data_free = user_data_free;
+}
+
+static gboolean
+autoar_extract_bytes_begin_entry (AutoarExtract *arextract,
+                                  const AutoarEntryInfo *info,
+                                  gpointer user_data,
+                                  GError **error)
+{
+  AutoarExtractPrivate *priv;
+
+  priv = arextract->priv;
+
+  if (!S_ISREG (info->mode))
+    return FALSE;
+
+  /* A hard link shares the content of the file it links to */
+  if (info->hardlink != NULL) {
+    GBytes *bytes = g_hash_table_lookup (priv->sink_bytes, info->hardlink);
+    if (bytes != NULL)
+      g_hash_table_replace (priv->sink_bytes,
+                            g_strdup (info->pathname), g_bytes_ref (bytes));
+    return FALSE;
+  }
+
+  priv->sink_current =
+    g_byte_array_sized_new (info->size > 0 && info->size <= G_MAXUINT ?
+                            info->size : 0);
+
+  return TRUE;
+}
+
+static gboolean
+autoar_extract_bytes_write_data (AutoarExtract *arextract,
+                                 const AutoarEntryInfo *info,
+                                 const void *data,
+                                 gsize size,
+                                 gint64 offset,
+                                 gpointer user_data,
+                                 GError **error)
+{
+  GByteArray *current;
+  guint len;
+
+  current = arextract->priv->sink_current;
+
+  if (offset < 0 || (guint64)offset + size > G_MAXUINT) {
+    g_set_error (error, AUTOAR_EXTRACT_ERROR, SINK_FAILED_ERRNO,
+                 "\'%s\': %s", info->pathname, "too large to be stored in memory");
+    return FALSE;
+  }
+
+  /* Holes of sparse files are filled with zeros */
+  len = current->len;
+  g_byte_array_set_size (current, offset);
+  if (offset > len)
+    memset (current->data + len, 0, offset - len);
+
+  g_byte_array_append (current, data, size);
+
+  return TRUE;
+}
+
+static gboolean
+autoar_extract_bytes_end_entry (AutoarExtract *arextract,
+                                const AutoarEntryInfo *info,
+                                gpointer user_data,
+                                GError **error)
+{
+  AutoarExtractPrivate *priv;
+  GByteArray *current;
+  guint len;
+
+  priv = arextract->priv;
+  current = priv->sink_current;
+  priv->sink_current = NULL;
+
+  /* The last hole of a sparse file is not passed as data */
+  len = current->len;
+  if (info->size > len && info->size <= G_MAXUINT) {
+    g_byte_array_set_size (current, info->size);
+    memset (current->data + len, 0, info->size - len);
+  }
+
+  g_hash_table_replace (priv->sink_bytes, g_strdup (info->pathname),
+                        g_byte_array_free_to_bytes (current));
+
+  return TRUE;
+}
+
+static const AutoarExtractSink autoar_extract_bytes_sink = {
+  autoar_extract_bytes_begin_entry,
+  autoar_extract_bytes_write_data,
+  autoar_extract_bytes_end_entry
+};
+
+/**
+ * autoar_extract_set_sink_bytes:
+ * @arextract: an #AutoarExtract
+ *
+ * Collects the contents of regular files in the archive into memory instead
+ * of writing them to the file system. The contents can be got with
+ * autoar_extract_get_sink_bytes() after #AutoarExtract::completed is
+ * emitted. Hard links share the content of their targets, and other types of
+ * entries are skipped. This is a sink set with autoar_extract_set_sink(), so
+ * the notes of that function also apply. This function should only be called
+ * before calling autoar_extract_start() or autoar_extract_start_async().
+ **/
+void
+autoar_extract_set_sink_bytes (AutoarExtract *arextract)
+{
+  g_return_if_fail (AUTOAR_IS_EXTRACT (arextract));
+
+  autoar_extract_set_sink (arextract, &autoar_extract_bytes_sink, NULL, NULL);
+
+  if (arextract->priv->sink_bytes == NULL)
+    arextract->priv->sink_bytes =
+      g_hash_table_new_full (g_str_hash, g_str_equal,
+                             g_free, (GDestroyNotify)g_bytes_unref);
+}
+
+static void
+autoar_extract_do_dir_cache_clear (AutoarExtract *arextract)
+{
+  AutoarExtractPrivate *priv;
+  AutoarExtractDirFd *dir_fd;
+
+  priv = arextract->priv;
+
+  while ((dir_fd = g_queue_pop_head (&(priv->dir_lru))) != NULL) {
+    close (dir_fd->fd);
+    g_free (dir_fd->path);
+    g_free (dir_fd);
+  }
+  /* File descriptors which are still in use are never left in the cache */
+  g_hash_table_remove_all (priv->dir_fds);
+}
+
+static guint
+autoar_extract_slice_hash (gconstpointer key)
+{
+  const AutoarExtractSlice *slice = key;
+  guint32 h = 5381;
+  gsize i;
+
+  for (i = 0; i < slice->len; i++)
+    h = (h << 5) + h + (guchar)(slice->str[i]);
+
+  return h;
+}
+
+static gboolean
+autoar_extract_slice_equal (gconstpointer a,
+                            gconstpointer b)
+{
+  const AutoarExtractSlice *sa = a;
+  const AutoarExtractSlice *sb = b;
+
+  return sa->len == sb->len && memcmp (sa->str, sb->str, sa->len) == 0;
+}
+
+static void
+autoar_extract_slice_free (gpointer data)
+{
+  AutoarExtractSlice *slice = data;
+
+  g_free ((char*)(slice->str));
+  g_free (slice);
+}
+
+static void
+autoar_extract_include_free (gpointer data)
+{
+  AutoarExtractInclude *include = data;
+
+  g_free ((char*)(include->slice.str));
+  g_free (include);
+}
+
+static AutoarExtractMatcher*
+autoar_extract_matcher_new (void)
+{
+  AutoarExtractMatcher *matcher;
+
+  matcher = g_new0 (AutoarExtractMatcher, 1);
+  matcher->literals = g_hash_table_new_full (autoar_extract_slice_hash,
+                                             autoar_extract_slice_equal,
+                                             autoar_extract_slice_free, NULL);
+  matcher->prefixes = g_hash_table_new_full (autoar_extract_slice_hash,
+                                             autoar_extract_slice_equal,
+                                             autoar_extract_slice_free, NULL);
+  matcher->suffixes = g_hash_table_new_full (autoar_extract_slice_hash,
+                                             autoar_extract_slice_equal,
+                                             autoar_extract_slice_free, NULL);
+  matcher->prefix_lengths = g_array_new (FALSE, FALSE, sizeof (gsize));
+  matcher->suffix_lengths = g_array_new (FALSE, FALSE, sizeof (gsize));
+  matcher->wildcards = g_ptr_array_new_with_free_func (g_free);
+
+  return matcher;
+}
+
+static void
+autoar_extract_matcher_free (AutoarExtractMatcher *matcher)
+{
+  g_hash_table_unref (matcher->literals);
+  g_hash_table_unref (matcher->prefixes);
+  g_hash_table_unref (matcher->suffixes);
+  g_array_unref (matcher->prefix_lengths);
+  g_array_unref (matcher->suffix_lengths);
+  g_ptr_array_unref (matcher->wildcards);
+  g_free (matcher);
+}
+
+static void
+autoar_extract_dispose (GObject *object)
+{
+  AutoarExtract *arextract;
+  AutoarExtractPrivate *priv;
+
+  arextract = AUTOAR_EXTRACT (object);
+  priv = arextract->priv;
+
+  g_debug ("AutoarExtract: dispose");
+
+  if (priv->reader.istream != NULL) {
+    if (!g_input_stream_is_closed (priv->reader.istream)) {
+      g_input_stream_close (priv->reader.istream, priv->cancellable, NULL);
+    }
+    g_object_unref (priv->reader.istream);
+    priv->reader.istream = NULL;
+  }
+
+  g_clear_object (&(priv->source_file));
+  g_clear_object (&(priv->output_file));
+  g_clear_object (&(priv->arpref));
+  g_clear_object (&(priv->top_level_dir));
+  g_clear_object (&(priv->staging_dir));
+  g_clear_object (&(priv->staged_first));
+  g_clear_object (&(priv->cancellable));
+
+  if (priv->source_bytes != NULL) {
+    g_bytes_unref (priv->source_bytes);
+    priv->source_bytes = NULL;
+    priv->source_buffer = NULL;
+    priv->source_buffer_size = 0;
+  }
+
+  g_clear_object (&(priv->source_stream));
+
+  if (priv->reader.replay != NULL) {
+    g_byte_array_unref (priv->reader.replay);
+    priv->reader.replay = NULL;
+  }
+
+
+  if (priv->sink_data_free != NULL) {
+    (*(priv->sink_data_free))(priv->sink_data);
+    priv->sink_data_free = NULL;
+    priv->sink_data = NULL;
+  }
+
+  if (priv->sink_bytes != NULL) {
+    g_hash_table_unref (priv->sink_bytes);
+    priv->sink_bytes = NULL;
+  }
+
+  if (priv->sink_current != NULL) {
+    g_byte_array_unref (priv->sink_current);
+    priv->sink_current = NULL;
+  }
+
+  if (priv->bad_filename != NULL) {
+    g_hash_table_unref (priv->bad_filename);
+    priv->bad_filename = NULL;
+  }
+
+  if (priv->bad_entries != NULL) {
+    g_array_unref (priv->bad_entries);
+    priv->bad_entries = NULL;
+  }
+
+  if (priv->pattern_matcher != NULL) {
+    autoar_extract_matcher_free (priv->pattern_matcher);
+    priv->pattern_matcher = NULL;
+  }
+
+  if (priv->include_literals != NULL) {
+    g_hash_table_unref (priv->include_literals);
+    priv->include_literals = NULL;
+  }
+
+  if (priv->include_wildcards != NULL) {
+    g_ptr_array_unref (priv->include_wildcards);
+    priv->include_wildcards = NULL;
+  }
+
+  if (priv->extracted_dir_list != NULL) {
+    g_array_unref (priv->extracted_dir_list);
+    priv->extracted_dir_list = NULL;
+  }
+
+  if (priv->parallel_deferred != NULL) {
+    g_array_unref (priv->parallel_deferred);
+    priv->parallel_deferred = NULL;
+  }
+
+  if (priv->dir_fds != NULL) {
+    autoar_extract_do_dir_cache_clear (arextract);
+    g_hash_table_unref (priv->dir_fds);
+    priv->dir_fds = NULL;
+  }
+
+  if (priv->dir_known != NULL) {
+    g_hash_table_unref (priv->dir_known);
+    priv->dir_known = NULL;
+  }
+
+  G_OBJECT_CLASS (autoar_extract_parent_class)->dispose (object);
 }
 
 static void
@@ -572,55 +1486,124 @@ autoar_extract_finalize (GObject *object)
   g_free (priv->source);
   priv->source = NULL;
 
+  g_strfreev (priv->include_patterns);
+  priv->include_patterns = NULL;
+
   g_free (priv->output);
   priv->output = NULL;
 
-  g_free (priv->buffer);
-  priv->buffer = NULL;
+  g_free (priv->reader.buffer);
+  priv->reader.buffer = NULL;
 
   if (priv->error != NULL) {
     g_error_free (priv->error);
     priv->error = NULL;
   }
 
+  g_mutex_clear (&(priv->mutex));
+  g_cond_clear (&(priv->cond));
+
+  g_free (priv->pathname_prefix);
+  priv->pathname_prefix = NULL;
+
   g_free (priv->pathname_basename);
   priv->pathname_basename = NULL;
 
   g_free (priv->suggested_destname);
   priv->suggested_destname = NULL;
 
+  autoar_common_signal_pool_clear (&(priv->signal_pool));
+
   G_OBJECT_CLASS (autoar_extract_parent_class)->finalize (object);
 }
 
+static gboolean
+libarchive_read_open_local (AutoarExtractReader *reader)
+{
+  /* Read local regular files through a file descriptor. The file is not
+   * mapped because truncating it while it is read would raise SIGBUS.
+   * Returns FALSE if GIO should be used instead. */
+
+  AutoarExtractPrivate *priv;
+  struct stat st;
+  char *path;
+  int fd;
+
+  priv = reader->arextract->priv;
+
+  path = g_file_get_path (priv->source_file);
+  if (path == NULL)
+    return FALSE;
+
+  fd = open (path, O_RDONLY | O_CLOEXEC);
+  g_free (path);
+  if (fd < 0)
+    return FALSE;
+
+  if (fstat (fd, &st) < 0 || !S_ISREG (st.st_mode)) {
+    close (fd);
+    return FALSE;
+  }
+
+#ifdef HAVE_POSIX_FADVISE
+  posix_fadvise (fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+  if (reader->buffer_size < LOCAL_BUFFER_SIZE) {
+    g_free (reader->buffer);
+    reader->buffer_size = LOCAL_BUFFER_SIZE;
+    reader->buffer = g_new (char, reader->buffer_size);
+  }
+
+  reader->fd = fd;
+  g_debug ("libarchive_read_open_local: fd %d", fd);
+  return TRUE;
+}
+
+static void
+libarchive_read_set_errno_error (AutoarExtractReader *reader,
+                                 int errsv)
+{
+  if (*(reader->error) == NULL)
+    g_set_error (reader->error, G_IO_ERROR, g_io_error_from_errno (errsv),
+                 "Error reading file '%s': %s",
+                 reader->arextract->priv->source, g_strerror (errsv));
+}
+
 static int
 libarchive_read_open_cb (struct archive *ar_read,
                          void *client_data)
 {
-  AutoarExtract *arextract;
+  AutoarExtractReader *reader;
   AutoarExtractPrivate *priv;
 
   g_debug ("libarchive_read_open_cb: called");
 
-  arextract = (AutoarExtract*)client_data;
-  priv = arextract->priv;
+  reader = (AutoarExtractReader*)client_data;
+  priv = reader->arextract->priv;
 
-  if (priv->error != NULL)
+  if (*(reader->error) != NULL)
     return ARCHIVE_FATAL;
 
-  if (arextract->priv->source_is_mem) {
-    priv->istream =
-      g_memory_input_stream_new_from_data (priv->source_buffer,
-                                           priv->source_buffer_size,
-                                           NULL);
-  } else {
+  if (priv->source_is_mem) {
+    /* libarchive reads the memory buffer directly without copying */
+    reader->mem = priv->source_buffer;
+    reader->mem_size = priv->source_buffer_size;
+    reader->mem_offset = 0;
+  } else if (priv->source_stream != NULL) {
+    reader->istream = g_object_ref (priv->source_stream);
+    if (reader->replay == NULL && !(reader->replay_done))
+      reader->replay = g_byte_array_new ();
+    reader->replay_offset = 0;
+  } else if (!libarchive_read_open_local (reader)) {
     GFileInputStream *istream;
     istream = g_file_read (priv->source_file,
                            priv->cancellable,
-                           &(arextract->priv->error));
-    priv->istream = G_INPUT_STREAM (istream);
+                           reader->error);
+    reader->istream = G_INPUT_STREAM (istream);
   }
 
-  if (priv->error != NULL)
+  if (*(reader->error) != NULL)
     return ARCHIVE_FATAL;
 
   g_debug ("libarchive_read_open_cb: ARCHIVE_OK");
@@ -631,23 +1614,34 @@ static int
 libarchive_read_close_cb (struct archive *ar_read,
                           void *client_data)
 {
-  AutoarExtract *arextract;
+  AutoarExtractReader *reader;
   AutoarExtractPrivate *priv;
 
   g_debug ("libarchive_read_close_cb: called");
 
-  arextract = (AutoarExtract*)client_data;
-  priv = arextract->priv;
+  reader = (AutoarExtractReader*)client_data;
+  priv = reader->arextract->priv;
 
-  if (priv->error != NULL)
-    return ARCHIVE_FATAL;
+  reader->mem = NULL;
+  reader->mem_size = 0;
+  reader->mem_offset = 0;
+
+  if (reader->fd >= 0) {
+    close (reader->fd);
+    reader->fd = -1;
+  }
 
-  if (priv->istream != NULL) {
-    g_input_stream_close (priv->istream, priv->cancellable, NULL);
-    g_object_unref (priv->istream);
-    priv->istream = NULL;
+  if (reader->istream != NULL) {
+    /* Streams passed by the caller are left open */
+    if (reader->istream != priv->source_stream)
+      g_input_stream_close (reader->istream, priv->cancellable, NULL);
+    g_object_unref (reader->istream);
+    reader->istream = NULL;
   }
 
+  if (*(reader->error) != NULL)
+    return ARCHIVE_FATAL;
+
   g_debug ("libarchive_read_close_cb: ARCHIVE_OK");
   return ARCHIVE_OK;
 }
@@ -657,27 +1651,64 @@ libarchive_read_read_cb (struct archive *ar_read,
                          void *client_data,
                          const void **buffer)
 {
-  AutoarExtract *arextract;
+  AutoarExtractReader *reader;
   AutoarExtractPrivate *priv;
   gssize read_size;
 
-  g_debug ("libarchive_read_read_cb: called");
+  reader = (AutoarExtractReader*)client_data;
+  priv = reader->arextract->priv;
 
-  arextract = (AutoarExtract*)client_data;
-  priv = arextract->priv;
+  if (reader->mem != NULL) {
+    *buffer = reader->mem + reader->mem_offset;
+    read_size = reader->mem_size - reader->mem_offset;
+    reader->mem_offset = reader->mem_size;
+    return read_size;
+  }
+
+  if (reader->fd >= 0) {
+    *buffer = reader->buffer;
+    do {
+      read_size = read (reader->fd, reader->buffer, reader->buffer_size);
+    } while (read_size < 0 && errno == EINTR);
+    if (read_size < 0)
+      libarchive_read_set_errno_error (reader, errno);
+    return read_size;
+  }
+
+  /* Only the stream path is traced, so the fast paths never log */
+  g_debug ("libarchive_read_read_cb: called");
 
-  if (priv->error != NULL || priv->istream == NULL)
+  if (*(reader->error) != NULL || reader->istream == NULL)
     return -1;
 
-  *buffer = priv->buffer;
-  read_size = g_input_stream_read (priv->istream,
-                                   priv->buffer,
-                                   priv->buffer_size,
+  if (reader->replay != NULL) {
+    if (reader->replay_offset < reader->replay->len) {
+      *buffer = reader->replay->data + reader->replay_offset;
+      read_size = reader->replay->len - reader->replay_offset;
+      reader->replay_offset = reader->replay->len;
+      return read_size;
+    }
+    /* libarchive has released the last replayed block */
+    if (reader->replay_done) {
+      g_byte_array_unref (reader->replay);
+      reader->replay = NULL;
+    }
+  }
+
+  *buffer = reader->buffer;
+  read_size = g_input_stream_read (reader->istream,
+                                   reader->buffer,
+                                   reader->buffer_size,
                                    priv->cancellable,
-                                   &(priv->error));
-  if (priv->error != NULL)
+                                   reader->error);
+  if (*(reader->error) != NULL)
     return -1;
 
+  if (reader->replay != NULL && read_size > 0) {
+    g_byte_array_append (reader->replay, reader->buffer, read_size);
+    reader->replay_offset = reader->replay->len;
+  }
+
   g_debug ("libarchive_read_read_cb: %" G_GSSIZE_FORMAT, read_size);
   return read_size;
 }
@@ -688,18 +1719,46 @@ libarchive_read_seek_cb (struct archive *ar_read,
                          gint64 request,
                          int whence)
 {
-  AutoarExtract *arextract;
+  AutoarExtractReader *reader;
   AutoarExtractPrivate *priv;
   GSeekable *seekable;
   GSeekType  seektype;
   off_t new_offset;
 
+  reader = (AutoarExtractReader*)client_data;
+  priv = reader->arextract->priv;
+  seekable = (GSeekable*)(reader->istream);
+
+  if (reader->mem != NULL) {
+    switch (whence) {
+      case SEEK_SET:
+        new_offset = request;
+        break;
+      case SEEK_CUR:
+        new_offset = reader->mem_offset + request;
+        break;
+      case SEEK_END:
+        new_offset = reader->mem_size + request;
+        break;
+      default:
+        return -1;
+    }
+    if (new_offset < 0 || new_offset > reader->mem_size)
+      return -1;
+    reader->mem_offset = new_offset;
+    return new_offset;
+  }
+
+  if (reader->fd >= 0) {
+    new_offset = lseek (reader->fd, request, whence);
+    if (new_offset < 0)
+      libarchive_read_set_errno_error (reader, errno);
+    return new_offset;
+  }
+
   g_debug ("libarchive_read_seek_cb: called");
 
-  arextract = (AutoarExtract*)client_data;
-  priv = arextract->priv;
-  seekable = (GSeekable*)(priv->istream);
-  if (priv->error != NULL || priv->istream == NULL)
+  if (*(reader->error) != NULL || reader->istream == NULL)
     return -1;
 
   switch (whence) {
@@ -720,9 +1779,9 @@ libarchive_read_seek_cb (struct archive *ar_read,
                    request,
                    seektype,
                    priv->cancellable,
-                   &(priv->error));
+                   reader->error);
   new_offset = g_seekable_tell (seekable);
-  if (priv->error != NULL)
+  if (*(reader->error) != NULL)
     return -1;
 
   g_debug ("libarchive_read_seek_cb: %"G_GOFFSET_FORMAT, (goffset)new_offset);
@@ -734,17 +1793,31 @@ libarchive_read_skip_cb (struct archive *ar_read,
                          void *client_data,
                          gint64 request)
 {
-  AutoarExtract *arextract;
-  AutoarExtractPrivate *priv;
+  AutoarExtractReader *reader;
   GSeekable *seekable;
   off_t old_offset, new_offset;
 
+  reader = (AutoarExtractReader*)client_data;
+  seekable = (GSeekable*)(reader->istream);
+
+  if (reader->mem != NULL) {
+    if (request > reader->mem_size - reader->mem_offset)
+      request = reader->mem_size - reader->mem_offset;
+    reader->mem_offset += request;
+    return request;
+  }
+
+  if (reader->fd >= 0) {
+    old_offset = lseek (reader->fd, 0, SEEK_CUR);
+    new_offset = lseek (reader->fd, request, SEEK_CUR);
+    if (old_offset < 0 || new_offset < 0)
+      return 0;
+    return new_offset - old_offset;
+  }
+
   g_debug ("libarchive_read_skip_cb: called");
 
-  arextract = (AutoarExtract*)client_data;
-  priv = arextract->priv;
-  seekable = (GSeekable*)(priv->istream);
-  if (priv->error != NULL || priv->istream == NULL) {
+  if (*(reader->error) != NULL || reader->istream == NULL) {
     return -1;
   }
 
@@ -758,7 +1831,7 @@ libarchive_read_skip_cb (struct archive *ar_read,
 
 static int
 libarchive_create_read_object (gboolean use_raw_format,
-                               AutoarExtract *arextract,
+                               AutoarExtractReader *reader,
                                struct archive **a)
 {
   *a = archive_read_new ();
@@ -770,32 +1843,30 @@ libarchive_create_read_object (gboolean use_raw_format,
   archive_read_set_open_callback (*a, libarchive_read_open_cb);
   archive_read_set_read_callback (*a, libarchive_read_read_cb);
   archive_read_set_close_callback (*a, libarchive_read_close_cb);
-  archive_read_set_seek_callback (*a, libarchive_read_seek_cb);
-  archive_read_set_skip_callback (*a, libarchive_read_skip_cb);
-  archive_read_set_callback_data (*a, arextract);
+  /* Without these callbacks, libarchive reads and discards data instead of
+   * skipping them, which is the only way to move forward in a stream */
+  if (reader->arextract->priv->source_stream == NULL) {
+    archive_read_set_seek_callback (*a, libarchive_read_seek_cb);
+    archive_read_set_skip_callback (*a, libarchive_read_skip_cb);
+  }
+  archive_read_set_callback_data (*a, reader);
 
   return archive_read_open1 (*a);
 }
 
-static void
-g_pattern_spec_free_safe (void *pattern_compiled)
-{
-  if (pattern_compiled != NULL)
-    g_pattern_spec_free (pattern_compiled);
-}
 
 static void
-g_file_and_info_free (void *g_file_and_info)
+autoar_extract_dir_meta_free (void *dir_meta)
 {
-  GFileAndInfo *fi = g_file_and_info;
-  g_object_unref (fi->file);
-  g_object_unref (fi->info);
+  AutoarExtractDirMeta *dm = dir_meta;
+  g_object_unref (dm->file);
 }
 
 static inline void
 autoar_extract_signal_scanned (AutoarExtract *arextract)
 {
-  autoar_common_g_signal_emit (arextract, arextract->priv->in_thread,
+  autoar_common_g_signal_emit (arextract, &(arextract->priv->signal_pool),
+                               arextract->priv->in_thread,
                                autoar_extract_signals[SCANNED], 0,
                                arextract->priv->files);
 }
@@ -803,7 +1874,8 @@ autoar_extract_signal_scanned (AutoarExtract *arextract)
 static inline void
 autoar_extract_signal_decide_dest (AutoarExtract *arextract)
 {
-  autoar_common_g_signal_emit (arextract, arextract->priv->in_thread,
+  autoar_common_g_signal_emit (arextract, &(arextract->priv->signal_pool),
+                               arextract->priv->in_thread,
                                autoar_extract_signals[DECIDE_DEST], 0,
                                arextract->priv->top_level_dir);
 }
@@ -811,21 +1883,14 @@ autoar_extract_signal_decide_dest (AutoarExtract *arextract)
 static inline void
 autoar_extract_signal_progress (AutoarExtract *arextract)
 {
-  gint64 mtime;
-  mtime = g_get_monotonic_time ();
-  if (mtime - arextract->priv->notify_last >= arextract->priv->notify_interval) {
-    autoar_common_g_signal_emit (arextract, arextract->priv->in_thread,
-                                 autoar_extract_signals[PROGRESS], 0,
-                                 arextract->priv->completed_size,
-                                 arextract->priv->completed_files);
-    arextract->priv->notify_last = mtime;
-  }
+  autoar_common_progress_notify (&(arextract->priv->progress), FALSE);
 }
 
 static inline void
 autoar_extract_signal_cancelled (AutoarExtract *arextract)
 {
-  autoar_common_g_signal_emit (arextract, arextract->priv->in_thread,
+  autoar_common_g_signal_emit (arextract, &(arextract->priv->signal_pool),
+                               arextract->priv->in_thread,
                                autoar_extract_signals[CANCELLED], 0);
 
 }
@@ -833,7 +1898,8 @@ autoar_extract_signal_cancelled (AutoarExtract *arextract)
 static inline void
 autoar_extract_signal_completed (AutoarExtract *arextract)
 {
-  autoar_common_g_signal_emit (arextract, arextract->priv->in_thread,
+  autoar_common_g_signal_emit (arextract, &(arextract->priv->signal_pool),
+                               arextract->priv->in_thread,
                                autoar_extract_signals[COMPLETED], 0);
 
 }
@@ -848,415 +1914,1522 @@ autoar_extract_signal_error (AutoarExtract *arextract)
       arextract->priv->error = NULL;
       autoar_extract_signal_cancelled (arextract);
     } else {
-      autoar_common_g_signal_emit (arextract, arextract->priv->in_thread,
+      autoar_common_g_signal_emit (arextract, &(arextract->priv->signal_pool),
+                                   arextract->priv->in_thread,
                                    autoar_extract_signals[AR_ERROR], 0,
                                    arextract->priv->error);
     }
   }
 }
 
-static GFile*
-autoar_extract_do_sanitize_pathname (const char *pathname,
-                                     const char *skip_chars,
-                                     GFile *top_level_dir) {
-  const char *pathname_skip_prefix;
-  char **pathname_chunks;
-  GFile *extracted_filename;
-  int i;
+static inline void
+autoar_extract_signal_entry_failed (AutoarExtract *arextract,
+                                   const char *pathname,
+                                   GError *error)
+{
+  autoar_common_g_signal_emit (arextract, &(arextract->priv->signal_pool),
+                               arextract->priv->in_thread,
+                               autoar_extract_signals[ENTRY_FAILED], 0,
+                               pathname, error);
+}
 
-  if (skip_chars != NULL)
-    pathname_skip_prefix = pathname + strspn (pathname, "./");
-  else
-    pathname_skip_prefix = pathname;
+static void
+autoar_extract_do_progress (AutoarExtract *arextract,
+                            guint64 completed_size,
+                            guint completed_files)
+{
+  AutoarExtractPrivate *priv;
 
-  for (; *pathname_skip_prefix == '/'; pathname_skip_prefix++);
-  extracted_filename = g_file_get_child (top_level_dir, pathname_skip_prefix);
+  priv = arextract->priv;
 
-  /* Extracted file should not be located outside the top level directory. */
-  if (!g_file_has_prefix (extracted_filename, top_level_dir)) {
-    pathname_chunks = g_strsplit (pathname_skip_prefix, "/", G_MAXINT);
-    for (i = 0; pathname_chunks[i] != NULL; i++) {
-      if (strcmp (pathname_chunks[i], "..") == 0) {
-        char *pathname_sanitized;
+  autoar_common_progress_add (&(priv->progress),
+                              completed_size, completed_files);
 
-        *pathname_chunks[i] = '\0';
-        pathname_sanitized = g_strjoinv ("/", pathname_chunks);
+  /* Workers of the parallel engine only update counters. The progress signal
+   * is emitted by the thread which started them. */
+  if (!(priv->in_parallel))
+    autoar_extract_signal_progress (arextract);
+}
 
-        g_object_unref (extracted_filename);
-        extracted_filename = g_file_get_child (top_level_dir, pathname_sanitized);
+static void
+autoar_extract_do_free_sanitize_buffer (gpointer buffer)
+{
+  g_string_free (buffer, TRUE);
+}
 
-        g_free (pathname_sanitized);
+/* Reused by every path name sanitized in a thread */
+static GPrivate autoar_extract_sanitize_buffer =
+  G_PRIVATE_INIT (autoar_extract_do_free_sanitize_buffer);
 
-        if (g_file_has_prefix (extracted_filename, top_level_dir))
-          break;
-      }
-    }
-    g_strfreev (pathname_chunks);
+static GString*
+autoar_extract_do_get_sanitize_buffer (void)
+{
+  GString *buffer;
+
+  buffer = g_private_get (&autoar_extract_sanitize_buffer);
+  if (buffer == NULL) {
+    buffer = g_string_sized_new (256);
+    g_private_set (&autoar_extract_sanitize_buffer, buffer);
   }
 
-  return extracted_filename;
+  return buffer;
 }
 
-static gboolean
-autoar_extract_do_pattern_check (const char *path,
-                                 GPtrArray *pattern)
-{
-  char **path_components;
-  GArray *path_components_len;
-
-  int i, j, len;
-
-  path_components = g_strsplit (path, "/", G_MAXINT);
-  path_components_len = g_array_new (FALSE, FALSE, sizeof(size_t));
-  for (i = 0; path_components[i] != NULL; i++) {
-    len = strlen (path_components[i]);
-    g_array_append_val (path_components_len, len);
-  }
-
-  for (i = 0; g_ptr_array_index (pattern, i) != NULL; i++) {
-    for (j = 0; path_components[j] != NULL; j++) {
-      if (g_pattern_match (g_ptr_array_index (pattern, i),
-                           g_array_index (path_components_len, size_t, j),
-                           path_components[j],
-                           NULL)) {
-        g_debug ("autoar_extract_do_pattern_check: ### %s", path_components[j]);
-        g_strfreev (path_components);
-        g_array_unref (path_components_len);
-        return FALSE;
-      }
-    }
-  }
+static GFile*
+autoar_extract_do_sanitize_pathname (const char *pathname,
+                                     const char *skip_chars,
+                                     GFile *top_level_dir) {
+  /* Extracted file should not be located outside the top level directory.
+   * The path name is normalized as a string, so the only allocation is the
+   * returned GFile. */
 
-  g_strfreev (path_components);
-  g_array_unref (path_components_len);
+  GString *buffer;
+  const char *sanitized;
 
-  return TRUE;
+  buffer = autoar_extract_do_get_sanitize_buffer ();
+  sanitized = autoar_common_sanitize_pathname (pathname, skip_chars != NULL, buffer);
+  if (*sanitized == '\0')
+    return g_object_ref (top_level_dir);
+
+  return g_file_get_child (top_level_dir, sanitized);
 }
 
-static void
-autoar_extract_do_write_entry (AutoarExtract *arextract,
-                               struct archive *a,
-                               struct archive_entry *entry,
-                               GFile *dest,
-                               GFile *hardlink)
+static gboolean
+autoar_extract_do_glob_match (const char *pattern,
+                              const char *str,
+                              gsize len)
 {
-  AutoarExtractPrivate *priv;
-  GFileInfo *info;
-  mode_t filetype;
-  int r;
+  /* Match a pattern accepted by GPatternSpec against @len bytes of @str,
+   * which does not need to be nul-terminated. '*' matches any string and
+   * '?' matches a single UTF-8 character. After a mismatch, only the last
+   * '*' needs to be retried with a longer string. */
+
+  const char *end, *star_pattern, *star_str;
+
+  end = str + len;
+  star_pattern = NULL;
+  star_str = NULL;
+
+  while (str < end) {
+    if (*pattern == '*') {
+      star_pattern = ++pattern;
+      star_str = str;
+    } else if (*pattern == '?') {
+      pattern++;
+      str += g_utf8_skip[*(const guchar*)str];
+    } else if (*pattern != '\0' && *pattern == *str) {
+      pattern++;
+      str++;
+    } else if (star_pattern != NULL) {
+      pattern = star_pattern;
+      str = ++star_str;
+    } else {
+      return FALSE;
+    }
+  }
 
-  priv = arextract->priv;
+  /* A multibyte character may be cut by the end of the component */
+  if (str > end)
+    return FALSE;
 
-  {
-    GFile *parent;
-    parent = g_file_get_parent (dest);
-    if (!g_file_query_exists (parent, priv->cancellable))
-      g_file_make_directory_with_parents (parent, priv->cancellable, NULL);
-    g_object_unref (parent);
-  }
+  while (*pattern == '*')
+    pattern++;
 
-  info = g_file_info_new ();
+  return *pattern == '\0';
+}
 
-  /* time */
-  g_debug ("autoar_extract_do_write_entry: time");
-  if (archive_entry_atime_is_set (entry)) {
-    g_file_info_set_attribute_uint64 (info,
-                                      G_FILE_ATTRIBUTE_TIME_ACCESS,
-                                      archive_entry_atime (entry));
-    g_file_info_set_attribute_uint32 (info,
-                                      G_FILE_ATTRIBUTE_TIME_ACCESS_USEC,
-                                      archive_entry_atime_nsec (entry) / 1000);
+static void
+autoar_extract_matcher_add_slice (GHashTable *table,
+                                  GArray *lengths,
+                                  const char *str,
+                                  gsize len)
+{
+  AutoarExtractSlice *slice;
+  guint i;
+
+  slice = g_new (AutoarExtractSlice, 1);
+  slice->str = g_strndup (str, len);
+  slice->len = len;
+  g_hash_table_add (table, slice);
+
+  if (lengths == NULL)
+    return;
+
+  for (i = 0; i < lengths->len; i++) {
+    if (g_array_index (lengths, gsize, i) == len)
+      return;
   }
-  if (archive_entry_birthtime_is_set (entry)) {
-    g_file_info_set_attribute_uint64 (info,
-                                      G_FILE_ATTRIBUTE_TIME_CREATED,
-                                      archive_entry_birthtime (entry));
-    g_file_info_set_attribute_uint32 (info,
-                                      G_FILE_ATTRIBUTE_TIME_CREATED_USEC,
-                                      archive_entry_birthtime_nsec (entry) / 1000);
+  g_array_append_val (lengths, len);
+}
+
+static void
+autoar_extract_matcher_add (AutoarExtractMatcher *matcher,
+                            const char *pattern)
+{
+  gsize len;
+  const char *wildcard;
+
+  len = strlen (pattern);
+  wildcard = strpbrk (pattern, "*?");
+
+  if (wildcard == NULL) {
+    autoar_extract_matcher_add_slice (matcher->literals, NULL, pattern, len);
+  } else if (wildcard == pattern + len - 1 && *wildcard == '*') {
+    autoar_extract_matcher_add_slice (matcher->prefixes, matcher->prefix_lengths,
+                                      pattern, len - 1);
+  } else if (wildcard == pattern && *wildcard == '*' &&
+             strpbrk (pattern + 1, "*?") == NULL) {
+    autoar_extract_matcher_add_slice (matcher->suffixes, matcher->suffix_lengths,
+                                      pattern + 1, len - 1);
+  } else {
+    g_ptr_array_add (matcher->wildcards, g_strdup (pattern));
   }
-  if (archive_entry_ctime_is_set (entry)) {
-    g_file_info_set_attribute_uint64 (info,
-                                      G_FILE_ATTRIBUTE_TIME_CHANGED,
-                                      archive_entry_ctime (entry));
-    g_file_info_set_attribute_uint32 (info,
-                                      G_FILE_ATTRIBUTE_TIME_CHANGED_USEC,
-                                      archive_entry_ctime_nsec (entry) / 1000);
+}
+
+static gboolean
+autoar_extract_matcher_match_component (AutoarExtractMatcher *matcher,
+                                        const char *str,
+                                        gsize len)
+{
+  AutoarExtractSlice slice;
+  guint i;
+
+  slice.str = str;
+  slice.len = len;
+  if (g_hash_table_contains (matcher->literals, &slice))
+    return TRUE;
+
+  for (i = 0; i < matcher->prefix_lengths->len; i++) {
+    slice.len = g_array_index (matcher->prefix_lengths, gsize, i);
+    slice.str = str;
+    if (slice.len <= len && g_hash_table_contains (matcher->prefixes, &slice))
+      return TRUE;
   }
-  if (archive_entry_mtime_is_set (entry)) {
-    g_file_info_set_attribute_uint64 (info,
-                                      G_FILE_ATTRIBUTE_TIME_MODIFIED,
-                                      archive_entry_mtime (entry));
-    g_file_info_set_attribute_uint32 (info,
-                                      G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC,
-                                      archive_entry_mtime_nsec (entry) / 1000);
+
+  for (i = 0; i < matcher->suffix_lengths->len; i++) {
+    slice.len = g_array_index (matcher->suffix_lengths, gsize, i);
+    if (slice.len > len)
+      continue;
+    slice.str = str + len - slice.len;
+    if (g_hash_table_contains (matcher->suffixes, &slice))
+      return TRUE;
   }
 
-  /* user */
-  {
-    guint32 uid;
-    const char *uname;
+  for (i = 0; i < matcher->wildcards->len; i++) {
+    if (autoar_extract_do_glob_match (g_ptr_array_index (matcher->wildcards, i), str, len))
+      return TRUE;
+  }
 
-    g_debug ("autoar_extract_do_write_entry: user");
-#ifdef HAVE_GETPWNAM
-    if ((uname = archive_entry_uname (entry)) != NULL) {
-      void *got_uid;
-      if (g_hash_table_lookup_extended (priv->userhash, uname, NULL, &got_uid) == TRUE) {
-        uid = GPOINTER_TO_UINT (got_uid);
-      } else {
-        struct passwd *pwd = getpwnam (uname);
-        if (pwd == NULL) {
-          uid = archive_entry_uid (entry);
-        } else {
-          uid = pwd->pw_uid;
-          g_hash_table_insert (priv->userhash, g_strdup (uname), GUINT_TO_POINTER (uid));
-        }
-      }
-      g_file_info_set_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_UID, uid);
-    } else
-#endif
+  return FALSE;
+}
 
-    if ((uid = archive_entry_uid (entry)) != 0) {
-      g_file_info_set_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_UID, uid);
+static gboolean
+autoar_extract_do_pattern_check (const char *path,
+                                 AutoarExtractMatcher *matcher)
+{
+  /* Returns FALSE if any component of @path matches a pattern. Components
+   * are matched in place, so nothing is allocated. */
+
+  const char *component, *end;
+
+  for (component = path; ; component = end + 1) {
+    end = strchr (component, '/');
+    if (end == NULL)
+      end = component + strlen (component);
+    if (autoar_extract_matcher_match_component (matcher, component, end - component)) {
+      g_debug ("autoar_extract_do_pattern_check: ### %.*s", (int)(end - component), component);
+      return FALSE;
     }
+    if (*end == '\0')
+      break;
   }
 
-  /* group */
-  {
-    guint32 gid;
-    const char *gname;
+  return TRUE;
+}
 
-    g_debug ("autoar_extract_do_write_entry: group");
-#ifdef HAVE_GETGRNAM
-    if ((gname = archive_entry_gname (entry)) != NULL) {
-      void *got_gid;
-      if (g_hash_table_lookup_extended (priv->grouphash, gname, NULL, &got_gid) == TRUE) {
-        gid = GPOINTER_TO_UINT (got_gid);
-      } else {
-        struct group *grp = getgrnam (gname);
-        if (grp == NULL) {
-          gid = archive_entry_gid (entry);
-        } else {
-          gid = grp->gr_gid;
-          g_hash_table_insert (priv->grouphash, g_strdup (gname), GUINT_TO_POINTER (gid));
-        }
-      }
-      g_file_info_set_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_GID, gid);
-    } else
-#endif
+static gboolean
+autoar_extract_do_include_check (AutoarExtract *arextract,
+                                 struct archive_entry *entry)
+{
+  /* Returns TRUE if the entry or one of its parent directories matches an
+   * include pattern. Literal paths found as entries other than directories
+   * are counted, so reading can stop when all of them are found. Only called
+   * by the thread which scans the archive. */
 
-    if ((gid = archive_entry_gid (entry)) != 0) {
-      g_file_info_set_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_GID, gid);
-    }
-  }
+  AutoarExtractPrivate *priv;
+  AutoarExtractInclude *include;
+  AutoarExtractSlice slice;
+  const char *path;
+  gsize len, i;
+  guint j;
 
-  /* permissions */
-  g_debug ("autoar_extract_do_write_entry: permissions");
-  g_file_info_set_attribute_uint32 (info,
-                                    G_FILE_ATTRIBUTE_UNIX_MODE,
-                                    archive_entry_perm (entry));
+  priv = arextract->priv;
 
-#ifdef HAVE_LINK
-  if (hardlink != NULL) {
-    char *hardlink_path, *dest_path;
-    r = link (hardlink_path = g_file_get_path (hardlink),
-              dest_path = g_file_get_path (dest));
-    g_debug ("autoar_extract_do_write_entry: hard link, %s => %s, %d",
-             dest_path, hardlink_path, r);
-    g_free (hardlink_path);
-    g_free (dest_path);
-    if (r >= 0) {
-      g_debug ("autoar_extract_do_write_entry: skip file creation");
-      goto applyinfo;
+  if (priv->include_patterns == NULL)
+    return TRUE;
+
+  path = autoar_common_sanitize_pathname (archive_entry_pathname (entry), TRUE,
+                                          autoar_extract_do_get_sanitize_buffer ());
+  len = strlen (path);
+
+  slice.str = path;
+  slice.len = len;
+  if ((include = g_hash_table_lookup (priv->include_literals, &slice)) != NULL) {
+    if (!(include->found) && archive_entry_filetype (entry) != AE_IFDIR) {
+      include->found = TRUE;
+      priv->include_pending--;
     }
+    return TRUE;
   }
-#endif
 
-  g_debug ("autoar_extract_do_write_entry: writing");
-  r = 0;
-  switch (filetype = archive_entry_filetype (entry)) {
-    default:
-    case AE_IFREG:
-      {
-        GOutputStream *ostream;
-        const void *buffer;
-        size_t size, written;
-        gint64 offset;
+  for (j = 0; j < priv->include_wildcards->len; j++) {
+    if (autoar_extract_do_glob_match (g_ptr_array_index (priv->include_wildcards, j), path, len))
+      return TRUE;
+  }
 
-        g_debug ("autoar_extract_do_write_entry: case REG");
-        ostream = (GOutputStream*)g_file_replace (dest,
-                                                  NULL,
-                                                  FALSE,
-                                                  G_FILE_CREATE_NONE,
-                                                  priv->cancellable,
-                                                  &(priv->error));
-        if (arextract->priv->error != NULL) {
-          g_object_unref (info);
-          return;
-        }
-        if (ostream != NULL) {
-          /* Archive entry size may be zero if we use raw format. */
-          if (archive_entry_size(entry) > 0 || priv->use_raw_format) {
-            while (archive_read_data_block (a, &buffer, &size, &offset) == ARCHIVE_OK) {
-              /* buffer == NULL occurs in some zip archives when an entry is
-               * completely read. We just skip this situation to prevent GIO
-               * warnings. */
-              if (buffer == NULL)
-                continue;
-              g_output_stream_write_all (ostream,
-                                         buffer,
-                                         size,
-                                         &written,
-                                         priv->cancellable,
-                                         &(priv->error));
-              if (priv->error != NULL) {
-                g_output_stream_close (ostream, priv->cancellable, NULL);
-                g_object_unref (ostream);
-                g_object_unref (info);
-                return;
-              }
-              if (g_cancellable_is_cancelled (priv->cancellable)) {
-                g_output_stream_close (ostream, priv->cancellable, NULL);
-                g_object_unref (ostream);
-                g_object_unref (info);
-                return;
-              }
-              priv->completed_size += written;
-              autoar_extract_signal_progress (arextract);
-            }
-          }
-          g_output_stream_close (ostream, priv->cancellable, NULL);
-          g_object_unref (ostream);
-        }
-      }
-      break;
-    case AE_IFDIR:
-      {
-        GFileAndInfo fileandinfo;
+  /* Parent directories */
+  for (i = 0; i < len; i++) {
+    if (path[i] != '/')
+      continue;
 
-        g_debug ("autoar_extract_do_write_entry: case DIR");
-        g_file_make_directory_with_parents (dest, priv->cancellable, &(priv->error));
-        if (priv->error != NULL) {
-          /* "File exists" is not a fatal error */
-          if (priv->error->code == G_IO_ERROR_EXISTS) {
-            g_error_free (priv->error);
-            priv->error = NULL;
-          } else {
-            g_object_unref (info);
-            return;
-          }
-        }
-        fileandinfo.file = g_object_ref (dest);
-        fileandinfo.info = g_object_ref (info);
-        g_array_append_val (priv->extracted_dir_list, fileandinfo);
-      }
-      break;
-    case AE_IFLNK:
-      g_debug ("autoar_extract_do_write_entry: case LNK");
-      g_file_make_symbolic_link (dest,
-                                 archive_entry_symlink (entry),
-                                 priv->cancellable,
-                                 &(priv->error));
-      break;
-    /* FIFOs, sockets, block files, character files are not important
-     * in the regular archives, so errors are not fatal. */
-#if defined HAVE_MKFIFO || defined HAVE_MKNOD
-    case AE_IFIFO:
-      {
-        char *path;
-        g_debug ("autoar_extract_do_write_entry: case FIFO");
-# ifdef HAVE_MKFIFO
-        r = mkfifo (path = g_file_get_path (dest), archive_entry_perm (entry));
-# else
-        r = mknod (path = g_file_get_path (dest),
-                   S_IFIFO | archive_entry_perm (entry),
-                   0);
-# endif
-        g_free (path);
-      }
-      break;
-#endif
-#ifdef HAVE_MKNOD
-    case AE_IFSOCK:
-      {
-        char *path;
-        g_debug ("autoar_extract_do_write_entry: case SOCK");
-        r = mknod (path = g_file_get_path (dest),
-                   S_IFSOCK | archive_entry_perm (entry),
-                   0);
-        g_free (path);
-      }
-      break;
-    case AE_IFBLK:
-      {
-        char *path;
-        g_debug ("autoar_extract_do_write_entry: case BLK");
-        r = mknod (path = g_file_get_path (dest),
-                   S_IFBLK | archive_entry_perm (entry),
-                   archive_entry_rdev (entry));
-        g_free (path);
-      }
-      break;
-    case AE_IFCHR:
-      {
-        char *path;
-        g_debug ("autoar_extract_do_write_entry: case CHR");
-        r = mknod (path = g_file_get_path (dest),
-                   S_IFCHR | archive_entry_perm (entry),
-                   archive_entry_rdev (entry));
-        g_free (path);
-      }
-      break;
-#endif
-  }
+    slice.len = i;
+    if (g_hash_table_contains (priv->include_literals, &slice))
+      return TRUE;
 
-#if defined HAVE_MKFIFO || defined HAVE_MKNOD
-  /* Create a empty regular file if we cannot create the special file. */
-  if (r < 0 && (filetype == AE_IFIFO ||
-                filetype == AE_IFSOCK ||
-                filetype == AE_IFBLK ||
-                filetype == AE_IFCHR)) {
-    GOutputStream *ostream;
-    ostream = (GOutputStream*)g_file_append_to (dest, G_FILE_CREATE_NONE, priv->cancellable, NULL);
-    if (ostream != NULL) {
-      g_output_stream_close (ostream, priv->cancellable, NULL);
-      g_object_unref (ostream);
+    for (j = 0; j < priv->include_wildcards->len; j++) {
+      if (autoar_extract_do_glob_match (g_ptr_array_index (priv->include_wildcards, j), path, i))
+        return TRUE;
     }
   }
-#endif
 
-applyinfo:
-  g_debug ("autoar_extract_do_write_entry: applying info");
-  g_file_set_attributes_from_info (dest,
-                                   info,
-                                   G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
-                                   priv->cancellable,
-                                   &(priv->error));
+  g_debug ("autoar_extract_do_include_check: ### %s", path);
+  return FALSE;
+}
 
-  if (priv->error != NULL) {
-    g_debug ("autoar_extract_do_write_entry: %s\n", priv->error->message);
-    g_error_free (priv->error);
-    priv->error = NULL;
-  }
+static gboolean
+autoar_extract_do_include_done (AutoarExtract *arextract,
+                                int format)
+{
+  /* All wanted entries are read when every include pattern is a literal path
+   * which has been found. The ISO 9660 reader does not read entries in a
+   * stable order, so it always reads to the end. */
 
-  g_object_unref (info);
+  AutoarExtractPrivate *priv;
+
+  priv = arextract->priv;
+
+  return priv->include_patterns != NULL && !(priv->use_raw_format) &&
+         priv->include_pending == 0 && priv->include_wildcards->len == 0 &&
+         g_hash_table_size (priv->include_literals) > 0 &&
+         (format & ARCHIVE_FORMAT_BASE_MASK) != ARCHIVE_FORMAT_ISO9660;
 }
 
-static void
-autoar_extract_class_init (AutoarExtractClass *klass)
+#ifdef USE_DIR_FD_CACHE
+static int
+autoar_extract_do_dir_cache_get_fd (AutoarExtract *arextract,
+                                    const char *path)
 {
-  GObjectClass *object_class;
-  GType type;
+  /* The mutex must be held. Returns -1 if the directory cannot be opened.
+   * The file descriptor is owned by the cache. */
 
-  object_class = G_OBJECT_CLASS (klass);
-  type = G_TYPE_FROM_CLASS (klass);
+  AutoarExtractPrivate *priv;
+  AutoarExtractDirFd *dir_fd;
+  GList *link;
+  char *parent, *basename;
+  int parent_fd, fd;
 
-  g_type_class_add_private (klass, sizeof (AutoarExtractPrivate));
+  priv = arextract->priv;
 
-  object_class->get_property = autoar_extract_get_property;
-  object_class->set_property = autoar_extract_set_property;
-  object_class->dispose = autoar_extract_dispose;
-  object_class->finalize = autoar_extract_finalize;
+  link = g_hash_table_lookup (priv->dir_fds, path);
+  if (link != NULL) {
+    g_queue_unlink (&(priv->dir_lru), link);
+    g_queue_push_head_link (&(priv->dir_lru), link);
+    return ((AutoarExtractDirFd*)(link->data))->fd;
+  }
+
+  /* Open the directory relative to its parent, so the kernel does not
+   * have to resolve the whole path again. */
+  parent = g_path_get_dirname (path);
+  parent_fd = strcmp (parent, path) != 0 ?
+              autoar_extract_do_dir_cache_get_fd (arextract, parent) : -1;
+  if (parent_fd >= 0) {
+    basename = g_path_get_basename (path);
+    fd = openat (parent_fd, basename, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    g_free (basename);
+  } else {
+    fd = open (path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  }
+  g_free (parent);
+
+  if (fd < 0)
+    return -1;
+
+  if (g_queue_get_length (&(priv->dir_lru)) >= DIR_FD_CACHE_SIZE) {
+    dir_fd = g_queue_pop_tail (&(priv->dir_lru));
+    g_hash_table_remove (priv->dir_fds, dir_fd->path);
+    /* It will be closed by the last user */
+    if (dir_fd->users > 0) {
+      dir_fd->evicted = TRUE;
+    } else {
+      close (dir_fd->fd);
+      g_free (dir_fd->path);
+      g_free (dir_fd);
+    }
+  }
+
+  dir_fd = g_new (AutoarExtractDirFd, 1);
+  dir_fd->path = g_strdup (path);
+  dir_fd->fd = fd;
+  dir_fd->users = 0;
+  dir_fd->evicted = FALSE;
+  g_queue_push_head (&(priv->dir_lru), dir_fd);
+  g_hash_table_insert (priv->dir_fds, dir_fd->path, priv->dir_lru.head);
+
+  return fd;
+}
+
+static AutoarExtractDirFd*
+autoar_extract_do_dir_cache_ref (AutoarExtract *arextract,
+                                 const char *path)
+{
+  /* The mutex must be held. The returned file descriptor can be used without
+   * holding the mutex until autoar_extract_do_dir_cache_unref() is called. */
+
+  GList *link;
+
+  if (autoar_extract_do_dir_cache_get_fd (arextract, path) < 0)
+    return NULL;
+
+  link = g_hash_table_lookup (arextract->priv->dir_fds, path);
+  ((AutoarExtractDirFd*)(link->data))->users++;
+
+  return link->data;
+}
+
+static void
+autoar_extract_do_dir_cache_unref (AutoarExtractDirFd *dir_fd)
+{
+  /* The mutex must be held */
+  dir_fd->users--;
+  if (dir_fd->evicted && dir_fd->users == 0) {
+    close (dir_fd->fd);
+    g_free (dir_fd->path);
+    g_free (dir_fd);
+  }
+}
+
+static gboolean
+autoar_extract_do_dir_cache_make (AutoarExtract *arextract,
+                                  const char *path,
+                                  GError **error)
+{
+  /* The mutex must be held */
+
+  AutoarExtractPrivate *priv;
+  char *parent, *basename;
+  int parent_fd, r;
+
+  priv = arextract->priv;
+
+  if (g_hash_table_contains (priv->dir_known, path))
+    return TRUE;
+
+  parent = g_path_get_dirname (path);
+  if (strcmp (parent, path) != 0 &&
+      !autoar_extract_do_dir_cache_make (arextract, parent, error)) {
+    g_free (parent);
+    return FALSE;
+  }
+
+  parent_fd = autoar_extract_do_dir_cache_get_fd (arextract, parent);
+  if (parent_fd >= 0) {
+    basename = g_path_get_basename (path);
+    r = mkdirat (parent_fd, basename, 0777);
+    g_free (basename);
+  } else {
+    r = g_mkdir (path, 0777);
+  }
+  g_free (parent);
+
+  if (r < 0 && errno != EEXIST) {
+    int errsv = errno;
+    g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+                 "Error creating directory '%s': %s", path, g_strerror (errsv));
+    return FALSE;
+  }
+
+  g_hash_table_add (priv->dir_known, g_strdup (path));
+  return TRUE;
+}
+#endif
+
+static gboolean
+autoar_extract_do_make_dir (AutoarExtract *arextract,
+                            GFile *dir,
+                            GError **error)
+{
+  /* Create a directory and its parents. It is not an error if the directory
+   * already exists. */
+
+  AutoarExtractPrivate *priv;
+  GError *local_error;
+  gboolean success;
+
+  priv = arextract->priv;
+
+#ifdef USE_DIR_FD_CACHE
+  {
+    char *path;
+
+    path = g_file_get_path (dir);
+    if (path != NULL) {
+      g_mutex_lock (&(priv->mutex));
+      success = autoar_extract_do_dir_cache_make (arextract, path, error);
+      g_mutex_unlock (&(priv->mutex));
+      g_free (path);
+      return success;
+    }
+  }
+#endif
+
+  local_error = NULL;
+  g_mutex_lock (&(priv->mutex));
+  success = g_file_make_directory_with_parents (dir, priv->cancellable, &local_error);
+  g_mutex_unlock (&(priv->mutex));
+  if (!success) {
+    if (local_error->domain == G_IO_ERROR && local_error->code == G_IO_ERROR_EXISTS) {
+      g_error_free (local_error);
+      return TRUE;
+    }
+    g_propagate_error (error, local_error);
+  }
+
+  return success;
+}
+
+static void
+autoar_extract_pipeline_wake (AutoarExtractPipeline *pipeline,
+                              int *waiting)
+{
+  if (g_atomic_int_get (waiting)) {
+    g_mutex_lock (&(pipeline->mutex));
+    g_cond_broadcast (&(pipeline->cond));
+    g_mutex_unlock (&(pipeline->mutex));
+  }
+}
+
+static void
+autoar_extract_pipeline_abort (AutoarExtractPipeline *pipeline)
+{
+  g_mutex_lock (&(pipeline->mutex));
+  g_atomic_int_set (&(pipeline->aborted), TRUE);
+  g_cond_broadcast (&(pipeline->cond));
+  g_mutex_unlock (&(pipeline->mutex));
+}
+
+static AutoarExtractBlock*
+autoar_extract_pipeline_reserve (AutoarExtractPipeline *pipeline)
+{
+  /* Called by the decoding thread. Returns NULL if the pipeline is aborted. */
+  int head;
+
+  head = g_atomic_int_get (&(pipeline->head));
+  if (head - g_atomic_int_get (&(pipeline->tail)) >= PIPELINE_SIZE) {
+    g_mutex_lock (&(pipeline->mutex));
+    g_atomic_int_set (&(pipeline->producer_waiting), TRUE);
+    while (head - g_atomic_int_get (&(pipeline->tail)) >= PIPELINE_SIZE &&
+           !g_atomic_int_get (&(pipeline->aborted)))
+      g_cond_wait (&(pipeline->cond), &(pipeline->mutex));
+    g_atomic_int_set (&(pipeline->producer_waiting), FALSE);
+    g_mutex_unlock (&(pipeline->mutex));
+  }
+
+  if (g_atomic_int_get (&(pipeline->aborted)))
+    return NULL;
+
+  return pipeline->blocks + (head % PIPELINE_SIZE);
+}
+
+static void
+autoar_extract_pipeline_commit (AutoarExtractPipeline *pipeline)
+{
+  g_atomic_int_inc (&(pipeline->head));
+  autoar_extract_pipeline_wake (pipeline, &(pipeline->consumer_waiting));
+}
+
+static AutoarExtractBlock*
+autoar_extract_pipeline_peek (AutoarExtractPipeline *pipeline)
+{
+  /* Called by the writing thread. Returns NULL if the pipeline is aborted. */
+  int tail;
+
+  tail = g_atomic_int_get (&(pipeline->tail));
+  if (g_atomic_int_get (&(pipeline->head)) == tail) {
+    g_mutex_lock (&(pipeline->mutex));
+    g_atomic_int_set (&(pipeline->consumer_waiting), TRUE);
+    while (g_atomic_int_get (&(pipeline->head)) == tail &&
+           !g_atomic_int_get (&(pipeline->aborted)))
+      g_cond_wait (&(pipeline->cond), &(pipeline->mutex));
+    g_atomic_int_set (&(pipeline->consumer_waiting), FALSE);
+    g_mutex_unlock (&(pipeline->mutex));
+  }
+
+  if (g_atomic_int_get (&(pipeline->aborted)))
+    return NULL;
+
+  return pipeline->blocks + (tail % PIPELINE_SIZE);
+}
+
+static void
+autoar_extract_pipeline_release (AutoarExtractPipeline *pipeline)
+{
+  g_atomic_int_inc (&(pipeline->tail));
+  autoar_extract_pipeline_wake (pipeline, &(pipeline->producer_waiting));
+}
+
+static gint64
+autoar_extract_do_get_source_offset (AutoarExtract *arextract,
+                                     struct archive *a,
+                                     struct archive_entry *entry)
+{
+  /* Returns the offset of the data of @entry in the source file if they can
+   * be copied from it directly, or -1 otherwise. Data of regular files are
+   * stored contiguously in uncompressed tar, cpio and ar archives, and
+   * libarchive has just consumed the header when this is called. */
+
+  AutoarExtractPrivate *priv;
+  int format;
+
+  priv = arextract->priv;
+
+  if (priv->reader.fd < 0 || priv->use_raw_format ||
+      archive_filter_count (a) != 1)
+    return -1;
+
+  format = archive_format (a) & ARCHIVE_FORMAT_BASE_MASK;
+  if (format != ARCHIVE_FORMAT_TAR &&
+      format != ARCHIVE_FORMAT_CPIO &&
+      format != ARCHIVE_FORMAT_AR)
+    return -1;
+
+  /* Small files are already in the buffer of libarchive */
+  if (archive_entry_filetype (entry) != AE_IFREG ||
+      archive_entry_hardlink (entry) != NULL ||
+      !archive_entry_size_is_set (entry) ||
+      archive_entry_size (entry) <= BUFFER_SIZE ||
+      archive_entry_sparse_count (entry) > 0)
+    return -1;
+
+  return archive_filter_bytes (a, 0);
+}
+
+static int
+autoar_extract_do_read_copy_block (AutoarExtract *arextract,
+                                   AutoarExtractBlock *block,
+                                   const void **buffer,
+                                   size_t *size,
+                                   gint64 *offset,
+                                   GError **error)
+{
+  /* Read data to be copied from the source file if the destination cannot
+   * use autoar_extract_do_native_copy (). The block is left in the pipeline
+   * and the writing thread drops it after the entry is written. */
+
+  ssize_t read_size;
+  int errsv;
+
+  if (block->size == 0)
+    return ARCHIVE_EOF;
+
+  if (block->buffer_size < BUFFER_SIZE) {
+    block->buffer_size = BUFFER_SIZE;
+    block->buffer = g_realloc (block->buffer, block->buffer_size);
+  }
+
+  do {
+    read_size = pread (arextract->priv->reader.fd, block->buffer,
+                       MIN (block->size, block->buffer_size),
+                       block->source_offset);
+  } while (read_size < 0 && errno == EINTR);
+
+  if (read_size <= 0) {
+    errsv = errno;
+    if (read_size < 0)
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+                   "Error reading from file '%s': %s",
+                   arextract->priv->source, g_strerror (errsv));
+    else
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_PARTIAL_INPUT,
+                   "\'%s\': %s", arextract->priv->source,
+                   "the archive ends before all data of an entry");
+    block->size = 0;
+    return ARCHIVE_FATAL;
+  }
+
+  *buffer = block->buffer;
+  *size = read_size;
+  *offset = block->offset;
+
+  block->size -= read_size;
+  block->offset += read_size;
+  block->source_offset += read_size;
+
+  return ARCHIVE_OK;
+}
+
+static gint64
+autoar_extract_do_take_source_offset (AutoarExtract *arextract,
+                                      struct archive *a,
+                                      AutoarExtractBlock *data,
+                                      struct archive_entry *entry)
+{
+  /* Returns the offset of the data of @entry in the source file if they
+   * should be copied by autoar_extract_do_native_copy () instead of being
+   * read by autoar_extract_do_read_data_block (). */
+
+  AutoarExtractPipeline *pipeline;
+  AutoarExtractBlock *block;
+  gint64 source_offset;
+
+  if (a != NULL)
+    return autoar_extract_do_get_source_offset (arextract, a, entry);
+
+  if (data != NULL)
+    return -1;
+
+  pipeline = arextract->priv->pipeline;
+  if (pipeline->holding) {
+    pipeline->holding = FALSE;
+    autoar_extract_pipeline_release (pipeline);
+  }
+
+  block = autoar_extract_pipeline_peek (pipeline);
+  if (block == NULL || block->type != AUTOAR_EXTRACT_BLOCK_COPY ||
+      block->offset != 0)
+    return -1;
+
+  source_offset = block->source_offset;
+  autoar_extract_pipeline_release (pipeline);
+
+  return source_offset;
+}
+
+static int
+autoar_extract_do_read_data_block (AutoarExtract *arextract,
+                                   struct archive *a,
+                                   AutoarExtractBlock *data,
+                                   const void **buffer,
+                                   size_t *size,
+                                   gint64 *offset,
+                                   GError **error)
+{
+  /* If there is no archive object, data blocks are either read into @data
+   * completely or copied from the decoding thread. The returned block is
+   * valid until the next call. At the end of data, @offset is set to the
+   * size of the file if it is known, or -1 otherwise. If the decoding thread
+   * stops before the end of data, @error is set because the entry cannot be
+   * completed. */
+
+  AutoarExtractPipeline *pipeline;
+  AutoarExtractBlock *block;
+
+  *offset = -1;
+
+  if (a != NULL)
+    return archive_read_data_block (a, buffer, size, offset);
+
+  if (data != NULL) {
+    if (data->type != AUTOAR_EXTRACT_BLOCK_DATA)
+      return ARCHIVE_EOF;
+    data->type = AUTOAR_EXTRACT_BLOCK_END;
+    *buffer = data->buffer;
+    *size = data->size;
+    *offset = data->offset;
+    return ARCHIVE_OK;
+  }
+
+  pipeline = arextract->priv->pipeline;
+  if (pipeline->holding) {
+    pipeline->holding = FALSE;
+    autoar_extract_pipeline_release (pipeline);
+  }
+
+  block = autoar_extract_pipeline_peek (pipeline);
+  if (block == NULL) {
+    if (!g_cancellable_set_error_if_cancelled (arextract->priv->cancellable, error))
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                   "Extraction stopped before all data were written");
+    return ARCHIVE_FATAL;
+  }
+  if (block->type == AUTOAR_EXTRACT_BLOCK_COPY)
+    return autoar_extract_do_read_copy_block (arextract, block, buffer, size, offset, error);
+  if (block->type != AUTOAR_EXTRACT_BLOCK_DATA) {
+    if (block->type == AUTOAR_EXTRACT_BLOCK_END)
+      *offset = block->offset;
+    return ARCHIVE_EOF;
+  }
+
+  pipeline->holding = TRUE;
+  *buffer = block->buffer;
+  *size = block->size;
+  *offset = block->offset;
+
+  return ARCHIVE_OK;
+}
+
+static gint64
+autoar_extract_do_sparse_end (struct archive_entry *entry,
+                              gboolean has_hole,
+                              gint64 end,
+                              gint64 eof_offset)
+{
+  /* Returns the size of the file after all data blocks have been written.
+   * Blocks of sparse files are not contiguous, and a trailing hole is only
+   * known from the offset reported at the end of data or from the size in
+   * the header. The header size is not used for files without holes, so
+   * truncated archives do not produce files padded with zeros. */
+
+  if (eof_offset > end)
+    end = eof_offset;
+  if (has_hole && archive_entry_size_is_set (entry) && archive_entry_size (entry) > end)
+    end = archive_entry_size (entry);
+  return end;
+}
+
+#ifdef USE_NATIVE_BACKEND
+static int
+autoar_extract_do_native_open (AutoarExtract *arextract,
+                               GFile *dest)
+{
+  /* Create a new regular file relative to the cached file descriptor of its
+   * parent. Returns -1 if the file cannot be created in this way, including
+   * the case that the file already exists. */
+
+  AutoarExtractPrivate *priv;
+  AutoarExtractDirFd *dir_fd;
+  char *path, *parent, *basename;
+  int fd;
+
+  priv = arextract->priv;
+
+  path = g_file_get_path (dest);
+  if (path == NULL)
+    return -1;
+
+  parent = g_path_get_dirname (path);
+  basename = g_path_get_basename (path);
+
+  g_mutex_lock (&(priv->mutex));
+  dir_fd = autoar_extract_do_dir_cache_ref (arextract, parent);
+  g_mutex_unlock (&(priv->mutex));
+
+  if (dir_fd != NULL) {
+    fd = openat (dir_fd->fd, basename,
+                 O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0666);
+    g_mutex_lock (&(priv->mutex));
+    autoar_extract_do_dir_cache_unref (dir_fd);
+    g_mutex_unlock (&(priv->mutex));
+  } else {
+    fd = -1;
+  }
+
+  g_debug ("autoar_extract_do_native_open: %s, %d", path, fd);
+
+  g_free (basename);
+  g_free (parent);
+  g_free (path);
+
+  return fd;
+}
+
+static gboolean
+autoar_extract_do_native_preallocate (AutoarExtract *arextract,
+                                      struct archive_entry *entry,
+                                      int fd)
+{
+  /* Allocate the disk space of a regular file if the size is known. Files
+   * which can be written with one write () are not worth an extra system
+   * call, and holes of sparse files must not be allocated. fallocate () is
+   * used instead of posix_fallocate (), which writes zeros to the whole file
+   * if the file system cannot allocate space. */
+
+#ifdef HAVE_FALLOCATE
+  AutoarExtractPrivate *priv;
+  int r;
+
+  priv = arextract->priv;
+
+  if (!(priv->preallocate) || priv->use_raw_format ||
+      !archive_entry_size_is_set (entry) ||
+      archive_entry_size (entry) <= BUFFER_SIZE ||
+      archive_entry_sparse_count (entry) > 0)
+    return FALSE;
+
+  /* Errors are not fatal, data are written without preallocation */
+  r = fallocate (fd, 0, 0, archive_entry_size (entry));
+  if (r < 0) {
+    int errsv = errno;
+    if (errsv != EOPNOTSUPP && errsv != ENOSYS)
+      g_debug ("autoar_extract_do_native_preallocate: %s", g_strerror (errsv));
+    return FALSE;
+  }
+
+  g_debug ("autoar_extract_do_native_preallocate: %" G_GINT64_FORMAT,
+           archive_entry_size (entry));
+  return TRUE;
+#else
+  return FALSE;
+#endif
+}
+
+static gboolean
+autoar_extract_do_native_copy (AutoarExtract *arextract,
+                               struct archive_entry *entry,
+                               gint64 source_offset,
+                               gint64 size,
+                               int fd,
+                               GFile *dest,
+                               GError **error)
+{
+  /* Copy data of an entry from the source file without passing them through
+   * libarchive. copy_file_range () may share the blocks with the source file,
+   * sendfile () copies them in the kernel, and pread () is used if neither of
+   * them works. Offsets are always explicit, so the file position used by
+   * the decoding thread is not changed. */
+
+  AutoarExtractPrivate *priv;
+  gboolean use_copy_file_range, use_sendfile;
+  char *buffer;
+  int source_fd;
+
+  priv = arextract->priv;
+  source_fd = priv->reader.fd;
+  use_copy_file_range = TRUE;
+  use_sendfile = TRUE;
+  buffer = NULL;
+
+  g_debug ("autoar_extract_do_native_copy: %" G_GINT64_FORMAT ", %" G_GINT64_FORMAT,
+           source_offset, size);
+
+  while (size > 0) {
+    size_t chunk = MIN (size, COPY_CHUNK_SIZE);
+    ssize_t copied;
+
+#ifdef HAVE_COPY_FILE_RANGE
+    if (use_copy_file_range) {
+      loff_t off_in = source_offset;
+      copied = copy_file_range (source_fd, &off_in, fd, NULL, chunk, 0);
+      if (copied < 0 && errno != EINTR) {
+        if (errno != ENOSYS && errno != EXDEV && errno != EINVAL &&
+            errno != EOPNOTSUPP && errno != EBADF)
+          goto error;
+        use_copy_file_range = FALSE;
+        continue;
+      }
+    } else
+#endif
+#ifdef HAVE_SENDFILE
+    if (use_sendfile) {
+      off_t off_in = source_offset;
+      copied = sendfile (fd, source_fd, &off_in, chunk);
+      if (copied < 0 && errno != EINTR) {
+        if (errno != ENOSYS && errno != EINVAL)
+          goto error;
+        use_sendfile = FALSE;
+        continue;
+      }
+    } else
+#endif
+    {
+      const char *remaining;
+      ssize_t remaining_size;
+
+      if (buffer == NULL)
+        buffer = g_malloc (BUFFER_SIZE);
+      copied = pread (source_fd, buffer, MIN (chunk, BUFFER_SIZE), source_offset);
+      for (remaining = buffer, remaining_size = copied; remaining_size > 0; ) {
+        ssize_t written = write (fd, remaining, remaining_size);
+        if (written < 0) {
+          if (errno == EINTR)
+            continue;
+          goto error;
+        }
+        remaining += written;
+        remaining_size -= written;
+      }
+    }
+
+    if (copied < 0) {
+      if (errno == EINTR)
+        continue;
+      goto error;
+    }
+
+    /* The source file is shorter than the archive claims */
+    if (copied == 0)
+      break;
+
+    source_offset += copied;
+    size -= copied;
+
+    if (g_cancellable_is_cancelled (priv->cancellable))
+      break;
+
+    autoar_extract_do_progress (arextract, copied, 0);
+  }
+
+  g_free (buffer);
+
+  if (size > 0 && !g_cancellable_set_error_if_cancelled (priv->cancellable, error))
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_PARTIAL_INPUT,
+                 "\'%s\': %s", archive_entry_pathname (entry),
+                 "the archive ends before all data of the entry");
+
+  return size == 0;
+
+error:
+  {
+    int errsv = errno;
+    char *path;
+    path = g_file_get_path (dest);
+    g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+                 "Error writing to file '%s': %s", path, g_strerror (errsv));
+    g_free (path);
+  }
+  g_free (buffer);
+  return FALSE;
+}
+
+static gboolean
+autoar_extract_do_native_write (AutoarExtract *arextract,
+                                struct archive *a,
+                                AutoarExtractBlock *data,
+                                struct archive_entry *entry,
+                                int fd,
+                                GFile *dest,
+                                GError **error)
+{
+  AutoarExtractPrivate *priv;
+  const void *buffer;
+  size_t size;
+  gint64 offset, position, end, source_offset;
+  gboolean has_hole, preallocated;
+  int errsv;
+
+  priv = arextract->priv;
+
+  /* Archive entry size may be zero if we use raw format. */
+  if (archive_entry_size (entry) <= 0 && !(priv->use_raw_format))
+    return TRUE;
+
+  source_offset = autoar_extract_do_take_source_offset (arextract, a, data, entry);
+  if (source_offset >= 0)
+    return autoar_extract_do_native_copy (arextract, entry, source_offset,
+                                          archive_entry_size (entry),
+                                          fd, dest, error);
+
+  position = 0;
+  has_hole = FALSE;
+  preallocated = autoar_extract_do_native_preallocate (arextract, entry, fd);
+
+  while (autoar_extract_do_read_data_block (arextract, a, data, &buffer, &size, &offset, error) == ARCHIVE_OK) {
+    const char *remaining;
+    size_t remaining_size;
+
+    if (buffer == NULL || size == 0)
+      continue;
+
+    /* Holes of sparse files are skipped instead of written */
+    if (offset >= 0 && offset != position) {
+      if (lseek (fd, offset, SEEK_SET) < 0)
+        goto error;
+      if (offset > position) {
+        autoar_extract_do_progress (arextract, offset - position, 0);
+        has_hole = TRUE;
+      }
+      position = offset;
+    }
+
+    for (remaining = buffer, remaining_size = size; remaining_size > 0; ) {
+      ssize_t written = write (fd, remaining, remaining_size);
+      if (written < 0) {
+        if (errno == EINTR)
+          continue;
+        goto error;
+      }
+      remaining += written;
+      remaining_size -= written;
+    }
+    position += size;
+
+    if (g_cancellable_is_cancelled (priv->cancellable))
+      return FALSE;
+
+    autoar_extract_do_progress (arextract, size, 0);
+  }
+
+  if (*error != NULL)
+    return FALSE;
+
+  end = autoar_extract_do_sparse_end (entry, has_hole, position, offset);
+  if (end > position) {
+    g_debug ("autoar_extract_do_native_write: trailing hole, %" G_GINT64_FORMAT, end - position);
+    if (ftruncate (fd, end) < 0)
+      goto error;
+    autoar_extract_do_progress (arextract, end - position, 0);
+  } else if (preallocated && end < archive_entry_size (entry)) {
+    g_debug ("autoar_extract_do_native_write: truncate preallocated file, %" G_GINT64_FORMAT, end);
+    if (ftruncate (fd, end) < 0)
+      goto error;
+  }
+
+  return TRUE;
+
+error:
+  errsv = errno;
+  {
+    char *path;
+    path = g_file_get_path (dest);
+    g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+                 "Error writing to file '%s': %s", path, g_strerror (errsv));
+    g_free (path);
+  }
+  return FALSE;
+}
+
+static void
+autoar_extract_do_apply_meta_fd (int fd,
+                                 const AutoarExtractMeta *meta)
+{
+  /* Apply the owner, mode and times in @meta through a file descriptor.
+   * Errors are not fatal, as g_file_set_attributes_from_info() errors are
+   * ignored for files written with GIO. */
+
+  struct timespec times[2];
+
+# ifdef HAVE_FCHOWN
+  if (meta->has_uid || meta->has_gid) {
+    if (fchown (fd,
+                meta->has_uid ? meta->uid : (uid_t)-1,
+                meta->has_gid ? meta->gid : (gid_t)-1) < 0)
+      g_debug ("autoar_extract_do_apply_meta_fd: fchown: %s", g_strerror (errno));
+  }
+# endif
+
+  fchmod (fd, meta->mode);
+
+  if (!(meta->has_atime) && !(meta->has_mtime))
+    return;
+
+  times[0].tv_nsec = UTIME_OMIT;
+  times[1].tv_nsec = UTIME_OMIT;
+  if (meta->has_atime) {
+    times[0].tv_sec = meta->atime;
+    times[0].tv_nsec = meta->atime_nsec;
+  }
+  if (meta->has_mtime) {
+    times[1].tv_sec = meta->mtime;
+    times[1].tv_nsec = meta->mtime_nsec;
+  }
+  futimens (fd, times);
+}
+#endif
+
+static void
+autoar_extract_do_gio_seek (GOutputStream *ostream,
+                            gint64 position,
+                            gint64 offset,
+                            GCancellable *cancellable,
+                            GError **error)
+{
+  /* Move from @position to @offset in a stream written sequentially so far.
+   * A hole at the end of the file is created by extending the file, and
+   * zeros are written if the stream cannot seek or truncate. */
+
+  static const char zeros[4096];
+  GSeekable *seekable;
+
+  seekable = G_IS_SEEKABLE (ostream) ? G_SEEKABLE (ostream) : NULL;
+
+  if (seekable != NULL && g_seekable_can_seek (seekable) &&
+      (offset < position || g_seekable_can_truncate (seekable))) {
+    if (offset > position &&
+        !g_seekable_truncate (seekable, offset, cancellable, error))
+      return;
+    g_seekable_seek (seekable, offset, G_SEEK_SET, cancellable, error);
+    return;
+  }
+
+  if (offset < position) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                 "Cannot seek backwards in the output stream");
+    return;
+  }
+
+  while (position < offset) {
+    gsize size = MIN (offset - position, (gint64) sizeof (zeros));
+    if (!g_output_stream_write_all (ostream, zeros, size, NULL, cancellable, error))
+      return;
+    position += size;
+  }
+}
+
+static void
+autoar_extract_do_get_meta (AutoarExtract *arextract,
+                            struct archive_entry *entry,
+                            AutoarExtractMeta *meta)
+{
+  /* Collect the metadata of @entry which can be applied to the file.
+   * Creation and change times cannot be set on extracted files, so they are
+   * not collected. */
+
+  AutoarExtractPrivate *priv;
+
+  priv = arextract->priv;
+
+  meta->has_atime = archive_entry_atime_is_set (entry) != 0;
+  if (meta->has_atime) {
+    meta->atime = archive_entry_atime (entry);
+    meta->atime_nsec = archive_entry_atime_nsec (entry);
+  }
+  meta->has_mtime = archive_entry_mtime_is_set (entry) != 0;
+  if (meta->has_mtime) {
+    meta->mtime = archive_entry_mtime (entry);
+    meta->mtime_nsec = archive_entry_mtime_nsec (entry);
+  }
+
+  meta->mode = archive_entry_perm (entry);
+  meta->has_uid = FALSE;
+  meta->has_gid = FALSE;
+
+  /* Changing the owner fails without privileges, so names are not even
+   * looked up in this case. */
+  if (!(priv->can_chown))
+    return;
+
+  /* user */
+  {
+    guint32 uid;
+    const char *uname;
+
+    if ((uname = archive_entry_uname (entry)) == NULL ||
+        !autoar_common_get_uid_from_name (uname, &uid))
+      uid = archive_entry_uid (entry);
+
+    /* New files are always owned by the effective user */
+    if (uid != priv->euid) {
+      meta->uid = uid;
+      meta->has_uid = TRUE;
+    }
+  }
+
+  /* group */
+  {
+    guint32 gid;
+    const char *gname;
+
+    if ((gname = archive_entry_gname (entry)) == NULL ||
+        !autoar_common_get_gid_from_name (gname, &gid))
+      gid = archive_entry_gid (entry);
+
+    /* New files may get the group of their parent directory instead of the
+     * effective group, so the group is always set */
+    meta->gid = gid;
+    meta->has_gid = TRUE;
+  }
+}
+
+static GFileInfo*
+autoar_extract_do_meta_to_info (const AutoarExtractMeta *meta)
+{
+  /* Used for files which are not written through file descriptors */
+
+  GFileInfo *info;
+
+  info = g_file_info_new ();
+
+  if (meta->has_atime) {
+    g_file_info_set_attribute_uint64 (info,
+                                      G_FILE_ATTRIBUTE_TIME_ACCESS,
+                                      meta->atime);
+    g_file_info_set_attribute_uint32 (info,
+                                      G_FILE_ATTRIBUTE_TIME_ACCESS_USEC,
+                                      meta->atime_nsec / 1000);
+  }
+  if (meta->has_mtime) {
+    g_file_info_set_attribute_uint64 (info,
+                                      G_FILE_ATTRIBUTE_TIME_MODIFIED,
+                                      meta->mtime);
+    g_file_info_set_attribute_uint32 (info,
+                                      G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC,
+                                      meta->mtime_nsec / 1000);
+  }
+  if (meta->has_uid)
+    g_file_info_set_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_UID, meta->uid);
+  if (meta->has_gid)
+    g_file_info_set_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_GID, meta->gid);
+  g_file_info_set_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_MODE, meta->mode);
+
+  return info;
+}
+
+static void
+autoar_extract_do_write_entry (AutoarExtract *arextract,
+                               struct archive *a,
+                               AutoarExtractBlock *data,
+                               struct archive_entry *entry,
+                               GFile *dest,
+                               GFile *hardlink,
+                               GError **error)
+{
+  AutoarExtractPrivate *priv;
+  AutoarExtractMeta meta;
+  GFileInfo *info;
+  mode_t filetype;
+  int r;
+
+  priv = arextract->priv;
+
+  {
+    GFile *parent;
+    parent = g_file_get_parent (dest);
+    autoar_extract_do_make_dir (arextract, parent, NULL);
+    g_object_unref (parent);
+  }
+
+  autoar_extract_do_get_meta (arextract, entry, &meta);
+
+#ifdef HAVE_LINK
+  if (hardlink != NULL) {
+    char *hardlink_path, *dest_path;
+    r = link (hardlink_path = g_file_get_path (hardlink),
+              dest_path = g_file_get_path (dest));
+    g_debug ("autoar_extract_do_write_entry: hard link, %s => %s, %d",
+             dest_path, hardlink_path, r);
+    g_free (hardlink_path);
+    g_free (dest_path);
+    if (r >= 0) {
+      g_debug ("autoar_extract_do_write_entry: skip file creation");
+      goto applyinfo;
+    }
+  }
+#endif
+
+  g_debug ("autoar_extract_do_write_entry: writing");
+  r = 0;
+  switch (filetype = archive_entry_filetype (entry)) {
+    default:
+    case AE_IFREG:
+      {
+        GOutputStream *ostream;
+        const void *buffer;
+        size_t size, written;
+        gint64 offset, position, end;
+        gboolean has_hole;
+
+        g_debug ("autoar_extract_do_write_entry: case REG");
+#ifdef USE_NATIVE_BACKEND
+        {
+          int fd;
+          if ((fd = autoar_extract_do_native_open (arextract, dest)) >= 0) {
+            if (autoar_extract_do_native_write (arextract, a, data, entry, fd, dest, error))
+              autoar_extract_do_apply_meta_fd (fd, &meta);
+            close (fd);
+            return;
+          }
+        }
+#endif
+        ostream = (GOutputStream*)g_file_replace (dest,
+                                                  NULL,
+                                                  FALSE,
+                                                  G_FILE_CREATE_NONE,
+                                                  priv->cancellable,
+                                                  error);
+        if (*error != NULL) {
+          return;
+        }
+        if (ostream != NULL) {
+          /* Archive entry size may be zero if we use raw format. */
+          if (archive_entry_size(entry) > 0 || priv->use_raw_format) {
+            position = 0;
+            has_hole = FALSE;
+            while (autoar_extract_do_read_data_block (arextract, a, data, &buffer, &size, &offset, error) == ARCHIVE_OK) {
+              /* buffer == NULL occurs in some zip archives when an entry is
+               * completely read. We just skip this situation to prevent GIO
+               * warnings. */
+              if (buffer == NULL || size == 0)
+                continue;
+              if (offset >= 0 && offset != position) {
+                if (offset > position) {
+                  autoar_extract_do_progress (arextract, offset - position, 0);
+                  has_hole = TRUE;
+                }
+                autoar_extract_do_gio_seek (ostream, position, offset,
+                                            priv->cancellable, error);
+                position = offset;
+                if (*error != NULL) {
+                  g_output_stream_close (ostream, priv->cancellable, NULL);
+                  g_object_unref (ostream);
+                  return;
+                }
+              }
+              g_output_stream_write_all (ostream,
+                                         buffer,
+                                         size,
+                                         &written,
+                                         priv->cancellable,
+                                         error);
+              if (*error != NULL) {
+                g_output_stream_close (ostream, priv->cancellable, NULL);
+                g_object_unref (ostream);
+                return;
+              }
+              if (g_cancellable_is_cancelled (priv->cancellable)) {
+                g_output_stream_close (ostream, priv->cancellable, NULL);
+                g_object_unref (ostream);
+                return;
+              }
+              position += written;
+              autoar_extract_do_progress (arextract, written, 0);
+            }
+            if (*error != NULL) {
+              g_output_stream_close (ostream, priv->cancellable, NULL);
+              g_object_unref (ostream);
+              return;
+            }
+            end = autoar_extract_do_sparse_end (entry, has_hole, position, offset);
+            if (end > position) {
+              autoar_extract_do_gio_seek (ostream, position, end,
+                                          priv->cancellable, error);
+              autoar_extract_do_progress (arextract, end - position, 0);
+            }
+          }
+          g_output_stream_close (ostream, priv->cancellable, NULL);
+          g_object_unref (ostream);
+        }
+      }
+      break;
+    case AE_IFDIR:
+      {
+        AutoarExtractDirMeta dir_meta;
+
+        g_debug ("autoar_extract_do_write_entry: case DIR");
+        if (!autoar_extract_do_make_dir (arextract, dest, error)) {
+          return;
+        }
+        dir_meta.file = g_object_ref (dest);
+        dir_meta.meta = meta;
+        g_mutex_lock (&(priv->mutex));
+        g_array_append_val (priv->extracted_dir_list, dir_meta);
+        g_mutex_unlock (&(priv->mutex));
+      }
+      break;
+    case AE_IFLNK:
+      g_debug ("autoar_extract_do_write_entry: case LNK");
+      g_file_make_symbolic_link (dest,
+                                 archive_entry_symlink (entry),
+                                 priv->cancellable,
+                                 error);
+      break;
+    /* FIFOs, sockets, block files, character files are not important
+     * in the regular archives, so errors are not fatal. */
+#if defined HAVE_MKFIFO || defined HAVE_MKNOD
+    case AE_IFIFO:
+      {
+        char *path;
+        g_debug ("autoar_extract_do_write_entry: case FIFO");
+# ifdef HAVE_MKFIFO
+        r = mkfifo (path = g_file_get_path (dest), archive_entry_perm (entry));
+# else
+        r = mknod (path = g_file_get_path (dest),
+                   S_IFIFO | archive_entry_perm (entry),
+                   0);
+# endif
+        g_free (path);
+      }
+      break;
+#endif
+#ifdef HAVE_MKNOD
+    case AE_IFSOCK:
+      {
+        char *path;
+        g_debug ("autoar_extract_do_write_entry: case SOCK");
+        r = mknod (path = g_file_get_path (dest),
+                   S_IFSOCK | archive_entry_perm (entry),
+                   0);
+        g_free (path);
+      }
+      break;
+    case AE_IFBLK:
+      {
+        char *path;
+        g_debug ("autoar_extract_do_write_entry: case BLK");
+        r = mknod (path = g_file_get_path (dest),
+                   S_IFBLK | archive_entry_perm (entry),
+                   archive_entry_rdev (entry));
+        g_free (path);
+      }
+      break;
+    case AE_IFCHR:
+      {
+        char *path;
+        g_debug ("autoar_extract_do_write_entry: case CHR");
+        r = mknod (path = g_file_get_path (dest),
+                   S_IFCHR | archive_entry_perm (entry),
+                   archive_entry_rdev (entry));
+        g_free (path);
+      }
+      break;
+#endif
+  }
+
+#if defined HAVE_MKFIFO || defined HAVE_MKNOD
+  /* Create a empty regular file if we cannot create the special file. */
+  if (r < 0 && (filetype == AE_IFIFO ||
+                filetype == AE_IFSOCK ||
+                filetype == AE_IFBLK ||
+                filetype == AE_IFCHR)) {
+    GOutputStream *ostream;
+    ostream = (GOutputStream*)g_file_append_to (dest, G_FILE_CREATE_NONE, priv->cancellable, NULL);
+    if (ostream != NULL) {
+      g_output_stream_close (ostream, priv->cancellable, NULL);
+      g_object_unref (ostream);
+    }
+  }
+#endif
+
+applyinfo:
+  g_debug ("autoar_extract_do_write_entry: applying info");
+  info = autoar_extract_do_meta_to_info (&meta);
+  g_file_set_attributes_from_info (dest,
+                                   info,
+                                   G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                   priv->cancellable,
+                                   error);
+
+  if (*error != NULL) {
+    g_debug ("autoar_extract_do_write_entry: %s\n", (*error)->message);
+    g_clear_error (error);
+  }
+
+  g_object_unref (info);
+}
+
+static void
+autoar_extract_class_init (AutoarExtractClass *klass)
+{
+  GObjectClass *object_class;
+  GType type;
+
+  object_class = G_OBJECT_CLASS (klass);
+  type = G_TYPE_FROM_CLASS (klass);
+
+  g_type_class_add_private (klass, sizeof (AutoarExtractPrivate));
+
+  object_class->get_property = autoar_extract_get_property;
+  object_class->set_property = autoar_extract_set_property;
+  object_class->dispose = autoar_extract_dispose;
+  object_class->finalize = autoar_extract_finalize;
 
   g_object_class_install_property (object_class, PROP_SOURCE,
                                    g_param_spec_string ("source",
@@ -1267,628 +3440,2559 @@ autoar_extract_class_init (AutoarExtractClass *klass)
                                                         G_PARAM_CONSTRUCT_ONLY |
                                                         G_PARAM_STATIC_STRINGS));
 
-  g_object_class_install_property (object_class, PROP_SOURCE_FILE,
-                                   g_param_spec_object ("source-file",
-                                                        "Source archive GFile",
-                                                        "The archive GFile to be extracted",
-                                                        G_TYPE_FILE,
-                                                        G_PARAM_READWRITE |
-                                                        G_PARAM_CONSTRUCT_ONLY |
-                                                        G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (object_class, PROP_SOURCE_FILE,
+                                   g_param_spec_object ("source-file",
+                                                        "Source archive GFile",
+                                                        "The archive GFile to be extracted",
+                                                        G_TYPE_FILE,
+                                                        G_PARAM_READWRITE |
+                                                        G_PARAM_CONSTRUCT_ONLY |
+                                                        G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class, PROP_OUTPUT,
+                                   g_param_spec_string ("output",
+                                                        "Output directory",
+                                                        "Output directory of extracted archive",
+                                                        NULL,
+                                                        G_PARAM_READWRITE |
+                                                        G_PARAM_CONSTRUCT_ONLY |
+                                                        G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class, PROP_OUTPUT_FILE,
+                                   g_param_spec_object ("output-file",
+                                                        "Output directory GFile",
+                                                        "Output directory GFile of extracted archives",
+                                                        G_TYPE_FILE,
+                                                        G_PARAM_READWRITE |
+                                                        G_PARAM_CONSTRUCT_ONLY |
+                                                        G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class, PROP_SIZE,
+                                   g_param_spec_uint64 ("size",
+                                                        "File size",
+                                                        "Size of the extracted files",
+                                                        0, G_MAXUINT64, 0,
+                                                        G_PARAM_READABLE |
+                                                        G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class, PROP_COMPLETED_SIZE,
+                                   g_param_spec_uint64 ("completed-size",
+                                                        "Written file size",
+                                                        "Bytes written to disk",
+                                                        0, G_MAXUINT64, 0,
+                                                        G_PARAM_READABLE |
+                                                        G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class, PROP_FILES,
+                                   g_param_spec_uint ("files",
+                                                      "Files",
+                                                      "Number of files in the archive",
+                                                      0, G_MAXUINT32, 0,
+                                                      G_PARAM_READABLE |
+                                                      G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class, PROP_COMPLETED_FILES,
+                                   g_param_spec_uint ("completed-files",
+                                                      "Written files",
+                                                      "Number of files has been written",
+                                                      0, G_MAXUINT32, 0,
+                                                      G_PARAM_READABLE |
+                                                      G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class, PROP_SOURCE_IS_MEM,
+                                   g_param_spec_boolean ("source-is-mem",
+                                                         "Source is memory",
+                                                         "Whether source file is in memory",
+                                                         FALSE,
+                                                         G_PARAM_READWRITE |
+                                                         G_PARAM_CONSTRUCT_ONLY |
+                                                         G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class, PROP_OUTPUT_IS_DEST,
+                                   g_param_spec_boolean ("output-is-dest",
+                                                         "Output is destination",
+                                                         "Whether output direcotry is used as destination",
+                                                         FALSE,
+                                                         G_PARAM_READWRITE |
+                                                         G_PARAM_CONSTRUCT |
+                                                         G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class, PROP_NOTIFY_INTERVAL,
+                                   g_param_spec_int64 ("notify-interval",
+                                                       "Notify interval",
+                                                       "Minimal time interval between progress signal",
+                                                       0, G_MAXINT64, 100000,
+                                                       G_PARAM_READWRITE |
+                                                       G_PARAM_CONSTRUCT |
+                                                       G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class, PROP_SINGLE_PASS,
+                                   g_param_spec_boolean ("single-pass",
+                                                         "Single pass",
+                                                         "Whether to decode the archive only once using a staging directory",
+                                                         FALSE,
+                                                         G_PARAM_READWRITE |
+                                                         G_PARAM_CONSTRUCT |
+                                                         G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class, PROP_USE_SCAN_CACHE,
+                                   g_param_spec_boolean ("use-scan-cache",
+                                                         "Use scan cache",
+                                                         "Whether to cache the results of scanning on disk",
+                                                         FALSE,
+                                                         G_PARAM_READWRITE |
+                                                         G_PARAM_CONSTRUCT |
+                                                         G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class, PROP_N_THREADS,
+                                   g_param_spec_uint ("n-threads",
+                                                      "Number of threads",
+                                                      "Maximal number of threads used to extract files",
+                                                      0, G_MAXUINT, 1,
+                                                      G_PARAM_READWRITE |
+                                                      G_PARAM_CONSTRUCT |
+                                                      G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class, PROP_SMALL_FILE_SIZE,
+                                   g_param_spec_uint64 ("small-file-size",
+                                                        "Small file size",
+                                                        "Maximal size of files written by writer threads",
+                                                        0, G_MAXUINT64, BUFFER_SIZE,
+                                                        G_PARAM_READWRITE |
+                                                        G_PARAM_CONSTRUCT |
+                                                        G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class, PROP_PREALLOCATE,
+                                   g_param_spec_boolean ("preallocate",
+                                                         "Preallocate",
+                                                         "Whether to allocate disk space before writing regular files",
+                                                         FALSE,
+                                                         G_PARAM_READWRITE |
+                                                         G_PARAM_CONSTRUCT |
+                                                         G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class, PROP_INCLUDE_PATTERNS,
+                                   g_param_spec_boxed ("include-patterns",
+                                                       "Include patterns",
+                                                       "Patterns of path names to extract, or NULL to extract all entries",
+                                                       G_TYPE_STRV,
+                                                       G_PARAM_READWRITE |
+                                                       G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class, PROP_VERIFY,
+                                   g_param_spec_boolean ("verify",
+                                                         "Verify",
+                                                         "Whether to test the archive instead of extracting it",
+                                                         FALSE,
+                                                         G_PARAM_READWRITE |
+                                                         G_PARAM_CONSTRUCT |
+                                                         G_PARAM_STATIC_STRINGS));
+
+/**
+ * AutoarExtract::scanned:
+ * @arextract: the #AutoarExtract
+ * @files: the number of files will be extracted from the source archive
+ *
+ * This signal is emitted when #AutoarExtract finish scanning filename entries
+ * in the source archive.
+ **/
+  autoar_extract_signals[SCANNED] =
+    g_signal_new ("scanned",
+                  type,
+                  G_SIGNAL_RUN_LAST,
+                  0, NULL, NULL,
+                  g_cclosure_marshal_VOID__UINT,
+                  G_TYPE_NONE,
+                  1,
+                  G_TYPE_UINT);
+
+/**
+ * AutoarExtract::decide-dest:
+ * @arextract: the #AutoarExtract
+ * @destination: the location of the extracted directory or file
+ *
+ * This signal is emitted when the location of the extracted directory or
+ * file is determined.
+ **/
+  autoar_extract_signals[DECIDE_DEST] =
+    g_signal_new ("decide-dest",
+                  type,
+                  G_SIGNAL_RUN_LAST,
+                  0, NULL, NULL,
+                  g_cclosure_marshal_generic,
+                  G_TYPE_NONE,
+                  1,
+                  G_TYPE_FILE);
+
+/**
+ * AutoarExtract::progress:
+ * @arextract: the #AutoarExtract
+ * @completed_size: bytes has been written to disk
+ * @completed_files: number of files have been written to disk
+ *
+ * This signal is used to report progress of creating archives.
+ **/
+  autoar_extract_signals[PROGRESS] =
+    g_signal_new ("progress",
+                  type,
+                  G_SIGNAL_RUN_LAST,
+                  0, NULL, NULL,
+                  g_cclosure_marshal_generic,
+                  G_TYPE_NONE,
+                  2,
+                  G_TYPE_UINT64,
+                  G_TYPE_UINT);
+
+/**
+ * AutoarExtract::cancelled:
+ * @arextract: the #AutoarExtract
+ *
+ * This signal is emitted after archive extracting job is cancelled by the
+ * #GCancellable.
+ **/
+  autoar_extract_signals[CANCELLED] =
+    g_signal_new ("cancelled",
+                  type,
+                  G_SIGNAL_RUN_LAST,
+                  0, NULL, NULL,
+                  g_cclosure_marshal_VOID__VOID,
+                  G_TYPE_NONE,
+                  0);
+
+/**
+ * AutoarExtract::completed:
+ * @arextract: the #AutoarExtract
+ *
+ * This signal is emitted after the archive extracting job is successfully
+ * completed.
+ **/
+  autoar_extract_signals[COMPLETED] =
+    g_signal_new ("completed",
+                  type,
+                  G_SIGNAL_RUN_LAST,
+                  0, NULL, NULL,
+                  g_cclosure_marshal_VOID__VOID,
+                  G_TYPE_NONE,
+                  0);
+
+/**
+ * AutoarExtract::error:
+ * @arextract: the #AutoarExtract
+ * @error: the #GError
+ *
+ * This signal is emitted when error occurs and all jobs should be terminated.
+ * Possible error domains are %AUTOAR_EXTRACT_ERROR, %G_IO_ERROR, and
+ * %AUTOAR_LIBARCHIVE_ERROR, which represent error occurs in #AutoarExtract,
+ * GIO, and libarchive, respectively. The #GError is owned by #AutoarExtract
+ * and should not be freed.
+ **/
+  autoar_extract_signals[AR_ERROR] =
+    g_signal_new ("error",
+                  type,
+                  G_SIGNAL_RUN_LAST,
+                  0, NULL, NULL,
+                  g_cclosure_marshal_generic,
+                  G_TYPE_NONE,
+                  1,
+                  G_TYPE_ERROR);
+
+/**
+ * AutoarExtract::entry-failed:
+ * @arextract: the #AutoarExtract
+ * @pathname: the path name of the entry in the archive
+ * @error: the #GError
+ *
+ * This signal is emitted in verify mode when the data of an entry cannot be
+ * decoded, such as when its checksum does not match. Testing goes on with the
+ * next entry. The #GError is owned by #AutoarExtract and should not be freed.
+ **/
+  autoar_extract_signals[ENTRY_FAILED] =
+    g_signal_new ("entry-failed",
+                  type,
+                  G_SIGNAL_RUN_LAST,
+                  0, NULL, NULL,
+                  g_cclosure_marshal_generic,
+                  G_TYPE_NONE,
+                  2,
+                  G_TYPE_STRING,
+                  G_TYPE_ERROR);
+
+  autoar_common_g_signal_cache (autoar_extract_signals, LAST_SIGNAL);
+}
+
+static void
+autoar_extract_init (AutoarExtract *arextract)
+{
+  AutoarExtractPrivate *priv;
+
+  priv = AUTOAR_EXTRACT_GET_PRIVATE (arextract);
+  arextract->priv = priv;
+
+  priv->source_buffer = NULL;
+  priv->source_buffer_size = 0;
+  priv->source_bytes = NULL;
+  priv->source_stream = NULL;
+
+  priv->use_sink = FALSE;
+  priv->sink_data = NULL;
+  priv->sink_data_free = NULL;
+  priv->sink_bytes = NULL;
+  priv->sink_current = NULL;
+
+  priv->verify_failed = 0;
+  priv->verify_size = 0;
+  priv->verify_time = 0;
+
+  priv->cancellable = NULL;
+
+  priv->size = 0;
+  priv->files = 0;
+  autoar_common_signal_pool_init (&(priv->signal_pool));
+  autoar_common_progress_init (&(priv->progress), arextract,
+                               &(priv->signal_pool),
+                               autoar_extract_signals[PROGRESS]);
+
+  priv->reader.arextract = arextract;
+  priv->reader.istream = NULL;
+  priv->reader.buffer_size = BUFFER_SIZE;
+  priv->reader.buffer = g_new (char, priv->reader.buffer_size);
+  priv->reader.error = &(priv->error);
+  priv->reader.fd = -1;
+  priv->reader.replay = NULL;
+  priv->reader.replay_offset = 0;
+  priv->reader.replay_done = FALSE;
+  priv->error = NULL;
+
+  g_mutex_init (&(priv->mutex));
+  g_cond_init (&(priv->cond));
+  priv->parallel_next = 0;
+  priv->parallel_failed = FALSE;
+  priv->parallel_running = 0;
+  priv->parallel_deferred = NULL;
+  priv->parallel_paths = NULL;
+  priv->pipeline = NULL;
+  priv->pool = NULL;
+
+  priv->bad_filename = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  priv->bad_entries = g_array_new (FALSE, TRUE, sizeof (guint8));
+  priv->pattern_matcher = autoar_extract_matcher_new ();
+  priv->include_patterns = NULL;
+  priv->include_literals = g_hash_table_new_full (autoar_extract_slice_hash,
+                                                  autoar_extract_slice_equal,
+                                                  NULL,
+                                                  autoar_extract_include_free);
+  priv->include_wildcards = g_ptr_array_new_with_free_func (g_free);
+  priv->include_pending = 0;
+  priv->entries_end = G_MAXUINT;
+  priv->extracted_dir_list = g_array_new (FALSE, FALSE, sizeof (AutoarExtractDirMeta));
+  g_array_set_clear_func (priv->extracted_dir_list, autoar_extract_dir_meta_free);
+  priv->dir_known = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  priv->dir_fds = g_hash_table_new (g_str_hash, g_str_equal);
+  g_queue_init (&(priv->dir_lru));
+  priv->top_level_dir = NULL;
+  priv->staging_dir = NULL;
+  priv->staged_first = NULL;
+
+  priv->pathname_prefix_len = 0;
+  priv->pathname_prefix = NULL;
+  priv->pathname_basename = NULL;
+  priv->suggested_destname = NULL;
+
+  priv->archive_format = 0;
+  priv->archive_filter = ARCHIVE_FILTER_NONE;
+
+  priv->in_thread = FALSE;
+  priv->in_parallel = FALSE;
+  priv->use_raw_format = FALSE;
+  priv->has_top_level_dir = TRUE;
+  priv->has_only_one_file = TRUE;
+}
+
+static AutoarExtract*
+autoar_extract_new_full (const char *source,
+                         GFile *source_file,
+                         const char *output,
+                         GFile *output_file,
+                         gboolean source_is_mem,
+                         AutoarPref *arpref,
+                         const void *buffer,
+                         gsize buffer_size,
+                         const char *suggested_destname)
+{
+  AutoarExtract *arextract;
+  char *gen_source, *gen_output;
+  GFile *gen_source_file, *gen_output_file;
+
+  gen_source      = NULL;
+  gen_source_file = NULL;
+  gen_output      = NULL;
+  gen_output_file = NULL;
+
+  if (source_is_mem) {
+    gen_source = g_strdup_printf ("(memory %p, size %" G_GSIZE_FORMAT ")", buffer, buffer_size);
+    gen_source_file = g_file_new_for_commandline_arg (gen_source);
+  } else {
+    if (source == NULL)
+      gen_source = autoar_common_g_file_get_name (source_file);
+    if (source_file == NULL)
+      gen_source_file = g_file_new_for_commandline_arg (source);
+  }
+
+  if (output == NULL)
+    gen_output = autoar_common_g_file_get_name (output_file);
+  if (output_file == NULL)
+    gen_output_file = g_file_new_for_commandline_arg (output);
+
+  arextract =
+    g_object_new (AUTOAR_TYPE_EXTRACT,
+                  "source",         source      != NULL ? source      : gen_source,
+                  "source-file",    source_file != NULL ? source_file : gen_source_file,
+                  "output",         output      != NULL ? output      : gen_output,
+                  "output-file",    output_file != NULL ? output_file : gen_output_file,
+                  "source-is-mem",  source_is_mem, NULL);
+  arextract->priv->arpref = g_object_ref (arpref);
+
+  if (source_is_mem) {
+    arextract->priv->source_buffer = buffer;
+    arextract->priv->source_buffer_size = buffer_size;
+    if (suggested_destname != NULL)
+      arextract->priv->suggested_destname =
+        autoar_common_get_basename_remove_extension (suggested_destname);
+    else
+      arextract->priv->suggested_destname =
+        autoar_common_get_basename_remove_extension (gen_source);
+  } else {
+    char *source_basename = g_file_get_basename (arextract->priv->source_file);
+    arextract->priv->suggested_destname =
+      autoar_common_get_basename_remove_extension (source_basename);
+    g_free (source_basename);
+  }
+
+  g_free (gen_source);
+  g_free (gen_output);
+
+  if (gen_source_file != NULL)
+    g_object_unref (gen_source_file);
+  if (gen_output_file != NULL)
+    g_object_unref (gen_output_file);
+
+  return arextract;
+}
+
+
+/**
+ * autoar_extract_new:
+ * @source: source archive
+ * @output: output directory of extracted file or directory, or the file name
+ * of the extracted file or directory itself if you set
+ * #AutoarExtract:output-is-dest on the returned object
+ * @arpref: an #AutoarPref object
+ *
+ * Extract a new #AutoarExtract object.
+ *
+ * Returns: (transfer full): a new #AutoarExtract object
+ **/
+AutoarExtract*
+autoar_extract_new (const char *source,
+                    const char *output,
+                    AutoarPref *arpref)
+{
+  g_return_val_if_fail (source != NULL, NULL);
+  g_return_val_if_fail (output != NULL, NULL);
+
+  return autoar_extract_new_full (source, NULL, output, NULL,
+                                  FALSE, arpref,
+                                  NULL, 0, NULL);
+}
+
+/**
+ * autoar_extract_new_file:
+ * @source_file: source archive
+ * @output_file: output directory of extracted file or directory, or the
+ * file name of the extracted file or directory itself if you set
+ * #AutoarExtract:output-is-dest on the returned object
+ * @arpref: an #AutoarPref object
+ *
+ * Create a new #AutoarExtract object.
+ *
+ * Returns: (transfer full): a new #AutoarExtract object
+ **/
+AutoarExtract*
+autoar_extract_new_file (GFile *source_file,
+                         GFile *output_file,
+                         AutoarPref *arpref)
+{
+  g_return_val_if_fail (source_file != NULL, NULL);
+  g_return_val_if_fail (output_file != NULL, NULL);
+
+  return autoar_extract_new_full (NULL, source_file, NULL, output_file,
+                                  FALSE, arpref,
+                                  NULL, 0, NULL);
+}
+
+/**
+ * autoar_extract_new_memory:
+ * @buffer: memory buffer holding the source archive
+ * @buffer_size: the size of the source archive memory buffer
+ * @source_name: the name of the source archive
+ * @output: output directory of extracted file or directory, or the file name
+ * of the extracted file or directory itself if you set
+ * #AutoarExtract:output-is-dest on the returned object
+ * @arpref: an #AutoarPref object
+ *
+ * Create a new #AutoarExtract object. @source_name does not need to be a full
+ * path. The file which it represents does not need to exist, either. This
+ * argument is only used to decide the name of the extracted file or directory,
+ * and it is useless if you set #AutoarExtract:output-is-dest to %TRUE.
+ *
+ * Returns: (transfer full): a new #AutoarExtract object
+ **/
+AutoarExtract*
+autoar_extract_new_memory (const void *buffer,
+                           gsize buffer_size,
+                           const char *source_name,
+                           const char *output,
+                           AutoarPref *arpref)
+{
+
+  g_return_val_if_fail (output != NULL, NULL);
+  g_return_val_if_fail (buffer != NULL, NULL);
+
+  return autoar_extract_new_full (NULL, NULL, output, NULL,
+                                  TRUE, arpref,
+                                  buffer, buffer_size, source_name);
+}
+
+/**
+ * autoar_extract_new_memory_file:
+ * @buffer: memory buffer holding the source archive
+ * @buffer_size: the size of the source archive memory buffer
+ * @source_name: the name of the source archive
+ * @output_file: output directory of extracted file or directory, or the file
+ * name of the extracted file or directory itself if you set
+ * #AutoarExtract:output-is-dest on the returned object
+ * @arpref: an #AutoarPref object
+ *
+ * Create a new #AutoarExtract object. This function is similar to
+ * autoar_extract_new_memory() except for the argument for the output
+ * directory is #GFile.
+ *
+ * Returns: (transfer full): a new #AutoarExtract object
+ **/
+AutoarExtract*
+autoar_extract_new_memory_file (const void *buffer,
+                                gsize buffer_size,
+                                const char *source_name,
+                                GFile *output_file,
+                                AutoarPref *arpref)
+{
+  g_return_val_if_fail (output_file != NULL, NULL);
+  g_return_val_if_fail (buffer != NULL, NULL);
+
+  return autoar_extract_new_full (NULL, NULL, NULL, output_file,
+                                  TRUE, arpref,
+                                  buffer, buffer_size, source_name);
+}
+
+/**
+ * autoar_extract_new_bytes:
+ * @bytes: a #GBytes holding the source archive
+ * @source_name: the name of the source archive
+ * @output: output directory of extracted file or directory, or the file name
+ * of the extracted file or directory itself if you set
+ * #AutoarExtract:output-is-dest on the returned object
+ * @arpref: an #AutoarPref object
+ *
+ * Create a new #AutoarExtract object. This function is similar to
+ * autoar_extract_new_memory(), but the returned object holds a reference to
+ * @bytes instead of borrowing a buffer, so the same archive can be shared by
+ * several #AutoarExtract objects. There is no need to call
+ * autoar_extract_free_source_buffer().
+ *
+ * Returns: (transfer full): a new #AutoarExtract object
+ **/
+AutoarExtract*
+autoar_extract_new_bytes (GBytes *bytes,
+                          const char *source_name,
+                          const char *output,
+                          AutoarPref *arpref)
+{
+  AutoarExtract *arextract;
+  gsize size;
+  gconstpointer data;
+
+  g_return_val_if_fail (output != NULL, NULL);
+  g_return_val_if_fail (bytes != NULL, NULL);
+
+  data = g_bytes_get_data (bytes, &size);
+  arextract = autoar_extract_new_full (NULL, NULL, output, NULL,
+                                       TRUE, arpref,
+                                       data, size, source_name);
+  arextract->priv->source_bytes = g_bytes_ref (bytes);
+
+  return arextract;
+}
+
+/**
+ * autoar_extract_new_bytes_file:
+ * @bytes: a #GBytes holding the source archive
+ * @source_name: the name of the source archive
+ * @output_file: output directory of extracted file or directory, or the file
+ * name of the extracted file or directory itself if you set
+ * #AutoarExtract:output-is-dest on the returned object
+ * @arpref: an #AutoarPref object
+ *
+ * Create a new #AutoarExtract object. This function is similar to
+ * autoar_extract_new_bytes() except for the argument for the output
+ * directory is #GFile.
+ *
+ * Returns: (transfer full): a new #AutoarExtract object
+ **/
+AutoarExtract*
+autoar_extract_new_bytes_file (GBytes *bytes,
+                               const char *source_name,
+                               GFile *output_file,
+                               AutoarPref *arpref)
+{
+  AutoarExtract *arextract;
+  gsize size;
+  gconstpointer data;
+
+  g_return_val_if_fail (output_file != NULL, NULL);
+  g_return_val_if_fail (bytes != NULL, NULL);
+
+  data = g_bytes_get_data (bytes, &size);
+  arextract = autoar_extract_new_full (NULL, NULL, NULL, output_file,
+                                       TRUE, arpref,
+                                       data, size, source_name);
+  arextract->priv->source_bytes = g_bytes_ref (bytes);
+
+  return arextract;
+}
+
+static AutoarExtract*
+autoar_extract_new_stream_full (GInputStream *stream,
+                                const char *source_name,
+                                const char *output,
+                                GFile *output_file,
+                                AutoarPref *arpref)
+{
+  AutoarExtract *arextract;
+  char *gen_source;
+
+  /* The source file is only a name used in messages. It is never opened or
+   * deleted. */
+  gen_source = g_strdup_printf ("(stream %p)", stream);
+  arextract = autoar_extract_new_full (gen_source, NULL, output, output_file,
+                                       FALSE, arpref,
+                                       NULL, 0, NULL);
+  arextract->priv->source_stream = g_object_ref (stream);
+
+  g_free (arextract->priv->suggested_destname);
+  arextract->priv->suggested_destname =
+    autoar_common_get_basename_remove_extension (source_name != NULL ?
+                                                 source_name : gen_source);
+  g_free (gen_source);
+
+  return arextract;
+}
+
+/**
+ * autoar_extract_new_stream:
+ * @stream: a #GInputStream holding the source archive
+ * @source_name: (allow-none): the name of the source archive, or %NULL
+ * @output: output directory of extracted file or directory, or the file name
+ * of the extracted file or directory itself if you set
+ * #AutoarExtract:output-is-dest on the returned object
+ * @arpref: an #AutoarPref object
+ *
+ * Create a new #AutoarExtract object which reads the source archive from
+ * @stream, such as a pipe, the output of a subprocess or a socket. The stream
+ * is read once from its current position to the end, and it is never seeked
+ * or skipped, so it does not need to be seekable. Files are always extracted
+ * as if #AutoarExtract:single-pass is %TRUE: they are written to a staging
+ * directory, and the destination is decided after the whole archive is read.
+ * #AutoarPref:delete-if-succeed has no effect. @stream is not closed.
+ * @source_name is only used to decide the name of the extracted file or
+ * directory, like the argument of autoar_extract_new_memory().
+ *
+ * Returns: (transfer full): a new #AutoarExtract object
+ **/
+AutoarExtract*
+autoar_extract_new_stream (GInputStream *stream,
+                           const char *source_name,
+                           const char *output,
+                           AutoarPref *arpref)
+{
+  g_return_val_if_fail (G_IS_INPUT_STREAM (stream), NULL);
+  g_return_val_if_fail (output != NULL, NULL);
+
+  return autoar_extract_new_stream_full (stream, source_name,
+                                         output, NULL, arpref);
+}
+
+/**
+ * autoar_extract_new_stream_file:
+ * @stream: a #GInputStream holding the source archive
+ * @source_name: (allow-none): the name of the source archive, or %NULL
+ * @output_file: output directory of extracted file or directory, or the file
+ * name of the extracted file or directory itself if you set
+ * #AutoarExtract:output-is-dest on the returned object
+ * @arpref: an #AutoarPref object
+ *
+ * Create a new #AutoarExtract object. This function is similar to
+ * autoar_extract_new_stream() except for the argument for the output
+ * directory is #GFile.
+ *
+ * Returns: (transfer full): a new #AutoarExtract object
+ **/
+AutoarExtract*
+autoar_extract_new_stream_file (GInputStream *stream,
+                                const char *source_name,
+                                GFile *output_file,
+                                AutoarPref *arpref)
+{
+  g_return_val_if_fail (G_IS_INPUT_STREAM (stream), NULL);
+  g_return_val_if_fail (output_file != NULL, NULL);
+
+  return autoar_extract_new_stream_full (stream, source_name,
+                                         NULL, output_file, arpref);
+}
+
+static void
+autoar_extract_step_initialize_pattern (AutoarExtract *arextract) {
+  /* Step 0: Compile the file name pattern. */
+
+  AutoarExtractPrivate *priv = arextract->priv;
+  const char **pattern = autoar_pref_get_pattern_to_ignore (priv->arpref);
+  int i;
+
+  g_debug ("autoar_extract_step_initialize_pattern: called");
+
+  if (pattern != NULL) {
+    for (i = 0; pattern[i] != NULL; i++)
+      autoar_extract_matcher_add (priv->pattern_matcher, pattern[i]);
+  }
+
+  if (priv->include_patterns != NULL) {
+    GString *buffer = autoar_extract_do_get_sanitize_buffer ();
+
+    for (i = 0; priv->include_patterns[i] != NULL; i++) {
+      AutoarExtractInclude *include;
+      const char *normalized;
+
+      normalized = autoar_common_sanitize_pathname (priv->include_patterns[i],
+                                                    TRUE, buffer);
+
+      /* The top-level directory includes everything */
+      if (*normalized == '\0')
+        normalized = "*";
+
+      if (strpbrk (normalized, "*?") != NULL) {
+        g_ptr_array_add (priv->include_wildcards, g_strdup (normalized));
+        continue;
+      }
+
+      include = g_new (AutoarExtractInclude, 1);
+      include->slice.len = strlen (normalized);
+      include->slice.str = g_strndup (normalized, include->slice.len);
+      include->found = FALSE;
+      if (g_hash_table_contains (priv->include_literals, &(include->slice))) {
+        autoar_extract_include_free (include);
+        continue;
+      }
+      g_hash_table_add (priv->include_literals, include);
+      priv->include_pending++;
+    }
+  }
+}
+
+static struct archive*
+autoar_extract_do_open_archive (AutoarExtract *arextract)
+{
+  struct archive *a;
+
+  AutoarExtractPrivate *priv;
+  int r;
+
+  priv = arextract->priv;
+
+  r = libarchive_create_read_object (FALSE, &(priv->reader), &a);
+  if (r != ARCHIVE_OK) {
+    archive_read_free (a);
+    r = libarchive_create_read_object (TRUE, &(priv->reader), &a);
+    if (r != ARCHIVE_OK) {
+      if (priv->error == NULL)
+        priv->error = autoar_common_g_error_new_a (a, priv->source);
+      archive_read_free (a);
+      return NULL;
+    } else if (archive_filter_count (a) <= 1){
+      /* If we only use raw format and filter count is one, libarchive will
+       * not do anything except for just copying the source file. We do not
+       * want this thing to happen because it does unnecesssary copying. */
+      if (priv->error == NULL)
+        priv->error = g_error_new (AUTOAR_EXTRACT_ERROR, NOT_AN_ARCHIVE_ERRNO,
+                                   "\'%s\': %s", priv->source, "not an archive");
+      archive_read_free (a);
+      return NULL;
+    }
+    priv->use_raw_format = TRUE;
+  }
+
+  /* The format is decided, so the archive is never opened again */
+  priv->reader.replay_done = TRUE;
+
+  return a;
+}
+
+static void
+autoar_extract_do_scan_entry (AutoarExtract *arextract,
+                              struct archive_entry *entry,
+                              const char *pathname)
+{
+  AutoarExtractPrivate *priv;
+
+  priv = arextract->priv;
+
+  if (priv->pathname_prefix == NULL) {
+    char *dir_sep_location;
+    size_t skip_len, prefix_len;
+
+    skip_len = strspn (pathname, "./");
+    dir_sep_location = strchr (pathname + skip_len, '/');
+    if (dir_sep_location == NULL) {
+      prefix_len = strlen (pathname);
+    } else {
+      prefix_len = dir_sep_location - pathname;
+    }
+    priv->pathname_prefix = g_strndup (pathname, prefix_len);
+    g_debug ("autoar_extract_do_scan_entry: pathname_prefix = %s", priv->pathname_prefix);
+
+    priv->pathname_prefix_len = prefix_len;
+    priv->pathname_basename = g_path_get_basename (pathname);
+  } else {
+    priv->has_only_one_file = FALSE;
+    /* The prefix must be followed by a directory separator. Otherwise,
+     * entries named 'foo' and 'foobar' are regarded as the same directory. */
+    if (!g_str_has_prefix (pathname, priv->pathname_prefix) ||
+        (pathname[priv->pathname_prefix_len] != '\0' &&
+         pathname[priv->pathname_prefix_len] != '/' &&
+         (priv->pathname_prefix_len == 0 ||
+          priv->pathname_prefix[priv->pathname_prefix_len - 1] != '/'))) {
+      priv->has_top_level_dir = FALSE;
+    }
+  }
+  priv->files++;
+  priv->size += archive_entry_size (entry);
+}
+
+static void
+autoar_extract_do_scan_finish (AutoarExtract *arextract)
+{
+  AutoarExtractPrivate *priv;
+
+  priv = arextract->priv;
+
+  /* If we are unable to determine the total size, set it to a positive
+   * number to prevent strange percentage. */
+  if (priv->size <= 0)
+    priv->size = G_MAXUINT64;
+
+  g_debug ("autoar_extract_do_scan_finish: has_top_level_dir = %s",
+           priv->has_top_level_dir ? "TRUE" : "FALSE");
+  g_debug ("autoar_extract_do_scan_finish: has_only_one_file = %s",
+           priv->has_only_one_file ? "TRUE" : "FALSE");
+  autoar_extract_signal_scanned (arextract);
+}
+
+static gboolean
+autoar_extract_do_make_staging_dir (AutoarExtract *arextract)
+{
+  AutoarExtractPrivate *priv;
+  GFile *parent;
+  int i;
+
+  priv = arextract->priv;
+
+  /* The staging directory must be located in the same directory as the
+   * destination, so the extracted files can be moved by renaming. */
+  parent = priv->output_is_dest ? g_file_get_parent (priv->output_file) : NULL;
+  if (parent == NULL)
+    parent = g_object_ref (priv->output_file);
+
+  if (!g_file_query_exists (parent, priv->cancellable))
+    g_file_make_directory_with_parents (parent, priv->cancellable, NULL);
+
+  for (i = 0; ; i++) {
+    char *staging_basename;
+
+    staging_basename = g_strdup_printf (".%s.autoar-%08x",
+                                        priv->suggested_destname,
+                                        g_random_int ());
+    priv->staging_dir = g_file_get_child (parent, staging_basename);
+    g_free (staging_basename);
+
+    if (g_file_make_directory (priv->staging_dir, priv->cancellable, &(priv->error)))
+      break;
+
+    g_clear_object (&(priv->staging_dir));
+    if (priv->error->domain != G_IO_ERROR ||
+        priv->error->code != G_IO_ERROR_EXISTS ||
+        i >= 100)
+      break;
+
+    g_error_free (priv->error);
+    priv->error = NULL;
+  }
+
+  g_object_unref (parent);
+
+  return priv->staging_dir != NULL;
+}
+
+static void
+autoar_extract_do_remove_recursive (GFile *file)
+{
+  GFileEnumerator *enumerator;
+  GFileInfo *info;
+
+  /* This function is used to clean up, so errors are not fatal and it should
+   * not be stopped by the GCancellable. */
+  enumerator = g_file_enumerate_children (file,
+                                          G_FILE_ATTRIBUTE_STANDARD_NAME ","
+                                          G_FILE_ATTRIBUTE_STANDARD_TYPE,
+                                          G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                          NULL, NULL);
+  if (enumerator != NULL) {
+    while ((info = g_file_enumerator_next_file (enumerator, NULL, NULL)) != NULL) {
+      GFile *child;
+
+      child = g_file_get_child (file, g_file_info_get_name (info));
+      if (g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY)
+        autoar_extract_do_remove_recursive (child);
+      else
+        g_file_delete (child, NULL, NULL);
+
+      g_object_unref (child);
+      g_object_unref (info);
+    }
+    g_object_unref (enumerator);
+  }
+
+  g_file_delete (file, NULL, NULL);
+}
+
+static void
+autoar_extract_do_move_merge (AutoarExtract *arextract,
+                              GFile *source,
+                              GFile *dest)
+{
+  AutoarExtractPrivate *priv;
+  GFileEnumerator *enumerator;
+  GFileInfo *info;
+
+  priv = arextract->priv;
+
+  /* Renaming is enough if the destination does not exist. We only have to
+   * merge directories if the destination has been already created by
+   * others, which is possible when #AutoarExtract:output-is-dest is set. */
+  if (g_file_query_file_type (source, G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                              priv->cancellable) != G_FILE_TYPE_DIRECTORY ||
+      g_file_query_file_type (dest, G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                              priv->cancellable) != G_FILE_TYPE_DIRECTORY) {
+    g_file_move (source, dest,
+                 G_FILE_COPY_NOFOLLOW_SYMLINKS | G_FILE_COPY_OVERWRITE,
+                 priv->cancellable, NULL, NULL, &(priv->error));
+    return;
+  }
+
+  enumerator = g_file_enumerate_children (source,
+                                          G_FILE_ATTRIBUTE_STANDARD_NAME,
+                                          G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                          priv->cancellable,
+                                          &(priv->error));
+  if (enumerator == NULL)
+    return;
+
+  while ((info = g_file_enumerator_next_file (enumerator, priv->cancellable, &(priv->error))) != NULL) {
+    GFile *source_child, *dest_child;
+
+    source_child = g_file_get_child (source, g_file_info_get_name (info));
+    dest_child = g_file_get_child (dest, g_file_info_get_name (info));
+    autoar_extract_do_move_merge (arextract, source_child, dest_child);
+    g_object_unref (source_child);
+    g_object_unref (dest_child);
+    g_object_unref (info);
+
+    if (priv->error != NULL)
+      break;
+  }
+
+  g_object_unref (enumerator);
+}
+
+static char*
+autoar_extract_do_get_scan_cache_path (AutoarExtract *arextract)
+{
+  char *uri, *uri_checksum, *cache_path;
+
+  uri = g_file_get_uri (arextract->priv->source_file);
+  uri_checksum = g_compute_checksum_for_string (G_CHECKSUM_SHA1, uri, -1);
+  cache_path = g_build_filename (g_get_user_cache_dir (), "gnome-autoar",
+                                 "scan", uri_checksum, NULL);
+
+  g_free (uri);
+  g_free (uri_checksum);
+
+  return cache_path;
+}
+
+static gboolean
+autoar_extract_do_check_scan_cache_patterns (const char **pattern,
+                                             char **cached_patterns)
+{
+  int i;
+
+  if (pattern == NULL)
+    return cached_patterns == NULL || cached_patterns[0] == NULL;
+  if (cached_patterns == NULL)
+    return pattern[0] == NULL;
+
+  for (i = 0; pattern[i] != NULL && cached_patterns[i] != NULL; i++) {
+    if (strcmp (pattern[i], cached_patterns[i]) != 0)
+      return FALSE;
+  }
+
+  return pattern[i] == NULL && cached_patterns[i] == NULL;
+}
+
+static const char *scan_cache_required_keys[] = {
+  "Version", "URI",
+  "SourceSize", "SourceMTime", "SourceMTimeUsec", "SourceDevice", "SourceInode",
+  "Files", "Size", "HasTopLevelDir", "HasOnlyOneFile", "UseRawFormat",
+  "Format", "Filter", "BadFilename",
+  NULL
+};
+
+static gboolean
+autoar_extract_do_bad_by_name (int format)
+{
+  /* Entries are read in the same order in every pass, so ignored entries are
+   * recorded by their ordinal numbers. The ISO 9660 reader sorts entries by
+   * the location of their data, and the order of entries sharing a location
+   * is not guaranteed, so their names are recorded instead. */
+  return (format & ARCHIVE_FORMAT_BASE_MASK) == ARCHIVE_FORMAT_ISO9660;
+}
+
+static void
+autoar_extract_do_mark_bad (AutoarExtract *arextract,
+                            int format,
+                            guint ordinal,
+                            const char *pathname)
+{
+  AutoarExtractPrivate *priv;
+
+  priv = arextract->priv;
+
+  if (autoar_extract_do_bad_by_name (format)) {
+    g_hash_table_add (priv->bad_filename, g_strdup (pathname));
+    return;
+  }
+
+  if (ordinal / 8 >= priv->bad_entries->len)
+    g_array_set_size (priv->bad_entries, ordinal / 8 + 1);
+  g_array_index (priv->bad_entries, guint8, ordinal / 8) |= 1 << (ordinal % 8);
+}
+
+static gboolean
+autoar_extract_do_is_bad (AutoarExtract *arextract,
+                          guint ordinal,
+                          const char *pathname)
+{
+  AutoarExtractPrivate *priv;
+
+  priv = arextract->priv;
+
+  if (autoar_extract_do_bad_by_name (priv->archive_format))
+    return g_hash_table_contains (priv->bad_filename, pathname);
+
+  return ordinal / 8 < priv->bad_entries->len &&
+         (g_array_index (priv->bad_entries, guint8, ordinal / 8) & (1 << (ordinal % 8)));
+}
+
+static char*
+autoar_extract_do_scan_cache_get_name (GKeyFile *key_file,
+                                       const char *key)
+{
+  /* Names in archives are not always valid UTF-8, but strings in key files
+   * must be, so names are stored escaped. */
+
+  char *escaped, *name;
+
+  escaped = g_key_file_get_string (key_file, SCAN_CACHE_GROUP, key, NULL);
+  if (escaped == NULL)
+    return NULL;
+
+  name = g_uri_unescape_string (escaped, NULL);
+  g_free (escaped);
+
+  return name;
+}
+
+static void
+autoar_extract_do_scan_cache_set_name (GKeyFile *key_file,
+                                       const char *key,
+                                       const char *name)
+{
+  char *escaped;
+
+  escaped = g_uri_escape_string (name, "/", FALSE);
+  g_key_file_set_string (key_file, SCAN_CACHE_GROUP, key, escaped);
+  g_free (escaped);
+}
+
+static gboolean
+autoar_extract_do_load_scan_cache (AutoarExtract *arextract,
+                                   GFileInfo *identity)
+{
+  AutoarExtractPrivate *priv;
+  GKeyFile *key_file;
+  char *cache_path;
+  char *uri, *cached_uri;
+  char **cached_patterns;
+  char **cached_include_patterns;
+  char **bad_filename;
+  gint *bad_entries;
+  gsize n_bad_entries;
+  gboolean valid;
+  int i;
+
+  priv = arextract->priv;
+  uri = NULL;
+  cached_uri = NULL;
+  cached_patterns = NULL;
+  cached_include_patterns = NULL;
+  bad_filename = NULL;
+  valid = FALSE;
+
+  cache_path = autoar_extract_do_get_scan_cache_path (arextract);
+  key_file = g_key_file_new ();
+  if (!g_key_file_load_from_file (key_file, cache_path, G_KEY_FILE_NONE, NULL)) {
+    g_key_file_free (key_file);
+    g_free (cache_path);
+    return FALSE;
+  }
+
+  /* The cache is only valid if all keys are present and the source archive
+   * is not changed since the cache was written. */
+  for (i = 0; scan_cache_required_keys[i] != NULL; i++) {
+    if (!g_key_file_has_key (key_file, SCAN_CACHE_GROUP,
+                             scan_cache_required_keys[i], NULL)) {
+      g_debug ("autoar_extract_do_load_scan_cache: %s has no key %s",
+               cache_path, scan_cache_required_keys[i]);
+      g_unlink (cache_path);
+      goto out;
+    }
+  }
+
+  uri = g_file_get_uri (priv->source_file);
+  cached_uri = g_key_file_get_string (key_file, SCAN_CACHE_GROUP, "URI", NULL);
+  cached_patterns = g_key_file_get_string_list (key_file, SCAN_CACHE_GROUP,
+                                                "PatternToIgnore", NULL, NULL);
+  cached_include_patterns = g_key_file_get_string_list (key_file, SCAN_CACHE_GROUP,
+                                                        "IncludePatterns", NULL, NULL);
+  if (g_key_file_get_integer (key_file, SCAN_CACHE_GROUP, "Version", NULL) != SCAN_CACHE_VERSION ||
+      g_strcmp0 (uri, cached_uri) != 0 ||
+      g_key_file_get_uint64 (key_file, SCAN_CACHE_GROUP, "SourceSize", NULL) !=
+        g_file_info_get_attribute_uint64 (identity, G_FILE_ATTRIBUTE_STANDARD_SIZE) ||
+      g_key_file_get_uint64 (key_file, SCAN_CACHE_GROUP, "SourceMTime", NULL) !=
+        g_file_info_get_attribute_uint64 (identity, G_FILE_ATTRIBUTE_TIME_MODIFIED) ||
+      g_key_file_get_uint64 (key_file, SCAN_CACHE_GROUP, "SourceMTimeUsec", NULL) !=
+        g_file_info_get_attribute_uint32 (identity, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC) ||
+      g_key_file_get_uint64 (key_file, SCAN_CACHE_GROUP, "SourceDevice", NULL) !=
+        g_file_info_get_attribute_uint32 (identity, G_FILE_ATTRIBUTE_UNIX_DEVICE) ||
+      g_key_file_get_uint64 (key_file, SCAN_CACHE_GROUP, "SourceInode", NULL) !=
+        g_file_info_get_attribute_uint64 (identity, G_FILE_ATTRIBUTE_UNIX_INODE) ||
+      !autoar_extract_do_check_scan_cache_patterns (autoar_pref_get_pattern_to_ignore (priv->arpref),
+                                                    cached_patterns) ||
+      (priv->include_patterns == NULL) != (cached_include_patterns == NULL) ||
+      !autoar_extract_do_check_scan_cache_patterns ((const char**)(priv->include_patterns),
+                                                    cached_include_patterns)) {
+    g_debug ("autoar_extract_do_load_scan_cache: %s is out of date", cache_path);
+    g_unlink (cache_path);
+    goto out;
+  }
+
+  priv->files = g_key_file_get_uint64 (key_file, SCAN_CACHE_GROUP, "Files", NULL);
+  priv->size = g_key_file_get_uint64 (key_file, SCAN_CACHE_GROUP, "Size", NULL);
+  priv->has_top_level_dir = g_key_file_get_boolean (key_file, SCAN_CACHE_GROUP, "HasTopLevelDir", NULL);
+  priv->has_only_one_file = g_key_file_get_boolean (key_file, SCAN_CACHE_GROUP, "HasOnlyOneFile", NULL);
+  priv->use_raw_format = g_key_file_get_boolean (key_file, SCAN_CACHE_GROUP, "UseRawFormat", NULL);
+  priv->archive_format = g_key_file_get_integer (key_file, SCAN_CACHE_GROUP, "Format", NULL);
+  priv->archive_filter = g_key_file_get_integer (key_file, SCAN_CACHE_GROUP, "Filter", NULL);
+  if (g_key_file_has_key (key_file, SCAN_CACHE_GROUP, "EntriesEnd", NULL))
+    priv->entries_end = g_key_file_get_uint64 (key_file, SCAN_CACHE_GROUP, "EntriesEnd", NULL);
+
+  /* An archive without entries has no prefix and basename */
+  priv->pathname_prefix = autoar_extract_do_scan_cache_get_name (key_file, "PathnamePrefix");
+  priv->pathname_prefix_len = priv->pathname_prefix != NULL ? strlen (priv->pathname_prefix) : 0;
+  priv->pathname_basename = autoar_extract_do_scan_cache_get_name (key_file, "PathnameBasename");
+
+  bad_filename = g_key_file_get_string_list (key_file, SCAN_CACHE_GROUP, "BadFilename", NULL, NULL);
+  for (i = 0; bad_filename != NULL && bad_filename[i] != NULL; i++) {
+    char *name = g_uri_unescape_string (bad_filename[i], NULL);
+    if (name != NULL)
+      autoar_extract_do_mark_bad (arextract, priv->archive_format, 0, name);
+    g_free (name);
+  }
+
+  bad_entries = g_key_file_get_integer_list (key_file, SCAN_CACHE_GROUP, "BadEntries", &n_bad_entries, NULL);
+  for (i = 0; bad_entries != NULL && i < n_bad_entries; i++)
+    autoar_extract_do_mark_bad (arextract, priv->archive_format, bad_entries[i], NULL);
+  g_free (bad_entries);
+
+  g_debug ("autoar_extract_do_load_scan_cache: %s is used", cache_path);
+  valid = TRUE;
+
+out:
+  g_strfreev (bad_filename);
+  g_strfreev (cached_patterns);
+  g_strfreev (cached_include_patterns);
+  g_free (cached_uri);
+  g_free (uri);
+  g_key_file_free (key_file);
+  g_free (cache_path);
+
+  return valid;
+}
+
+static void
+autoar_extract_do_save_scan_cache (AutoarExtract *arextract,
+                                   GFileInfo *identity)
+{
+  AutoarExtractPrivate *priv;
+  GKeyFile *key_file;
+  GHashTableIter iter;
+  gpointer bad_filename;
+  GPtrArray *bad_filename_list;
+  GArray *bad_entries_list;
+  const char **pattern;
+  guint i;
+  char *cache_path, *cache_dir;
+  char *uri;
+  char *data;
+  gsize length;
+
+  priv = arextract->priv;
+
+  key_file = g_key_file_new ();
+  uri = g_file_get_uri (priv->source_file);
+  g_key_file_set_integer (key_file, SCAN_CACHE_GROUP, "Version", SCAN_CACHE_VERSION);
+  g_key_file_set_string (key_file, SCAN_CACHE_GROUP, "URI", uri);
+  g_key_file_set_uint64 (key_file, SCAN_CACHE_GROUP, "SourceSize",
+                         g_file_info_get_attribute_uint64 (identity, G_FILE_ATTRIBUTE_STANDARD_SIZE));
+  g_key_file_set_uint64 (key_file, SCAN_CACHE_GROUP, "SourceMTime",
+                         g_file_info_get_attribute_uint64 (identity, G_FILE_ATTRIBUTE_TIME_MODIFIED));
+  g_key_file_set_uint64 (key_file, SCAN_CACHE_GROUP, "SourceMTimeUsec",
+                         g_file_info_get_attribute_uint32 (identity, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC));
+  g_key_file_set_uint64 (key_file, SCAN_CACHE_GROUP, "SourceDevice",
+                         g_file_info_get_attribute_uint32 (identity, G_FILE_ATTRIBUTE_UNIX_DEVICE));
+  g_key_file_set_uint64 (key_file, SCAN_CACHE_GROUP, "SourceInode",
+                         g_file_info_get_attribute_uint64 (identity, G_FILE_ATTRIBUTE_UNIX_INODE));
+  g_free (uri);
+
+  pattern = autoar_pref_get_pattern_to_ignore (priv->arpref);
+  if (pattern != NULL)
+    g_key_file_set_string_list (key_file, SCAN_CACHE_GROUP, "PatternToIgnore",
+                                pattern, g_strv_length ((char**)pattern));
+  if (priv->include_patterns != NULL)
+    g_key_file_set_string_list (key_file, SCAN_CACHE_GROUP, "IncludePatterns",
+                                (const char * const *)(priv->include_patterns),
+                                g_strv_length (priv->include_patterns));
+
+  g_key_file_set_uint64 (key_file, SCAN_CACHE_GROUP, "Files", priv->files);
+  g_key_file_set_uint64 (key_file, SCAN_CACHE_GROUP, "Size", priv->size);
+  g_key_file_set_boolean (key_file, SCAN_CACHE_GROUP, "HasTopLevelDir", priv->has_top_level_dir);
+  g_key_file_set_boolean (key_file, SCAN_CACHE_GROUP, "HasOnlyOneFile", priv->has_only_one_file);
+  g_key_file_set_boolean (key_file, SCAN_CACHE_GROUP, "UseRawFormat", priv->use_raw_format);
+  g_key_file_set_integer (key_file, SCAN_CACHE_GROUP, "Format", priv->archive_format);
+  g_key_file_set_integer (key_file, SCAN_CACHE_GROUP, "Filter", priv->archive_filter);
+  if (priv->entries_end != G_MAXUINT)
+    g_key_file_set_uint64 (key_file, SCAN_CACHE_GROUP, "EntriesEnd", priv->entries_end);
+  if (priv->pathname_prefix != NULL)
+    autoar_extract_do_scan_cache_set_name (key_file, "PathnamePrefix", priv->pathname_prefix);
+  if (priv->pathname_basename != NULL)
+    autoar_extract_do_scan_cache_set_name (key_file, "PathnameBasename", priv->pathname_basename);
+
+  bad_filename_list = g_ptr_array_new_with_free_func (g_free);
+  g_hash_table_iter_init (&iter, priv->bad_filename);
+  while (g_hash_table_iter_next (&iter, &bad_filename, NULL))
+    g_ptr_array_add (bad_filename_list, g_uri_escape_string (bad_filename, "/", FALSE));
+  g_key_file_set_string_list (key_file, SCAN_CACHE_GROUP, "BadFilename",
+                              (const char * const *)(bad_filename_list->pdata),
+                              bad_filename_list->len);
+  g_ptr_array_unref (bad_filename_list);
+
+  bad_entries_list = g_array_new (FALSE, FALSE, sizeof (gint));
+  for (i = 0; i < priv->bad_entries->len * 8; i++) {
+    if (autoar_extract_do_is_bad (arextract, i, NULL)) {
+      gint ordinal = i;
+      g_array_append_val (bad_entries_list, ordinal);
+    }
+  }
+  g_key_file_set_integer_list (key_file, SCAN_CACHE_GROUP, "BadEntries",
+                               (gint*)(bad_entries_list->data),
+                               bad_entries_list->len);
+  g_array_unref (bad_entries_list);
+
+  /* Failing to write the cache is not fatal. It only makes the next run
+   * slower. */
+  cache_path = autoar_extract_do_get_scan_cache_path (arextract);
+  cache_dir = g_path_get_dirname (cache_path);
+  data = g_key_file_to_data (key_file, &length, NULL);
+  if (data != NULL && g_mkdir_with_parents (cache_dir, 0700) == 0)
+    g_file_set_contents (cache_path, data, length, NULL);
+
+  g_free (data);
+  g_free (cache_dir);
+  g_free (cache_path);
+  g_key_file_free (key_file);
+}
+
+static void
+autoar_extract_step_scan_toplevel (AutoarExtract *arextract)
+{
+  /* Step 1: Scan all file names in the archive
+   * We have to check whether the archive contains a top-level directory
+   * before performing the extraction. We emit the "scanned" signal when
+   * the checking is completed. */
+
+  struct archive *a;
+  struct archive_entry *entry;
+
+  AutoarExtractPrivate *priv;
+  GFileInfo *identity;
+  int r;
+  guint ordinal;
+
+  priv = arextract->priv;
+  identity = NULL;
+
+  g_debug ("autoar_extract_step_scan_toplevel: called");
+
+  if (priv->use_scan_cache && !(priv->source_is_mem)) {
+    identity = g_file_query_info (priv->source_file,
+                                  SCAN_CACHE_ATTRIBUTES,
+                                  G_FILE_QUERY_INFO_NONE,
+                                  priv->cancellable,
+                                  NULL);
+    if (identity != NULL && autoar_extract_do_load_scan_cache (arextract, identity)) {
+      g_object_unref (identity);
+      autoar_extract_do_scan_finish (arextract);
+      return;
+    }
+  }
+
+  a = autoar_extract_do_open_archive (arextract);
+  if (a == NULL) {
+    autoar_common_g_object_unref (identity);
+    return;
+  }
+
+  for (ordinal = 0; (r = archive_read_next_header (a, &entry)) == ARCHIVE_OK; ordinal++) {
+    const char *pathname;
+
+    if (g_cancellable_is_cancelled (priv->cancellable)) {
+      autoar_common_g_object_unref (identity);
+      archive_read_free (a);
+      return;
+    }
+
+    pathname = archive_entry_pathname (entry);
+    g_debug ("autoar_extract_step_scan_toplevel: %d: pathname = %s", priv->files, pathname);
+
+    if (!priv->use_raw_format &&
+        (!autoar_extract_do_include_check (arextract, entry) ||
+         !autoar_extract_do_pattern_check (pathname, priv->pattern_matcher))) {
+      autoar_extract_do_mark_bad (arextract, archive_format (a), ordinal, pathname);
+      continue;
+    }
+
+    g_debug ("autoar_extract_step_scan_toplevel: %d: pattern check passed", priv->files);
+
+    autoar_extract_do_scan_entry (arextract, entry, pathname);
+
+    /* Later entries are neither scanned nor extracted */
+    if (autoar_extract_do_include_done (arextract, archive_format (a))) {
+      g_debug ("autoar_extract_step_scan_toplevel: all included paths found");
+      priv->entries_end = ordinal + 1;
+      r = ARCHIVE_EOF;
+      break;
+    }
+
+    archive_read_data_skip (a);
+  }
+
+  if (r != ARCHIVE_EOF) {
+    if (priv->error == NULL) {
+      priv->error = autoar_common_g_error_new_a (a, priv->source);
+    }
+    autoar_common_g_object_unref (identity);
+    archive_read_free (a);
+    return;
+  }
+
+  priv->archive_format = archive_format (a);
+  priv->archive_filter = archive_filter_code (a, 0);
+  archive_read_free (a);
+
+  if (identity != NULL) {
+    autoar_extract_do_save_scan_cache (arextract, identity);
+    g_object_unref (identity);
+  }
+
+  autoar_extract_do_scan_finish (arextract);
+}
+
+static void
+autoar_extract_step_extract_staged (AutoarExtract *arextract)
+{
+  /* Alternative step 1: Scan and extract files in the same pass
+   * Because we do not know whether the archive has a top-level directory
+   * before all entries are read, files are extracted to the staging
+   * directory with their original path names. The "scanned" signal is
+   * emitted after all files are written. */
+
+  struct archive *a;
+  struct archive_entry *entry;
+
+  AutoarExtractPrivate *priv;
+  int r;
+
+  priv = arextract->priv;
+
+  g_debug ("autoar_extract_step_extract_staged: called");
+
+  a = autoar_extract_do_open_archive (arextract);
+  if (a == NULL)
+    return;
+
+  if (!autoar_extract_do_make_staging_dir (arextract)) {
+    archive_read_free (a);
+    return;
+  }
+
+  while ((r = archive_read_next_header (a, &entry)) == ARCHIVE_OK) {
+    const char *pathname;
+    const char *hardlink;
+    GFile *extracted_filename;
+    GFile *hardlink_filename;
+
+    if (g_cancellable_is_cancelled (priv->cancellable)) {
+      archive_read_free (a);
+      return;
+    }
+
+    pathname = archive_entry_pathname (entry);
+    hardlink = archive_entry_hardlink (entry);
+    g_debug ("autoar_extract_step_extract_staged: %d: pathname = %s", priv->files, pathname);
+
+    if (!priv->use_raw_format &&
+        (!autoar_extract_do_include_check (arextract, entry) ||
+         !autoar_extract_do_pattern_check (pathname, priv->pattern_matcher)))
+      continue;
+
+    autoar_extract_do_scan_entry (arextract, entry, pathname);
+
+    extracted_filename =
+      autoar_extract_do_sanitize_pathname (pathname, "./", priv->staging_dir);
+    hardlink_filename = hardlink == NULL ? NULL :
+      autoar_extract_do_sanitize_pathname (hardlink, "./", priv->staging_dir);
+
+    if (priv->staged_first == NULL)
+      priv->staged_first = g_object_ref (extracted_filename);
+
+    autoar_extract_do_write_entry (arextract, a, NULL, entry,
+                                   extracted_filename, hardlink_filename,
+                                   &(priv->error));
+
+    g_object_unref (extracted_filename);
+    if (hardlink_filename != NULL)
+      g_object_unref (hardlink_filename);
+
+    if (priv->error != NULL) {
+      archive_read_free (a);
+      return;
+    }
+
+    autoar_extract_do_progress (arextract, 0, 1);
+
+    if (autoar_extract_do_include_done (arextract, archive_format (a))) {
+      g_debug ("autoar_extract_step_extract_staged: all included paths found");
+      r = ARCHIVE_EOF;
+      break;
+    }
+  }
+
+  if (r != ARCHIVE_EOF) {
+    if (priv->error == NULL) {
+      priv->error = autoar_common_g_error_new_a (a, priv->source);
+    }
+    archive_read_free (a);
+    return;
+  }
+
+  priv->archive_format = archive_format (a);
+  priv->archive_filter = archive_filter_code (a, 0);
+  archive_read_free (a);
+
+  autoar_extract_do_scan_finish (arextract);
+}
+
+static void
+autoar_extract_do_sink_failed (AutoarExtract *arextract,
+                               const AutoarEntryInfo *info)
+{
+  AutoarExtractPrivate *priv;
+
+  priv = arextract->priv;
+
+  /* Callbacks of the sink may fail without setting an error */
+  if (priv->error == NULL)
+    priv->error = g_error_new (AUTOAR_EXTRACT_ERROR, SINK_FAILED_ERRNO,
+                               "\'%s\': %s", info->pathname, "rejected by the sink");
+}
+
+static void
+autoar_extract_step_extract_sink (AutoarExtract *arextract)
+{
+  /* Alternative step 1: Pass entries to the sink
+   * Data blocks are passed as they are decoded, pointing to the buffer of
+   * libarchive. Nothing is written to the file system, so the destination is
+   * never decided. The "scanned" signal is emitted after all entries are
+   * read. */
+
+  struct archive *a;
+  struct archive_entry *entry;
+
+  AutoarExtractPrivate *priv;
+  AutoarExtractSink *sink;
+  GString *pathname_buffer;
+  GString *hardlink_buffer;
+  guint ordinal;
+  int r;
+
+  priv = arextract->priv;
+  sink = &(priv->sink);
+
+  g_debug ("autoar_extract_step_extract_sink: called");
+
+  a = autoar_extract_do_open_archive (arextract);
+  if (a == NULL)
+    return;
+
+  pathname_buffer = autoar_extract_do_get_sanitize_buffer ();
+  hardlink_buffer = g_string_new (NULL);
+
+  for (ordinal = 0; (r = archive_read_next_header (a, &entry)) == ARCHIVE_OK; ordinal++) {
+    AutoarEntryInfo info;
+    const char *pathname;
+    const char *hardlink;
+    const void *buffer;
+    size_t size;
+    gint64 offset;
+    int rd;
+
+    if (g_cancellable_is_cancelled (priv->cancellable))
+      break;
+
+    pathname = archive_entry_pathname (entry);
+    hardlink = archive_entry_hardlink (entry);
+    g_debug ("autoar_extract_step_extract_sink: %d: pathname = %s", priv->files, pathname);
+
+    if (!priv->use_raw_format &&
+        (!autoar_extract_do_include_check (arextract, entry) ||
+         !autoar_extract_do_pattern_check (pathname, priv->pattern_matcher)))
+      continue;
+
+    autoar_extract_do_scan_entry (arextract, entry, pathname);
+
+    /* The raw format does not record a name */
+    if (priv->use_raw_format)
+      pathname = priv->suggested_destname;
+    else
+      pathname = autoar_common_sanitize_pathname (pathname, FALSE, pathname_buffer);
+    if (hardlink != NULL)
+      hardlink = autoar_common_sanitize_pathname (hardlink, FALSE, hardlink_buffer);
+
+    /* The directory containing the archive itself */
+    if (*pathname == '\0') {
+      autoar_extract_do_progress (arextract, 0, 1);
+      continue;
+    }
+
+    autoar_common_entry_info_fill (&info, entry, pathname, hardlink, ordinal);
+
+    if (sink->begin_entry == NULL ||
+        (*(sink->begin_entry))(arextract, &info, priv->sink_data, &(priv->error))) {
+      rd = ARCHIVE_EOF;
+      while (sink->write_data != NULL &&
+             (rd = archive_read_data_block (a, &buffer, &size, &offset)) == ARCHIVE_OK) {
+        if (buffer == NULL)
+          continue;
+        if (!(*(sink->write_data))(arextract, &info, buffer, size, offset,
+                                   priv->sink_data, &(priv->error))) {
+          autoar_extract_do_sink_failed (arextract, &info);
+          break;
+        }
+        autoar_extract_do_progress (arextract, size, 0);
+      }
+
+      if (priv->error == NULL && rd != ARCHIVE_EOF)
+        priv->error = autoar_common_g_error_new_a_entry (a, entry);
+
+      if (priv->error == NULL && sink->end_entry != NULL &&
+          !(*(sink->end_entry))(arextract, &info, priv->sink_data, &(priv->error)))
+        autoar_extract_do_sink_failed (arextract, &info);
+    }
+
+    if (priv->error != NULL)
+      break;
+
+    autoar_extract_do_progress (arextract, 0, 1);
+
+    if (autoar_extract_do_include_done (arextract, archive_format (a))) {
+      g_debug ("autoar_extract_step_extract_sink: all included paths found");
+      r = ARCHIVE_EOF;
+      break;
+    }
+  }
+
+  g_string_free (hardlink_buffer, TRUE);
+
+  if (priv->error != NULL || g_cancellable_is_cancelled (priv->cancellable)) {
+    archive_read_free (a);
+    return;
+  }
+
+  if (r != ARCHIVE_EOF) {
+    priv->error = autoar_common_g_error_new_a (a, priv->source);
+    archive_read_free (a);
+    return;
+  }
+
+  priv->archive_format = archive_format (a);
+  priv->archive_filter = archive_filter_code (a, 0);
+  archive_read_free (a);
+
+  autoar_extract_do_scan_finish (arextract);
+}
+
+static void
+autoar_extract_step_verify (AutoarExtract *arextract)
+{
+  /* Alternative step 1: Decode all entries and discard their data
+   * Errors of a single entry are reported and testing goes on with the next
+   * entry. Only fatal errors and broken headers stop it. Nothing is written
+   * to the file system, so the destination is never decided. */
+
+  struct archive *a;
+  struct archive_entry *entry;
+
+  AutoarExtractPrivate *priv;
+  gint64 start;
+  int r;
+
+  priv = arextract->priv;
+
+  g_debug ("autoar_extract_step_verify: called");
+
+  start = g_get_monotonic_time ();
+
+  a = autoar_extract_do_open_archive (arextract);
+  if (a == NULL)
+    return;
+
+  while ((r = archive_read_next_header (a, &entry)) == ARCHIVE_OK) {
+    const char *pathname;
+    const void *buffer;
+    size_t size;
+    gint64 offset;
+    int rd;
+
+    if (g_cancellable_is_cancelled (priv->cancellable))
+      break;
+
+    pathname = archive_entry_pathname (entry);
+    g_debug ("autoar_extract_step_verify: %d: pathname = %s", priv->files, pathname);
+
+    if (!priv->use_raw_format &&
+        (!autoar_extract_do_include_check (arextract, entry) ||
+         !autoar_extract_do_pattern_check (pathname, priv->pattern_matcher)))
+      continue;
+
+    autoar_extract_do_scan_entry (arextract, entry, pathname);
+
+    while ((rd = archive_read_data_block (a, &buffer, &size, &offset)) == ARCHIVE_OK) {
+      priv->verify_size += size;
+      autoar_extract_do_progress (arextract, size, 0);
+    }
+
+    if (rd == ARCHIVE_FATAL) {
+      priv->error = autoar_common_g_error_new_a_entry (a, entry);
+      break;
+    }
+
+    if (rd != ARCHIVE_EOF) {
+      GError *error = autoar_common_g_error_new_a_entry (a, entry);
+      g_debug ("autoar_extract_step_verify: failed: %s", error->message);
+      priv->verify_failed++;
+      autoar_extract_signal_entry_failed (arextract, pathname, error);
+      g_error_free (error);
+    }
+
+    autoar_extract_do_progress (arextract, 0, 1);
+
+    if (autoar_extract_do_include_done (arextract, archive_format (a))) {
+      g_debug ("autoar_extract_step_verify: all included paths found");
+      r = ARCHIVE_EOF;
+      break;
+    }
+  }
+
+  priv->verify_time = g_get_monotonic_time () - start;
+  g_debug ("autoar_extract_step_verify: %" G_GUINT64_FORMAT " bytes in %" G_GINT64_FORMAT " us",
+           priv->verify_size, priv->verify_time);
+
+  if (priv->error != NULL || g_cancellable_is_cancelled (priv->cancellable)) {
+    archive_read_free (a);
+    return;
+  }
+
+  if (r != ARCHIVE_EOF) {
+    priv->error = autoar_common_g_error_new_a (a, priv->source);
+    archive_read_free (a);
+    return;
+  }
+
+  priv->archive_format = archive_format (a);
+  priv->archive_filter = archive_filter_code (a, 0);
+  archive_read_free (a);
+
+  if (priv->verify_failed > 0) {
+    priv->error = g_error_new (AUTOAR_EXTRACT_ERROR, VERIFY_FAILED_ERRNO,
+                               "\'%s\': %u %s", priv->source, priv->verify_failed,
+                               priv->verify_failed == 1 ?
+                               "entry is damaged" : "entries are damaged");
+    return;
+  }
+
+  autoar_extract_do_scan_finish (arextract);
+}
+
+static void
+autoar_extract_step_decide_dest (AutoarExtract *arextract) {
+  /* Step 2: Create necessary directories
+   * If the archive contains only one file, we don't create the directory */
+
+  const char *pathname_extension;
+
+  AutoarExtractPrivate *priv;
+  int i;
+
+  priv = arextract->priv;
+
+  g_debug ("autoar_extract_step_decide_dest: called");
+
+  {
+    pathname_extension = autoar_common_get_filename_extension (priv->pathname_basename);
+    if (priv->has_only_one_file && (pathname_extension != priv->pathname_basename)) {
+      /* If we only have one file, we have to add the file extension.
+       * Although we use the variable `top_level_dir', it may be a regular
+       * file, so the extension is important. */
+      char *new_filename = g_strconcat (priv->suggested_destname, pathname_extension, NULL);
+      priv->top_level_dir = g_file_get_child (priv->output_file, new_filename);
+      g_free (new_filename);
+    } else {
+      priv->top_level_dir = g_file_get_child (priv->output_file, priv->suggested_destname);
+      pathname_extension = "";
+    }
+  }
+
+  {
+    char *top_level_dir_basename_modified = NULL;
+    for (i = 1; g_file_query_exists (priv->top_level_dir, priv->cancellable); i++) {
+      g_free (top_level_dir_basename_modified);
+      g_object_unref (priv->top_level_dir);
 
-  g_object_class_install_property (object_class, PROP_OUTPUT,
-                                   g_param_spec_string ("output",
-                                                        "Output directory",
-                                                        "Output directory of extracted archive",
-                                                        NULL,
-                                                        G_PARAM_READWRITE |
-                                                        G_PARAM_CONSTRUCT_ONLY |
-                                                        G_PARAM_STATIC_STRINGS));
+      if (g_cancellable_is_cancelled (priv->cancellable))
+        return;
 
-  g_object_class_install_property (object_class, PROP_OUTPUT_FILE,
-                                   g_param_spec_object ("output-file",
-                                                        "Output directory GFile",
-                                                        "Output directory GFile of extracted archives",
-                                                        G_TYPE_FILE,
-                                                        G_PARAM_READWRITE |
-                                                        G_PARAM_CONSTRUCT_ONLY |
-                                                        G_PARAM_STATIC_STRINGS));
+      if (priv->has_only_one_file) {
+        top_level_dir_basename_modified = g_strdup_printf ("%s(%d)%s",
+                                                           priv->suggested_destname,
+                                                           i,
+                                                           pathname_extension);
+      } else {
+        top_level_dir_basename_modified = g_strdup_printf ("%s(%d)",
+                                                           priv->suggested_destname,
+                                                           i);
+      }
+      priv->top_level_dir = g_file_get_child (priv->output_file,
+                                              top_level_dir_basename_modified);
+    }
+    g_free (top_level_dir_basename_modified);
+  }
 
-  g_object_class_install_property (object_class, PROP_SIZE,
-                                   g_param_spec_uint64 ("size",
-                                                        "File size",
-                                                        "Size of the extracted files",
-                                                        0, G_MAXUINT64, 0,
-                                                        G_PARAM_READABLE |
-                                                        G_PARAM_STATIC_STRINGS));
+  /* Staged files will be moved to the destination, so there is no need to
+   * create the directory here. */
+  if (!(priv->has_only_one_file) && priv->staging_dir == NULL)
+    g_file_make_directory_with_parents (priv->top_level_dir, priv->cancellable, &(priv->error));
 
-  g_object_class_install_property (object_class, PROP_COMPLETED_SIZE,
-                                   g_param_spec_uint64 ("completed-size",
-                                                        "Written file size",
-                                                        "Bytes written to disk",
-                                                        0, G_MAXUINT64, 0,
-                                                        G_PARAM_READABLE |
-                                                        G_PARAM_STATIC_STRINGS));
+  if (priv->error != NULL)
+    return;
 
-  g_object_class_install_property (object_class, PROP_FILES,
-                                   g_param_spec_uint ("files",
-                                                      "Files",
-                                                      "Number of files in the archive",
-                                                      0, G_MAXUINT32, 0,
-                                                      G_PARAM_READABLE |
-                                                      G_PARAM_STATIC_STRINGS));
+  autoar_extract_signal_decide_dest (arextract);
+}
 
-  g_object_class_install_property (object_class, PROP_COMPLETED_FILES,
-                                   g_param_spec_uint ("completed-files",
-                                                      "Written files",
-                                                      "Number of files has been written",
-                                                      0, G_MAXUINT32, 0,
-                                                      G_PARAM_READABLE |
-                                                      G_PARAM_STATIC_STRINGS));
+static void
+autoar_extract_step_decide_dest_already (AutoarExtract *arextract) {
+  /* Alternative step 2: Output is destination */
+  arextract->priv->top_level_dir = g_object_ref (arextract->priv->output_file);
+  autoar_extract_signal_decide_dest (arextract);
+}
 
-  g_object_class_install_property (object_class, PROP_SOURCE_IS_MEM,
-                                   g_param_spec_boolean ("source-is-mem",
-                                                         "Source is memory",
-                                                         "Whether source file is in memory",
-                                                         FALSE,
-                                                         G_PARAM_READWRITE |
-                                                         G_PARAM_CONSTRUCT_ONLY |
-                                                         G_PARAM_STATIC_STRINGS));
+static GFile*
+autoar_extract_do_get_dest (AutoarExtract *arextract,
+                            struct archive_entry *entry,
+                            GFile **hardlink_file)
+{
+  /* Returns NULL if the entry should be ignored */
 
-  g_object_class_install_property (object_class, PROP_OUTPUT_IS_DEST,
-                                   g_param_spec_boolean ("output-is-dest",
-                                                         "Output is destination",
-                                                         "Whether output direcotry is used as destination",
-                                                         FALSE,
-                                                         G_PARAM_READWRITE |
-                                                         G_PARAM_CONSTRUCT |
-                                                         G_PARAM_STATIC_STRINGS));
+  AutoarExtractPrivate *priv;
+  const char *pathname;
+  const char *hardlink;
+  GFile *extracted_filename;
+  GFile *hardlink_filename;
 
-  g_object_class_install_property (object_class, PROP_NOTIFY_INTERVAL,
-                                   g_param_spec_int64 ("notify-interval",
-                                                       "Notify interval",
-                                                       "Minimal time interval between progress signal",
-                                                       0, G_MAXINT64, 100000,
-                                                       G_PARAM_READWRITE |
-                                                       G_PARAM_CONSTRUCT |
-                                                       G_PARAM_STATIC_STRINGS));
+  priv = arextract->priv;
 
-/**
- * AutoarExtract::scanned:
- * @arextract: the #AutoarExtract
- * @files: the number of files will be extracted from the source archive
- *
- * This signal is emitted when #AutoarExtract finish scanning filename entries
- * in the source archive.
- **/
-  autoar_extract_signals[SCANNED] =
-    g_signal_new ("scanned",
-                  type,
-                  G_SIGNAL_RUN_LAST,
-                  0, NULL, NULL,
-                  g_cclosure_marshal_VOID__UINT,
-                  G_TYPE_NONE,
-                  1,
-                  G_TYPE_UINT);
+  pathname = archive_entry_pathname (entry);
+  hardlink = archive_entry_hardlink (entry);
+  hardlink_filename = NULL;
+  *hardlink_file = NULL;
+
+  if (!(priv->has_only_one_file)) {
+    if (priv->has_top_level_dir) {
+      extracted_filename =
+        autoar_extract_do_sanitize_pathname (pathname + priv->pathname_prefix_len,
+                                             NULL, priv->top_level_dir);
+      if (hardlink != NULL)
+        hardlink_filename =
+          autoar_extract_do_sanitize_pathname (hardlink + priv->pathname_prefix_len,
+                                               NULL, priv->top_level_dir);
+    } else {
+      extracted_filename =
+        autoar_extract_do_sanitize_pathname (pathname, "./", priv->top_level_dir);
+      if (hardlink != NULL)
+        hardlink_filename =
+          autoar_extract_do_sanitize_pathname (hardlink, "./", priv->top_level_dir);
+    }
+  } else {
+    extracted_filename = g_object_ref (priv->top_level_dir);
+  }
 
-/**
- * AutoarExtract::decide-dest:
- * @arextract: the #AutoarExtract
- * @destination: the location of the extracted directory or file
- *
- * This signal is emitted when the location of the extracted directory or
- * file is determined.
- **/
-  autoar_extract_signals[DECIDE_DEST] =
-    g_signal_new ("decide-dest",
-                  type,
-                  G_SIGNAL_RUN_LAST,
-                  0, NULL, NULL,
-                  g_cclosure_marshal_generic,
-                  G_TYPE_NONE,
-                  1,
-                  G_TYPE_FILE);
+  *hardlink_file = hardlink_filename;
+  return extracted_filename;
+}
 
-/**
- * AutoarExtract::progress:
- * @arextract: the #AutoarExtract
- * @completed_size: bytes has been written to disk
- * @completed_files: number of files have been written to disk
- *
- * This signal is used to report progress of creating archives.
- **/
-  autoar_extract_signals[PROGRESS] =
-    g_signal_new ("progress",
-                  type,
-                  G_SIGNAL_RUN_LAST,
-                  0, NULL, NULL,
-                  g_cclosure_marshal_generic,
-                  G_TYPE_NONE,
-                  2,
-                  G_TYPE_UINT64,
-                  G_TYPE_UINT);
+static void
+autoar_extract_do_extract_entry (AutoarExtract *arextract,
+                                 struct archive *a,
+                                 struct archive_entry *entry,
+                                 GError **error)
+{
+  GFile *extracted_filename;
+  GFile *hardlink_filename;
 
-/**
- * AutoarExtract::cancelled:
- * @arextract: the #AutoarExtract
- *
- * This signal is emitted after archive extracting job is cancelled by the
- * #GCancellable.
- **/
-  autoar_extract_signals[CANCELLED] =
-    g_signal_new ("cancelled",
-                  type,
-                  G_SIGNAL_RUN_LAST,
-                  0, NULL, NULL,
-                  g_cclosure_marshal_VOID__VOID,
-                  G_TYPE_NONE,
-                  0);
+  extracted_filename = autoar_extract_do_get_dest (arextract, entry, &hardlink_filename);
+  if (extracted_filename == NULL)
+    return;
 
-/**
- * AutoarExtract::completed:
- * @arextract: the #AutoarExtract
- *
- * This signal is emitted after the archive extracting job is successfully
- * completed.
- **/
-  autoar_extract_signals[COMPLETED] =
-    g_signal_new ("completed",
-                  type,
-                  G_SIGNAL_RUN_LAST,
-                  0, NULL, NULL,
-                  g_cclosure_marshal_VOID__VOID,
-                  G_TYPE_NONE,
-                  0);
+  autoar_extract_do_write_entry (arextract, a, NULL, entry,
+                                 extracted_filename, hardlink_filename,
+                                 error);
 
-/**
- * AutoarExtract::error:
- * @arextract: the #AutoarExtract
- * @error: the #GError
- *
- * This signal is emitted when error occurs and all jobs should be terminated.
- * Possible error domains are %AUTOAR_EXTRACT_ERROR, %G_IO_ERROR, and
- * %AUTOAR_LIBARCHIVE_ERROR, which represent error occurs in #AutoarExtract,
- * GIO, and libarchive, respectively. The #GError is owned by #AutoarExtract
- * and should not be freed.
- **/
-  autoar_extract_signals[AR_ERROR] =
-    g_signal_new ("error",
-                  type,
-                  G_SIGNAL_RUN_LAST,
-                  0, NULL, NULL,
-                  g_cclosure_marshal_generic,
-                  G_TYPE_NONE,
-                  1,
-                  G_TYPE_ERROR);
+  g_object_unref (extracted_filename);
+  if (hardlink_filename != NULL)
+    g_object_unref (hardlink_filename);
+
+  if (*error != NULL)
+    return;
+
+  autoar_extract_do_progress (arextract, 0, 1);
 }
 
-static void
-autoar_extract_init (AutoarExtract *arextract)
+static guint
+autoar_extract_do_get_n_threads (AutoarExtract *arextract)
+{
+  return arextract->priv->n_threads == 0 ?
+         g_get_num_processors () : arextract->priv->n_threads;
+}
+
+static guint
+autoar_extract_do_get_n_workers (AutoarExtract *arextract)
 {
   AutoarExtractPrivate *priv;
+  guint n_workers;
+  int format;
 
-  priv = AUTOAR_EXTRACT_GET_PRIVATE (arextract);
-  arextract->priv = priv;
+  priv = arextract->priv;
+
+  n_workers = autoar_extract_do_get_n_threads (arextract);
+  if (n_workers > priv->files)
+    n_workers = priv->files;
+  if (n_workers <= 1)
+    return 1;
+
+  /* Each reader must be able to jump to the entry it wants without decoding
+   * all previous entries. It is possible for zip archives which are not
+   * compressed as a whole. Workers claim entries by their ordinal numbers, so
+   * every reader must also see the entries in the same order, which is not
+   * guaranteed for ISO 9660 images. */
+  format = priv->archive_format & ARCHIVE_FORMAT_BASE_MASK;
+  if (priv->use_raw_format || priv->has_only_one_file ||
+      priv->archive_filter != ARCHIVE_FILTER_NONE ||
+      format != ARCHIVE_FORMAT_ZIP)
+    return 1;
+
+  if (!(priv->source_is_mem)) {
+    GFileInputStream *istream;
+    gboolean can_seek;
+
+    istream = g_file_read (priv->source_file, priv->cancellable, NULL);
+    if (istream == NULL)
+      return 1;
+    can_seek = g_seekable_can_seek (G_SEEKABLE (istream));
+    g_object_unref (istream);
+    if (!can_seek)
+      return 1;
+  }
+
+  return n_workers;
+}
+
+static gpointer
+autoar_extract_do_parallel_worker (gpointer data)
+{
+  /* Each worker owns a reader on the source archive. Entries are claimed by
+   * their ordinal numbers, so every entry is extracted by exactly one worker
+   * and all workers only move forward in the archive. */
+
+  AutoarExtractWorker *worker;
+  AutoarExtract *arextract;
+  AutoarExtractPrivate *priv;
+  struct archive *a;
+  struct archive_entry *entry;
+  GFile *extracted_filename;
+  GFile *hardlink_filename;
+  gpointer owner;
+  gboolean deferred, replaced;
+  int ordinal, claimed;
+  int r;
+
+  worker = data;
+  arextract = worker->reader.arextract;
+  priv = arextract->priv;
+
+  r = libarchive_create_read_object (FALSE, &(worker->reader), &a);
+  if (r != ARCHIVE_OK) {
+    if (worker->error == NULL)
+      worker->error = autoar_common_g_error_new_a (a, priv->source);
+  } else {
+    claimed = g_atomic_int_add (&(priv->parallel_next), 1);
+    for (ordinal = 0; (guint)ordinal < priv->entries_end; ordinal++) {
+      if (g_atomic_int_get (&(priv->parallel_failed)) ||
+          g_cancellable_is_cancelled (priv->cancellable))
+        break;
+
+      r = archive_read_next_header (a, &entry);
+      if (r != ARCHIVE_OK) {
+        if (r != ARCHIVE_EOF && worker->error == NULL)
+          worker->error = autoar_common_g_error_new_a (a, priv->source);
+        break;
+      }
 
-  priv->source_buffer = NULL;
-  priv->source_buffer_size = 0;
+      if (ordinal < claimed)
+        continue;
+      claimed = g_atomic_int_add (&(priv->parallel_next), 1);
+
+      if (autoar_extract_do_is_bad (arextract, ordinal, archive_entry_pathname (entry)))
+        continue;
+
+      extracted_filename = autoar_extract_do_get_dest (arextract, entry, &hardlink_filename);
+      if (extracted_filename == NULL)
+        continue;
+
+      /* Only the first entry seen for a path is written by a worker. Other
+       * entries with the same path are written later in archive order, or
+       * dropped if a later entry has already been written over them. Hard
+       * links can only be created after their targets exist. */
+      g_mutex_lock (&(priv->mutex));
+      if (g_hash_table_lookup_extended (priv->parallel_paths, extracted_filename,
+                                        NULL, &owner)) {
+        replaced = GPOINTER_TO_INT (owner) > ordinal;
+        deferred = !replaced;
+      } else {
+        replaced = FALSE;
+        deferred = hardlink_filename != NULL;
+        g_hash_table_insert (priv->parallel_paths, g_object_ref (extracted_filename),
+                             GINT_TO_POINTER (deferred ? -1 : ordinal));
+      }
+      if (deferred)
+        g_array_append_val (priv->parallel_deferred, ordinal);
+      g_mutex_unlock (&(priv->mutex));
 
-  priv->cancellable = NULL;
+      if (deferred || replaced) {
+        g_object_unref (extracted_filename);
+        if (hardlink_filename != NULL)
+          g_object_unref (hardlink_filename);
+        if (replaced)
+          autoar_extract_do_progress (arextract, 0, 1);
+        continue;
+      }
 
-  priv->size = 0;
-  priv->completed_size = 0;
+      g_debug ("autoar_extract_do_parallel_worker: %d: pathname = %s",
+               ordinal, archive_entry_pathname (entry));
+      autoar_extract_do_write_entry (arextract, a, NULL, entry,
+                                     extracted_filename, NULL,
+                                     &(worker->error));
+      g_object_unref (extracted_filename);
+      if (worker->error != NULL)
+        break;
 
-  priv->files = 0;
-  priv->completed_files = 0;
+      autoar_extract_do_progress (arextract, 0, 1);
+    }
+  }
 
-  priv->notify_last = 0;
+  if (worker->error != NULL)
+    g_atomic_int_set (&(priv->parallel_failed), TRUE);
 
-  priv->istream = NULL;
-  priv->buffer_size = BUFFER_SIZE;
-  priv->buffer = g_new (char, priv->buffer_size);
-  priv->error = NULL;
+  archive_read_free (a);
 
-  priv->userhash = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
-  priv->grouphash = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
-  priv->bad_filename = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
-  priv->pattern_compiled = g_ptr_array_new_with_free_func (g_pattern_spec_free_safe);
-  priv->extracted_dir_list = g_array_new (FALSE, FALSE, sizeof (GFileAndInfo));
-  g_array_set_clear_func (priv->extracted_dir_list, g_file_and_info_free);
-  priv->top_level_dir = NULL;
+  g_mutex_lock (&(priv->mutex));
+  priv->parallel_running--;
+  g_cond_signal (&(priv->cond));
+  g_mutex_unlock (&(priv->mutex));
 
-  priv->pathname_prefix_len = 0;
-  priv->pathname_basename = NULL;
-  priv->suggested_destname = NULL;
+  return NULL;
+}
 
-  priv->in_thread = FALSE;
-  priv->use_raw_format = FALSE;
-  priv->has_top_level_dir = TRUE;
-  priv->has_only_one_file = TRUE;
+static gint
+autoar_extract_do_compare_ordinal (gconstpointer a,
+                                   gconstpointer b)
+{
+  return *(const int*)a - *(const int*)b;
 }
 
-static AutoarExtract*
-autoar_extract_new_full (const char *source,
-                         GFile *source_file,
-                         const char *output,
-                         GFile *output_file,
-                         gboolean source_is_mem,
-                         AutoarPref *arpref,
-                         const void *buffer,
-                         gsize buffer_size,
-                         const char *suggested_destname)
+static void
+autoar_extract_do_extract_parallel (AutoarExtract *arextract,
+                                    guint n_workers)
 {
-  AutoarExtract *arextract;
-  char *gen_source, *gen_output;
-  GFile *gen_source_file, *gen_output_file;
+  AutoarExtractPrivate *priv;
+  AutoarExtractWorker *workers;
+  struct archive *a;
+  struct archive_entry *entry;
+  guint i;
+  int ordinal;
+  int r;
 
-  gen_source      = NULL;
-  gen_source_file = NULL;
-  gen_output      = NULL;
-  gen_output_file = NULL;
+  priv = arextract->priv;
 
-  if (source_is_mem) {
-    gen_source = g_strdup_printf ("(memory %p, size %" G_GSIZE_FORMAT ")", buffer, buffer_size);
-    gen_source_file = g_file_new_for_commandline_arg (gen_source);
-  } else {
-    if (source == NULL)
-      gen_source = autoar_common_g_file_get_name (source_file);
-    if (source_file == NULL)
-      gen_source_file = g_file_new_for_commandline_arg (source);
+  g_debug ("autoar_extract_do_extract_parallel: %u workers", n_workers);
+
+  priv->parallel_next = 0;
+  priv->parallel_failed = FALSE;
+  priv->parallel_running = n_workers;
+  priv->parallel_deferred = g_array_new (FALSE, FALSE, sizeof (int));
+  priv->parallel_paths = g_hash_table_new_full (g_file_hash, (GEqualFunc)g_file_equal,
+                                                g_object_unref, NULL);
+  priv->in_parallel = TRUE;
+
+  workers = g_new0 (AutoarExtractWorker, n_workers);
+  for (i = 0; i < n_workers; i++) {
+    workers[i].reader.arextract = arextract;
+    workers[i].reader.buffer_size = BUFFER_SIZE;
+    workers[i].reader.buffer = g_new (char, workers[i].reader.buffer_size);
+    workers[i].reader.error = &(workers[i].error);
+    workers[i].reader.fd = -1;
+    workers[i].thread = g_thread_new ("autoar-extract",
+                                      autoar_extract_do_parallel_worker,
+                                      workers + i);
   }
 
-  if (output == NULL)
-    gen_output = autoar_common_g_file_get_name (output_file);
-  if (output_file == NULL)
-    gen_output_file = g_file_new_for_commandline_arg (output);
-
-  arextract =
-    g_object_new (AUTOAR_TYPE_EXTRACT,
-                  "source",         source      != NULL ? source      : gen_source,
-                  "source-file",    source_file != NULL ? source_file : gen_source_file,
-                  "output",         output      != NULL ? output      : gen_output,
-                  "output-file",    output_file != NULL ? output_file : gen_output_file,
-                  "source-is-mem",  source_is_mem, NULL);
-  arextract->priv->arpref = g_object_ref (arpref);
+  /* Report progress until all workers stop */
+  g_mutex_lock (&(priv->mutex));
+  while (priv->parallel_running > 0) {
+    g_cond_wait_until (&(priv->cond), &(priv->mutex),
+                       g_get_monotonic_time () +
+                       MAX (priv->notify_interval, G_TIME_SPAN_MILLISECOND));
+    g_mutex_unlock (&(priv->mutex));
+    autoar_extract_signal_progress (arextract);
+    g_mutex_lock (&(priv->mutex));
+  }
+  g_mutex_unlock (&(priv->mutex));
 
-  if (source_is_mem) {
-    arextract->priv->source_buffer = buffer;
-    arextract->priv->source_buffer_size = buffer_size;
-    if (suggested_destname != NULL)
-      arextract->priv->suggested_destname =
-        autoar_common_get_basename_remove_extension (suggested_destname);
-    else
-      arextract->priv->suggested_destname =
-        autoar_common_get_basename_remove_extension (gen_source);
-  } else {
-    char *source_basename = g_file_get_basename (arextract->priv->source_file);
-    arextract->priv->suggested_destname =
-      autoar_common_get_basename_remove_extension (source_basename);
-    g_free (source_basename);
+  for (i = 0; i < n_workers; i++) {
+    g_thread_join (workers[i].thread);
+    g_free (workers[i].reader.buffer);
+    if (workers[i].error != NULL) {
+      if (priv->error == NULL)
+        priv->error = workers[i].error;
+      else
+        g_error_free (workers[i].error);
+    }
   }
+  g_free (workers);
 
-  g_free (gen_source);
-  g_free (gen_output);
+  g_hash_table_unref (priv->parallel_paths);
+  priv->parallel_paths = NULL;
+  priv->in_parallel = FALSE;
 
-  if (gen_source_file != NULL)
-    g_object_unref (gen_source_file);
-  if (gen_output_file != NULL)
-    g_object_unref (gen_output_file);
+  if (priv->error != NULL || priv->parallel_deferred->len == 0 ||
+      g_cancellable_is_cancelled (priv->cancellable))
+    return;
 
-  return arextract;
-}
+  /* Create hard links and entries sharing a path in one more serial pass */
+  g_array_sort (priv->parallel_deferred, autoar_extract_do_compare_ordinal);
 
+  r = libarchive_create_read_object (FALSE, &(priv->reader), &a);
+  if (r != ARCHIVE_OK) {
+    if (priv->error == NULL) {
+      priv->error = autoar_common_g_error_new_a (a, priv->source);
+    }
+    archive_read_free (a);
+    return;
+  }
 
-/**
- * autoar_extract_new:
- * @source: source archive
- * @output: output directory of extracted file or directory, or the file name
- * of the extracted file or directory itself if you set
- * #AutoarExtract:output-is-dest on the returned object
- * @arpref: an #AutoarPref object
- *
- * Extract a new #AutoarExtract object.
- *
- * Returns: (transfer full): a new #AutoarExtract object
- **/
-AutoarExtract*
-autoar_extract_new (const char *source,
-                    const char *output,
-                    AutoarPref *arpref)
-{
-  g_return_val_if_fail (source != NULL, NULL);
-  g_return_val_if_fail (output != NULL, NULL);
+  for (i = 0, ordinal = 0; i < priv->parallel_deferred->len; ordinal++) {
+    if (g_cancellable_is_cancelled (priv->cancellable))
+      break;
 
-  return autoar_extract_new_full (source, NULL, output, NULL,
-                                  FALSE, arpref,
-                                  NULL, 0, NULL);
-}
+    r = archive_read_next_header (a, &entry);
+    if (r != ARCHIVE_OK) {
+      if (priv->error == NULL) {
+        priv->error = autoar_common_g_error_new_a (a, priv->source);
+      }
+      break;
+    }
 
-/**
- * autoar_extract_new_file:
- * @source_file: source archive
- * @output_file: output directory of extracted file or directory, or the
- * file name of the extracted file or directory itself if you set
- * #AutoarExtract:output-is-dest on the returned object
- * @arpref: an #AutoarPref object
- *
- * Create a new #AutoarExtract object.
- *
- * Returns: (transfer full): a new #AutoarExtract object
- **/
-AutoarExtract*
-autoar_extract_new_file (GFile *source_file,
-                         GFile *output_file,
-                         AutoarPref *arpref)
-{
-  g_return_val_if_fail (source_file != NULL, NULL);
-  g_return_val_if_fail (output_file != NULL, NULL);
+    if (ordinal != g_array_index (priv->parallel_deferred, int, i))
+      continue;
+    i++;
 
-  return autoar_extract_new_full (NULL, source_file, NULL, output_file,
-                                  FALSE, arpref,
-                                  NULL, 0, NULL);
+    autoar_extract_do_extract_entry (arextract, a, entry, &(priv->error));
+    if (priv->error != NULL)
+      break;
+  }
+
+  archive_read_free (a);
 }
 
-/**
- * autoar_extract_new_memory:
- * @buffer: memory buffer holding the source archive
- * @buffer_size: the size of the source archive memory buffer
- * @source_name: the name of the source archive
- * @output: output directory of extracted file or directory, or the file name
- * of the extracted file or directory itself if you set
- * #AutoarExtract:output-is-dest on the returned object
- * @arpref: an #AutoarPref object
- *
- * Create a new #AutoarExtract object. @source_name does not need to be a full
- * path. The file which it represents does not need to exist, either. This
- * argument is only used to decide the name of the extracted file or directory,
- * and it is useless if you set #AutoarExtract:output-is-dest to %TRUE.
- *
- * Returns: (transfer full): a new #AutoarExtract object
- **/
-AutoarExtract*
-autoar_extract_new_memory (const void *buffer,
-                           gsize buffer_size,
-                           const char *source_name,
-                           const char *output,
-                           AutoarPref *arpref)
+static gpointer
+autoar_extract_do_pipeline_writer (gpointer data)
 {
+  AutoarExtract *arextract;
+  AutoarExtractPipeline *pipeline;
+  AutoarExtractBlock *block;
+  struct archive_entry *entry;
 
-  g_return_val_if_fail (output != NULL, NULL);
-  g_return_val_if_fail (buffer != NULL, NULL);
+  arextract = data;
+  pipeline = arextract->priv->pipeline;
 
-  return autoar_extract_new_full (NULL, NULL, output, NULL,
-                                  TRUE, arpref,
-                                  buffer, buffer_size, source_name);
-}
+  for (;;) {
+    if (pipeline->holding) {
+      pipeline->holding = FALSE;
+      autoar_extract_pipeline_release (pipeline);
+    }
 
-/**
- * autoar_extract_new_memory_file:
- * @buffer: memory buffer holding the source archive
- * @buffer_size: the size of the source archive memory buffer
- * @source_name: the name of the source archive
- * @output_file: output directory of extracted file or directory, or the file
- * name of the extracted file or directory itself if you set
- * #AutoarExtract:output-is-dest on the returned object
- * @arpref: an #AutoarPref object
- *
- * Create a new #AutoarExtract object. This function is similar to
- * autoar_extract_new_memory() except for the argument for the output
- * directory is #GFile.
- *
- * Returns: (transfer full): a new #AutoarExtract object
- **/
-AutoarExtract*
-autoar_extract_new_memory_file (const void *buffer,
-                                gsize buffer_size,
-                                const char *source_name,
-                                GFile *output_file,
-                                AutoarPref *arpref)
-{
-  g_return_val_if_fail (output_file != NULL, NULL);
-  g_return_val_if_fail (buffer != NULL, NULL);
+    block = autoar_extract_pipeline_peek (pipeline);
+    if (block == NULL)
+      break;
 
-  return autoar_extract_new_full (NULL, NULL, NULL, output_file,
-                                  TRUE, arpref,
-                                  buffer, buffer_size, source_name);
+    switch (block->type) {
+      case AUTOAR_EXTRACT_BLOCK_ENTRY:
+        entry = block->entry;
+        block->entry = NULL;
+        autoar_extract_pipeline_release (pipeline);
+        autoar_extract_do_extract_entry (arextract, NULL, entry, &(pipeline->error));
+        archive_entry_free (entry);
+        if (pipeline->error != NULL) {
+          autoar_extract_pipeline_abort (pipeline);
+          return NULL;
+        }
+        break;
+      case AUTOAR_EXTRACT_BLOCK_FINISH:
+        autoar_extract_pipeline_release (pipeline);
+        return NULL;
+      default:
+        /* Data which are not used by the previous entry */
+        autoar_extract_pipeline_release (pipeline);
+        break;
+    }
+  }
+
+  return NULL;
 }
 
 static void
-autoar_extract_step_initialize_pattern (AutoarExtract *arextract) {
-  /* Step 0: Compile the file name pattern. */
+autoar_extract_do_extract_pipeline (AutoarExtract *arextract,
+                                    struct archive *a)
+{
+  /* Decode entries in this thread and write them in another thread */
 
-  AutoarExtractPrivate *priv = arextract->priv;
-  const char **pattern = autoar_pref_get_pattern_to_ignore (priv->arpref);
-  int i;
+  AutoarExtractPrivate *priv;
+  AutoarExtractPipeline *pipeline;
+  AutoarExtractBlock *block;
+  struct archive_entry *entry;
+  int i, r;
+  guint ordinal;
 
-  g_debug ("autoar_extract_step_initialize_pattern: called");
+  priv = arextract->priv;
+  pipeline = g_new0 (AutoarExtractPipeline, 1);
+  g_mutex_init (&(pipeline->mutex));
+  g_cond_init (&(pipeline->cond));
+
+  priv->pipeline = pipeline;
+  priv->in_parallel = TRUE;
+  pipeline->thread = g_thread_new ("autoar-extract-writer",
+                                   autoar_extract_do_pipeline_writer,
+                                   arextract);
+
+  /* Reading stops after the last entry found by the scan */
+  r = ARCHIVE_EOF;
+  for (ordinal = 0;
+       ordinal < priv->entries_end &&
+       (r = archive_read_next_header (a, &entry)) == ARCHIVE_OK;
+       ordinal++) {
+    const void *buffer;
+    size_t size;
+    gint64 offset, source_offset;
+    int rd;
+
+    if (g_cancellable_is_cancelled (priv->cancellable))
+      break;
+
+    if (autoar_extract_do_is_bad (arextract, ordinal, archive_entry_pathname (entry)))
+      continue;
+
+    if ((block = autoar_extract_pipeline_reserve (pipeline)) == NULL)
+      break;
+    block->type = AUTOAR_EXTRACT_BLOCK_ENTRY;
+    block->entry = archive_entry_clone (entry);
+    autoar_extract_pipeline_commit (pipeline);
+
+    /* Errors of data are ignored as autoar_extract_do_write_entry does */
+    offset = -1;
+    rd = ARCHIVE_OK;
+    if ((source_offset = autoar_extract_do_get_source_offset (arextract, a, entry)) >= 0) {
+      /* The writing thread copies the data from the source file, and
+       * libarchive skips them when reading the next header. */
+      if ((block = autoar_extract_pipeline_reserve (pipeline)) == NULL)
+        break;
+      block->type = AUTOAR_EXTRACT_BLOCK_COPY;
+      block->size = archive_entry_size (entry);
+      block->offset = 0;
+      block->source_offset = source_offset;
+      autoar_extract_pipeline_commit (pipeline);
+    } else {
+      while ((rd = archive_read_data_block (a, &buffer, &size, &offset)) == ARCHIVE_OK) {
+        if (buffer == NULL)
+          continue;
+        if ((block = autoar_extract_pipeline_reserve (pipeline)) == NULL)
+          break;
+        if (block->buffer_size < size) {
+          block->buffer_size = MAX (size, BUFFER_SIZE);
+          block->buffer = g_realloc (block->buffer, block->buffer_size);
+        }
+        memcpy (block->buffer, buffer, size);
+        block->type = AUTOAR_EXTRACT_BLOCK_DATA;
+        block->size = size;
+        block->offset = offset;
+        autoar_extract_pipeline_commit (pipeline);
+        autoar_extract_signal_progress (arextract);
+      }
+    }
+
+    if ((block = autoar_extract_pipeline_reserve (pipeline)) == NULL)
+      break;
+    block->type = AUTOAR_EXTRACT_BLOCK_END;
+    /* The size of a sparse file is reported with the end of data */
+    block->offset = rd == ARCHIVE_EOF ? offset : -1;
+    autoar_extract_pipeline_commit (pipeline);
+    autoar_extract_signal_progress (arextract);
+  }
+
+  /* All needed entries are queued if the loop reaches the end of them */
+  if (r == ARCHIVE_OK && ordinal == priv->entries_end)
+    r = ARCHIVE_EOF;
+
+  if (r != ARCHIVE_OK && r != ARCHIVE_EOF && priv->error == NULL)
+    priv->error = autoar_common_g_error_new_a (a, priv->source);
+
+  if (r == ARCHIVE_EOF &&
+      (block = autoar_extract_pipeline_reserve (pipeline)) != NULL) {
+    block->type = AUTOAR_EXTRACT_BLOCK_FINISH;
+    autoar_extract_pipeline_commit (pipeline);
+  } else {
+    autoar_extract_pipeline_abort (pipeline);
+  }
+
+  g_thread_join (pipeline->thread);
+  priv->in_parallel = FALSE;
+  priv->pipeline = NULL;
+
+  if (pipeline->error != NULL) {
+    if (priv->error == NULL)
+      priv->error = pipeline->error;
+    else
+      g_error_free (pipeline->error);
+  }
 
-  if (pattern != NULL) {
-    for (i = 0; pattern[i] != NULL; i++)
-      g_ptr_array_add (priv->pattern_compiled, g_pattern_spec_new (pattern[i]));
+  for (i = 0; i < PIPELINE_SIZE; i++) {
+    if (pipeline->blocks[i].entry != NULL)
+      archive_entry_free (pipeline->blocks[i].entry);
+    g_free (pipeline->blocks[i].buffer);
   }
-  g_ptr_array_add (priv->pattern_compiled, NULL);
+  g_mutex_clear (&(pipeline->mutex));
+  g_cond_clear (&(pipeline->cond));
+  g_free (pipeline);
 }
 
 static void
-autoar_extract_step_scan_toplevel (AutoarExtract *arextract)
+autoar_extract_do_pool_write (gpointer data,
+                              gpointer user_data)
 {
-  /* Step 1: Scan all file names in the archive
-   * We have to check whether the archive contains a top-level directory
-   * before performing the extraction. We emit the "scanned" signal when
-   * the checking is completed. */
-
-  struct archive *a;
-  struct archive_entry *entry;
-
-  char *pathname_prefix;
-
+  AutoarExtractBlock *block;
+  AutoarExtract *arextract;
   AutoarExtractPrivate *priv;
-  int r;
+  AutoarExtractPool *pool;
+  GError *error;
 
+  block = data;
+  arextract = user_data;
   priv = arextract->priv;
-
-  g_debug ("autoar_extract_step_scan_toplevel: called");
-
-  r = libarchive_create_read_object (FALSE, arextract, &a);
-  if (r != ARCHIVE_OK) {
-    archive_read_free (a);
-    r = libarchive_create_read_object (TRUE, arextract, &a);
-    if (r != ARCHIVE_OK) {
-      if (priv->error == NULL)
-        priv->error = autoar_common_g_error_new_a (a, priv->source);
-      return;
-    } else if (archive_filter_count (a) <= 1){
-      /* If we only use raw format and filter count is one, libarchive will
-       * not do anything except for just copying the source file. We do not
-       * want this thing to happen because it does unnecesssary copying. */
-      if (priv->error == NULL)
-        priv->error = g_error_new (AUTOAR_EXTRACT_ERROR, NOT_AN_ARCHIVE_ERRNO,
-                                   "\'%s\': %s", priv->source, "not an archive");
-      return;
-    }
-    priv->use_raw_format = TRUE;
+  pool = priv->pool;
+  error = NULL;
+
+  if (!g_atomic_int_get (&(pool->failed)) &&
+      !g_cancellable_is_cancelled (priv->cancellable)) {
+    autoar_extract_do_write_entry (arextract, NULL, block, block->entry,
+                                   block->dest, NULL, &error);
+    if (error == NULL)
+      autoar_extract_do_progress (arextract, 0, 1);
   }
 
-  pathname_prefix = NULL;
+  archive_entry_free (block->entry);
+  block->entry = NULL;
 
-  while ((r = archive_read_next_header (a, &entry)) == ARCHIVE_OK) {
-    const char *pathname;
+  g_mutex_lock (&(priv->mutex));
+  if (error != NULL) {
+    if (pool->error == NULL)
+      pool->error = error;
+    else
+      g_error_free (error);
+    g_atomic_int_set (&(pool->failed), TRUE);
+  }
+  g_hash_table_remove (pool->paths, block->dest);
+  g_clear_object (&(block->dest));
+  pool->free_blocks = g_slist_prepend (pool->free_blocks, block);
+  pool->pending--;
+  g_cond_broadcast (&(priv->cond));
+  g_mutex_unlock (&(priv->mutex));
+}
 
-    if (g_cancellable_is_cancelled (priv->cancellable)) {
-      g_free (pathname_prefix);
-      archive_read_free (a);
-      return;
-    }
+static void
+autoar_extract_do_pool_drain (AutoarExtract *arextract)
+{
+  AutoarExtractPrivate *priv;
 
-    pathname = archive_entry_pathname (entry);
-    g_debug ("autoar_extract_step_scan_toplevel: %d: pathname = %s", priv->files, pathname);
+  priv = arextract->priv;
 
-    if (!priv->use_raw_format && !autoar_extract_do_pattern_check (pathname, priv->pattern_compiled)) {
-      g_hash_table_insert (priv->bad_filename, g_strdup (pathname), GUINT_TO_POINTER (TRUE));
-      continue;
-    }
+  g_mutex_lock (&(priv->mutex));
+  while (priv->pool->pending > 0)
+    g_cond_wait (&(priv->cond), &(priv->mutex));
+  g_mutex_unlock (&(priv->mutex));
+}
 
-    g_debug ("autoar_extract_step_scan_toplevel: %d: pattern check passed", priv->files);
+static AutoarExtractBlock*
+autoar_extract_do_pool_get_block (AutoarExtract *arextract,
+                                  GFile *dest)
+{
+  /* Wait until there is room for one more file. A file which is still being
+   * written by a writer thread must not be written again concurrently. */
 
-    if (pathname_prefix == NULL) {
-      char *dir_sep_location;
-      size_t skip_len, prefix_len;
+  AutoarExtractPrivate *priv;
+  AutoarExtractPool *pool;
+  AutoarExtractBlock *block;
 
-      skip_len = strspn (pathname, "./");
-      dir_sep_location = strchr (pathname + skip_len, '/');
-      if (dir_sep_location == NULL) {
-        prefix_len = strlen (pathname);
-      } else {
-        prefix_len = dir_sep_location - pathname;
-      }
-      pathname_prefix = g_strndup (pathname, prefix_len);
-      g_debug ("autoar_extract_step_scan_toplevel: pathname_prefix = %s", pathname_prefix);
+  priv = arextract->priv;
+  pool = priv->pool;
 
-      priv->pathname_prefix_len = prefix_len;
-      priv->pathname_basename = g_path_get_basename (pathname);
-    } else {
-      priv->has_only_one_file = FALSE;
-      if (!g_str_has_prefix (pathname, pathname_prefix)) {
-        priv->has_top_level_dir = FALSE;
-      }
-    }
-    priv->files++;
-    priv->size += archive_entry_size (entry);
-    archive_read_data_skip (a);
-  }
+  g_mutex_lock (&(priv->mutex));
+  while (pool->pending >= pool->max_pending ||
+         g_hash_table_contains (pool->paths, dest))
+    g_cond_wait (&(priv->cond), &(priv->mutex));
 
-  if (r != ARCHIVE_EOF) {
-    if (priv->error == NULL) {
-      priv->error = autoar_common_g_error_new_a (a, priv->source);
-    }
-    g_free (pathname_prefix);
-    archive_read_free (a);
-    return;
+  if (pool->free_blocks != NULL) {
+    block = pool->free_blocks->data;
+    pool->free_blocks = g_slist_delete_link (pool->free_blocks, pool->free_blocks);
+  } else {
+    block = g_new0 (AutoarExtractBlock, 1);
   }
+  g_mutex_unlock (&(priv->mutex));
 
-  /* If we are unable to determine the total size, set it to a positive
-   * number to prevent strange percentage. */
-  if (priv->size <= 0)
-    priv->size = G_MAXUINT64;
-
-  g_free (pathname_prefix);
-  archive_read_free (a);
-
-  g_debug ("autoar_extract_step_scan_toplevel: has_top_level_dir = %s",
-           priv->has_top_level_dir ? "TRUE" : "FALSE");
-  g_debug ("autoar_extract_step_scan_toplevel: has_only_one_file = %s",
-           priv->has_only_one_file ? "TRUE" : "FALSE");
-  autoar_extract_signal_scanned (arextract);
+  return block;
 }
 
 static void
-autoar_extract_step_decide_dest (AutoarExtract *arextract) {
-  /* Step 2: Create necessary directories
-   * If the archive contains only one file, we don't create the directory */
+autoar_extract_do_pool_free_block (gpointer data)
+{
+  AutoarExtractBlock *block = data;
+  g_free (block->buffer);
+  g_free (block);
+}
 
-  const char *pathname_extension;
+static void
+autoar_extract_do_extract_pool (AutoarExtract *arextract,
+                                struct archive *a,
+                                guint n_threads)
+{
+  /* Small regular files are read into memory in this thread and written by
+   * the writer threads. Other entries are written in this thread. Entries
+   * which depend on other files wait until all writer threads are idle. */
 
   AutoarExtractPrivate *priv;
-  int i;
+  AutoarExtractPool *pool;
+  struct archive_entry *entry;
+  int r;
+  guint ordinal;
 
   priv = arextract->priv;
 
-  g_debug ("autoar_extract_step_decide_dest: called");
+  g_debug ("autoar_extract_do_extract_pool: %u threads", n_threads);
+
+  pool = g_new0 (AutoarExtractPool, 1);
+  pool->paths = g_hash_table_new_full (g_file_hash, (GEqualFunc)g_file_equal,
+                                       g_object_unref, NULL);
+  pool->max_pending = n_threads * 4;
+  priv->pool = pool;
+  priv->in_parallel = TRUE;
+  pool->threads = g_thread_pool_new (autoar_extract_do_pool_write, arextract,
+                                     n_threads, TRUE, NULL);
+
+  r = ARCHIVE_EOF;
+  for (ordinal = 0;
+       ordinal < priv->entries_end &&
+       (r = archive_read_next_header (a, &entry)) == ARCHIVE_OK;
+       ordinal++) {
+    GFile *extracted_filename;
+    GFile *hardlink_filename;
+    gboolean in_progress;
+    gint64 entry_size;
 
-  {
-    pathname_extension = autoar_common_get_filename_extension (priv->pathname_basename);
-    if (priv->has_only_one_file && (pathname_extension != priv->pathname_basename)) {
-      /* If we only have one file, we have to add the file extension.
-       * Although we use the variable `top_level_dir', it may be a regular
-       * file, so the extension is important. */
-      char *new_filename = g_strconcat (priv->suggested_destname, pathname_extension, NULL);
-      priv->top_level_dir = g_file_get_child (priv->output_file, new_filename);
-      g_free (new_filename);
-    } else {
-      priv->top_level_dir = g_file_get_child (priv->output_file, priv->suggested_destname);
-      pathname_extension = "";
-    }
-  }
+    if (g_cancellable_is_cancelled (priv->cancellable) ||
+        g_atomic_int_get (&(pool->failed)))
+      break;
 
-  {
-    char *top_level_dir_basename_modified = NULL;
-    for (i = 1; g_file_query_exists (priv->top_level_dir, priv->cancellable); i++) {
-      g_free (top_level_dir_basename_modified);
-      g_object_unref (priv->top_level_dir);
+    if (autoar_extract_do_is_bad (arextract, ordinal, archive_entry_pathname (entry)))
+      continue;
 
-      if (g_cancellable_is_cancelled (priv->cancellable))
-        return;
+    extracted_filename = autoar_extract_do_get_dest (arextract, entry, &hardlink_filename);
+    if (extracted_filename == NULL)
+      continue;
 
-      if (priv->has_only_one_file) {
-        top_level_dir_basename_modified = g_strdup_printf ("%s(%d)%s",
-                                                           priv->suggested_destname,
-                                                           i,
-                                                           pathname_extension);
-      } else {
-        top_level_dir_basename_modified = g_strdup_printf ("%s(%d)",
-                                                           priv->suggested_destname,
-                                                           i);
+    entry_size = archive_entry_size (entry);
+    if (archive_entry_filetype (entry) == AE_IFREG && hardlink_filename == NULL &&
+        !(priv->use_raw_format) && archive_entry_size_is_set (entry) &&
+        entry_size >= 0 && entry_size <= priv->small_file_size) {
+      AutoarExtractBlock *block;
+      const void *buffer;
+      size_t size;
+      gint64 offset;
+
+      block = autoar_extract_do_pool_get_block (arextract, extracted_filename);
+      if (block->buffer_size < entry_size) {
+        block->buffer_size = entry_size;
+        block->buffer = g_realloc (block->buffer, block->buffer_size);
       }
-      priv->top_level_dir = g_file_get_child (priv->output_file,
-                                              top_level_dir_basename_modified);
+      if (entry_size > 0)
+        memset (block->buffer, 0, entry_size);
+
+      /* Data beyond the size in the header are dropped */
+      while (archive_read_data_block (a, &buffer, &size, &offset) == ARCHIVE_OK) {
+        if (buffer == NULL || offset >= entry_size)
+          continue;
+        memcpy ((char*)(block->buffer) + offset, buffer, MIN (size, entry_size - offset));
+      }
+
+      block->type = AUTOAR_EXTRACT_BLOCK_DATA;
+      block->entry = archive_entry_clone (entry);
+      block->dest = extracted_filename;
+      block->size = entry_size;
+      block->offset = 0;
+
+      g_mutex_lock (&(priv->mutex));
+      g_hash_table_add (pool->paths, g_object_ref (extracted_filename));
+      pool->pending++;
+      g_mutex_unlock (&(priv->mutex));
+
+      g_thread_pool_push (pool->threads, block, NULL);
+      autoar_extract_signal_progress (arextract);
+      continue;
     }
-    g_free (top_level_dir_basename_modified);
+
+    /* Hard links and symbolic links may refer to files which are still
+     * being written, and the same file may be written more than once. */
+    g_mutex_lock (&(priv->mutex));
+    in_progress = g_hash_table_contains (pool->paths, extracted_filename);
+    g_mutex_unlock (&(priv->mutex));
+    if (in_progress || hardlink_filename != NULL ||
+        archive_entry_filetype (entry) == AE_IFLNK)
+      autoar_extract_do_pool_drain (arextract);
+
+    autoar_extract_do_write_entry (arextract, a, NULL, entry,
+                                   extracted_filename, hardlink_filename,
+                                   &(priv->error));
+
+    g_object_unref (extracted_filename);
+    if (hardlink_filename != NULL)
+      g_object_unref (hardlink_filename);
+
+    if (priv->error != NULL)
+      break;
+
+    autoar_extract_do_progress (arextract, 0, 1);
+    autoar_extract_signal_progress (arextract);
   }
 
-  if (!(priv->has_only_one_file))
-    g_file_make_directory_with_parents (priv->top_level_dir, priv->cancellable, &(priv->error));
+  if (r != ARCHIVE_OK && r != ARCHIVE_EOF && priv->error == NULL)
+    priv->error = autoar_common_g_error_new_a (a, priv->source);
 
-  if (priv->error != NULL)
-    return;
+  g_thread_pool_free (pool->threads, FALSE, TRUE);
+  priv->in_parallel = FALSE;
+  priv->pool = NULL;
 
-  autoar_extract_signal_decide_dest (arextract);
-}
+  if (pool->error != NULL) {
+    if (priv->error == NULL)
+      priv->error = pool->error;
+    else
+      g_error_free (pool->error);
+  }
 
-static void
-autoar_extract_step_decide_dest_already (AutoarExtract *arextract) {
-  /* Alternative step 2: Output is destination */
-  arextract->priv->top_level_dir = g_object_ref (arextract->priv->output_file);
-  autoar_extract_signal_decide_dest (arextract);
+  g_slist_free_full (pool->free_blocks, autoar_extract_do_pool_free_block);
+  g_hash_table_unref (pool->paths);
+  g_free (pool);
 }
 
 static void
@@ -1897,16 +6001,22 @@ autoar_extract_step_extract (AutoarExtract *arextract) {
    * We have to re-open the archive to extract files */
 
   struct archive *a;
-  struct archive_entry *entry;
 
   AutoarExtractPrivate *priv;
+  guint n_workers;
   int r;
 
   priv = arextract->priv;
 
   g_debug ("autoar_extract_step_extract: called");
 
-  r = libarchive_create_read_object (priv->use_raw_format, arextract, &a);
+  n_workers = autoar_extract_do_get_n_workers (arextract);
+  if (n_workers > 1) {
+    autoar_extract_do_extract_parallel (arextract, n_workers);
+    return;
+  }
+
+  r = libarchive_create_read_object (priv->use_raw_format, &(priv->reader), &a);
   if (r != ARCHIVE_OK) {
     if (priv->error == NULL) {
       priv->error = autoar_common_g_error_new_a (a, priv->source);
@@ -1915,68 +6025,48 @@ autoar_extract_step_extract (AutoarExtract *arextract) {
     return;
   }
 
-  while ((r = archive_read_next_header (a, &entry)) == ARCHIVE_OK) {
-    const char *pathname;
-    const char *hardlink;
-    GFile *extracted_filename;
-    GFile *hardlink_filename;
-
-    if (g_cancellable_is_cancelled (priv->cancellable)) {
-      archive_read_free (a);
-      return;
-    }
+  n_workers = autoar_extract_do_get_n_threads (arextract);
+  if (n_workers > 1 && priv->small_file_size > 0)
+    autoar_extract_do_extract_pool (arextract, a, n_workers);
+  else
+    autoar_extract_do_extract_pipeline (arextract, a);
 
-    pathname = archive_entry_pathname (entry);
-    hardlink = archive_entry_hardlink (entry);
-    hardlink_filename = NULL;
-    if (GPOINTER_TO_UINT (g_hash_table_lookup (priv->bad_filename, pathname)))
-      continue;
+  archive_read_free (a);
+}
 
-    if (!(priv->has_only_one_file)) {
-      if (priv->has_top_level_dir) {
-        extracted_filename =
-          autoar_extract_do_sanitize_pathname (pathname + priv->pathname_prefix_len,
-                                               NULL, priv->top_level_dir);
-        if (hardlink != NULL)
-          hardlink_filename =
-            autoar_extract_do_sanitize_pathname (hardlink + priv->pathname_prefix_len,
-                                                 NULL, priv->top_level_dir);
-      } else {
-        extracted_filename =
-          autoar_extract_do_sanitize_pathname (pathname, "./", priv->top_level_dir);
-        if (hardlink != NULL)
-          hardlink_filename =
-            autoar_extract_do_sanitize_pathname (pathname, "./", priv->top_level_dir);
-      }
-    } else {
-      extracted_filename = g_object_ref (priv->top_level_dir);
-    }
+static gboolean
+autoar_extract_do_apply_dir_meta_fd (AutoarExtract *arextract,
+                                     GFile *file,
+                                     const AutoarExtractMeta *meta)
+{
+  /* Apply the metadata of a directory through its cached file descriptor.
+   * Returns FALSE if the cache cannot be used. */
 
-    autoar_extract_do_write_entry (arextract, a, entry,
-                                   extracted_filename, hardlink_filename);
+#ifdef USE_NATIVE_BACKEND
+  AutoarExtractPrivate *priv;
+  char *path;
+  int fd;
 
-    g_object_unref (extracted_filename);
-    if (hardlink_filename != NULL)
-      g_object_unref (hardlink_filename);
+  priv = arextract->priv;
 
-    if (priv->error != NULL) {
-      archive_read_free (a);
-      return;
-    }
+  path = g_file_get_path (file);
+  if (path == NULL)
+    return FALSE;
 
-    priv->completed_files++;
-    autoar_extract_signal_progress (arextract);
-  }
+  g_mutex_lock (&(priv->mutex));
+  fd = autoar_extract_do_dir_cache_get_fd (arextract, path);
+  g_mutex_unlock (&(priv->mutex));
+  g_free (path);
+  if (fd < 0)
+    return FALSE;
 
-  if (r != ARCHIVE_EOF) {
-    if (priv->error == NULL) {
-      priv->error = autoar_common_g_error_new_a (a, priv->source);
-    }
-    archive_read_free (a);
-    return;
-  }
+  g_debug ("autoar_extract_do_apply_dir_meta_fd: %d", fd);
+  autoar_extract_do_apply_meta_fd (fd, meta);
 
-  archive_read_free (a);
+  return TRUE;
+#else
+  return FALSE;
+#endif
 }
 
 static void
@@ -1993,15 +6083,113 @@ autoar_extract_step_apply_dir_fileinfo (AutoarExtract *arextract) {
   g_debug ("autoar_extract_step_apply_dir_fileinfo: called");
 
   for (i = 0; i < priv->extracted_dir_list->len; i++) {
-    GFile *file = g_array_index (priv->extracted_dir_list, GFileAndInfo, i).file;
-    GFileInfo *info = g_array_index (priv->extracted_dir_list, GFileAndInfo, i).info;
-    g_file_set_attributes_from_info (file, info,
-                                     G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
-                                     priv->cancellable, NULL);
+    AutoarExtractDirMeta *dir_meta;
+
+    dir_meta = &g_array_index (priv->extracted_dir_list, AutoarExtractDirMeta, i);
+    if (!autoar_extract_do_apply_dir_meta_fd (arextract, dir_meta->file, &(dir_meta->meta))) {
+      GFileInfo *info = autoar_extract_do_meta_to_info (&(dir_meta->meta));
+      g_file_set_attributes_from_info (dir_meta->file, info,
+                                       G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                       priv->cancellable, NULL);
+      g_object_unref (info);
+    }
     if (g_cancellable_is_cancelled (priv->cancellable)) {
-      return;
+      break;
+    }
+  }
+
+  /* No more files are created in these directories */
+  autoar_extract_do_dir_cache_clear (arextract);
+  g_hash_table_remove_all (priv->dir_known);
+}
+
+static void
+autoar_extract_do_remap_dir_list (AutoarExtract *arextract,
+                                  GFile *staged)
+{
+  /* Directories moved from @staged get their metadata at their new
+   * locations. Others are removed with the staging directory. */
+
+  AutoarExtractPrivate *priv;
+  guint i;
+
+  priv = arextract->priv;
+
+  for (i = priv->extracted_dir_list->len; i > 0; i--) {
+    AutoarExtractDirMeta *dir_meta;
+    GFile *moved;
+    char *relative_path;
+
+    dir_meta = &g_array_index (priv->extracted_dir_list, AutoarExtractDirMeta, i - 1);
+    moved = NULL;
+    if (staged != NULL) {
+      if (g_file_equal (dir_meta->file, staged)) {
+        moved = g_object_ref (priv->top_level_dir);
+      } else if ((relative_path = g_file_get_relative_path (staged, dir_meta->file)) != NULL) {
+        moved = g_file_resolve_relative_path (priv->top_level_dir, relative_path);
+        g_free (relative_path);
+      }
+    }
+
+    if (moved == NULL) {
+      g_array_remove_index (priv->extracted_dir_list, i - 1);
+      continue;
     }
+
+    g_object_unref (dir_meta->file);
+    dir_meta->file = moved;
+  }
+}
+
+static void
+autoar_extract_step_move_staged (AutoarExtract *arextract) {
+  /* Alternative step 4: Move staged files to the destination
+   * The layout is decided now, so we can move the single file, the top-level
+   * directory, or the whole staging directory to the destination. Metadata
+   * of directories are applied after moving, so read-only directories from
+   * the archive do not prevent their children from being moved. */
+
+  AutoarExtractPrivate *priv;
+  GFile *staged;
+
+  priv = arextract->priv;
+
+  g_debug ("autoar_extract_step_move_staged: called");
+
+  /* Cached descriptors refer to directories in the staging directory */
+  autoar_extract_do_dir_cache_clear (arextract);
+  g_hash_table_remove_all (priv->dir_known);
+
+  if (priv->staged_first == NULL) {
+    staged = NULL;
+  } else if (priv->has_only_one_file) {
+    staged = g_object_ref (priv->staged_first);
+  } else if (priv->has_top_level_dir) {
+    const char *prefix_name;
+
+    prefix_name = priv->pathname_prefix + strspn (priv->pathname_prefix, "./");
+    for (; *prefix_name == '/'; prefix_name++);
+    if (*prefix_name == '\0')
+      staged = g_object_ref (priv->staging_dir);
+    else
+      staged = g_file_get_child (priv->staging_dir, prefix_name);
+  } else {
+    staged = g_object_ref (priv->staging_dir);
+  }
+
+  if (staged != NULL)
+    autoar_extract_do_move_merge (arextract, staged, priv->top_level_dir);
+
+  if (priv->error != NULL) {
+    g_clear_object (&staged);
+    return;
   }
+
+  autoar_extract_do_remap_dir_list (arextract, staged);
+  g_clear_object (&staged);
+
+  autoar_extract_do_remove_recursive (priv->staging_dir);
+  g_clear_object (&(priv->staging_dir));
 }
 
 static void
@@ -2016,14 +6204,18 @@ autoar_extract_step_cleanup (AutoarExtract *arextract) {
 
   g_debug ("autoar_extract_step_cleanup: called");
 
-  priv->completed_size = priv->size;
-  priv->completed_files = priv->files;
-  priv->notify_last = 0;
-  autoar_extract_signal_progress (arextract);
+  autoar_common_progress_set (&(priv->progress), priv->size, priv->files);
+  autoar_common_progress_notify (&(priv->progress), TRUE);
   g_debug ("autoar_extract_step_cleanup: Update progress");
-  if (autoar_pref_get_delete_if_succeed (priv->arpref) && priv->source_file != NULL) {
+  if (autoar_pref_get_delete_if_succeed (priv->arpref) && priv->source_file != NULL &&
+      priv->source_stream == NULL && !(priv->verify)) {
     g_debug ("autoar_extract_step_cleanup: Delete");
-    g_file_delete (priv->source_file, priv->cancellable, NULL);
+    if (g_file_delete (priv->source_file, priv->cancellable, NULL) &&
+        priv->use_scan_cache && !(priv->source_is_mem)) {
+      char *cache_path = autoar_extract_do_get_scan_cache_path (arextract);
+      g_unlink (cache_path);
+      g_free (cache_path);
+    }
   }
 }
 
@@ -2049,14 +6241,35 @@ autoar_extract_run (AutoarExtract *arextract)
     return;
   }
 
+  /* Changing the owner of files requires privileges */
+  priv->euid = geteuid ();
+  priv->can_chown = priv->euid == 0;
+
+  autoar_common_progress_start (&(priv->progress), priv->in_thread,
+                                priv->notify_interval);
+
   i = 0;
   steps[i++] = autoar_extract_step_initialize_pattern;
-  steps[i++] = autoar_extract_step_scan_toplevel;
-  steps[i++] = priv->output_is_dest ?
-               autoar_extract_step_decide_dest_already :
-               autoar_extract_step_decide_dest;
-  steps[i++] = autoar_extract_step_extract;
-  steps[i++] = autoar_extract_step_apply_dir_fileinfo;
+  if (priv->verify) {
+    steps[i++] = autoar_extract_step_verify;
+  } else if (priv->use_sink) {
+    steps[i++] = autoar_extract_step_extract_sink;
+  } else if (priv->single_pass || priv->source_stream != NULL) {
+    /* A stream can only be read once */
+    steps[i++] = autoar_extract_step_extract_staged;
+    steps[i++] = priv->output_is_dest ?
+                 autoar_extract_step_decide_dest_already :
+                 autoar_extract_step_decide_dest;
+    steps[i++] = autoar_extract_step_move_staged;
+    steps[i++] = autoar_extract_step_apply_dir_fileinfo;
+  } else {
+    steps[i++] = autoar_extract_step_scan_toplevel;
+    steps[i++] = priv->output_is_dest ?
+                 autoar_extract_step_decide_dest_already :
+                 autoar_extract_step_decide_dest;
+    steps[i++] = autoar_extract_step_extract;
+    steps[i++] = autoar_extract_step_apply_dir_fileinfo;
+  }
   steps[i++] = autoar_extract_step_cleanup;
   steps[i++] = NULL;
 
@@ -2064,16 +6277,26 @@ autoar_extract_run (AutoarExtract *arextract)
     g_debug ("autoar_extract_run: Step %d Begin", i);
     (*steps[i])(arextract);
     g_debug ("autoar_extract_run: Step %d End", i);
+    if (priv->error != NULL || g_cancellable_is_cancelled (priv->cancellable)) {
+      /* Do not leave the hidden staging directory in the output directory */
+      if (priv->staging_dir != NULL) {
+        autoar_extract_do_remove_recursive (priv->staging_dir);
+        g_clear_object (&(priv->staging_dir));
+      }
+    }
     if (priv->error != NULL) {
+      autoar_common_progress_stop (&(priv->progress));
       autoar_extract_signal_error (arextract);
       return;
     }
     if (g_cancellable_is_cancelled (priv->cancellable)) {
+      autoar_common_progress_stop (&(priv->progress));
       autoar_extract_signal_cancelled (arextract);
       return;
     }
   }
 
+  autoar_common_progress_stop (&(priv->progress));
   autoar_extract_signal_completed (arextract);
 }
 
@@ -2147,14 +6370,21 @@ autoar_extract_start_async (AutoarExtract *arextract,
  * autoar_extract_new_memory_file(). This functions should only be called
  * after the extracting job is completed. That is, you should only call this
  * function after you receives one of #AutoarExtract::cancelled,
- * #AutoarExtract::error, or #AutoarExtract::completed signal.
+ * #AutoarExtract::error, or #AutoarExtract::completed signal. If the source
+ * archive is provided in autoar_extract_new_bytes() or
+ * autoar_extract_new_bytes_file(), the reference to the #GBytes is dropped
+ * and @free_func is not called.
  **/
 void
 autoar_extract_free_source_buffer (AutoarExtract *arextract,
                                    GDestroyNotify free_func)
 {
-  if (arextract->priv->source_buffer != NULL)
+  if (arextract->priv->source_bytes != NULL) {
+    g_bytes_unref (arextract->priv->source_bytes);
+    arextract->priv->source_bytes = NULL;
+  } else if (arextract->priv->source_buffer != NULL) {
     (*free_func)((void*)(arextract->priv->source_buffer));
+  }
 
   arextract->priv->source_buffer = NULL;
   arextract->priv->source_buffer_size = 0;
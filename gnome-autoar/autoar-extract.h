@@ -29,6 +29,7 @@
 #include <glib-object.h>
 #include <gio/gio.h>
 
+#include "autoar-misc.h"
 #include "autoar-pref.h"
 
 G_BEGIN_DECLS
@@ -67,6 +68,43 @@ struct _AutoarExtractClass
 
 GQuark          autoar_extract_quark               (void);
 
+/**
+ * AutoarExtractSink:
+ * @begin_entry: (allow-none): called before the data of an entry are passed.
+ * Return %FALSE without setting the error to skip the data of the entry,
+ * in which case @end_entry is not called.
+ * @write_data: (allow-none): called with each block of data decoded from the
+ * entry. @data points to the buffer of libarchive and is only valid during
+ * the call. @offset is the position of @data in the entry, which is larger
+ * than the end of the previous block if there is a hole in a sparse file.
+ * @end_entry: (allow-none): called after all data of an entry are passed
+ *
+ * Callbacks receiving the entries of an archive instead of the file system.
+ * See autoar_extract_set_sink(). Returning %FALSE from @write_data or
+ * @end_entry, or setting the error in any of them, stops extracting and
+ * #AutoarExtract::error is emitted.
+ **/
+typedef struct _AutoarExtractSink AutoarExtractSink;
+
+struct _AutoarExtractSink
+{
+  gboolean (*begin_entry) (AutoarExtract *arextract,
+                           const AutoarEntryInfo *info,
+                           gpointer user_data,
+                           GError **error);
+  gboolean (*write_data)  (AutoarExtract *arextract,
+                           const AutoarEntryInfo *info,
+                           const void *data,
+                           gsize size,
+                           gint64 offset,
+                           gpointer user_data,
+                           GError **error);
+  gboolean (*end_entry)   (AutoarExtract *arextract,
+                           const AutoarEntryInfo *info,
+                           gpointer user_data,
+                           GError **error);
+};
+
 GType           autoar_extract_get_type            (void) G_GNUC_CONST;
 
 AutoarExtract  *autoar_extract_new                 (const char *source,
@@ -85,6 +123,22 @@ AutoarExtract  *autoar_extract_new_memory_file     (const void *buffer,
                                                     const char *source_name,
                                                     GFile *output_file,
                                                     AutoarPref *arpref);
+AutoarExtract  *autoar_extract_new_bytes           (GBytes *bytes,
+                                                    const char *source_name,
+                                                    const char *output,
+                                                    AutoarPref *arpref);
+AutoarExtract  *autoar_extract_new_bytes_file      (GBytes *bytes,
+                                                    const char *source_name,
+                                                    GFile *output_file,
+                                                    AutoarPref *arpref);
+AutoarExtract  *autoar_extract_new_stream          (GInputStream *stream,
+                                                    const char *source_name,
+                                                    const char *output,
+                                                    AutoarPref *arpref);
+AutoarExtract  *autoar_extract_new_stream_file     (GInputStream *stream,
+                                                    const char *source_name,
+                                                    GFile *output_file,
+                                                    AutoarPref *arpref);
 
 void            autoar_extract_start               (AutoarExtract *arextract,
                                                     GCancellable *cancellable);
@@ -104,11 +158,42 @@ guint           autoar_extract_get_completed_files (AutoarExtract *arextract);
 gboolean        autoar_extract_get_source_is_mem   (AutoarExtract *arextract);
 gboolean        autoar_extract_get_output_is_dest  (AutoarExtract *arextract);
 gint64          autoar_extract_get_notify_interval (AutoarExtract *arextract);
+gboolean        autoar_extract_get_single_pass     (AutoarExtract *arextract);
+gboolean        autoar_extract_get_use_scan_cache  (AutoarExtract *arextract);
+guint           autoar_extract_get_n_threads       (AutoarExtract *arextract);
+guint64         autoar_extract_get_small_file_size (AutoarExtract *arextract);
+gboolean        autoar_extract_get_preallocate     (AutoarExtract *arextract);
+const char    **autoar_extract_get_include_patterns
+                                                   (AutoarExtract *arextract);
+GHashTable     *autoar_extract_get_sink_bytes      (AutoarExtract *arextract);
+gboolean        autoar_extract_get_verify          (AutoarExtract *arextract);
+guint           autoar_extract_get_failed_entries  (AutoarExtract *arextract);
+gdouble         autoar_extract_get_throughput      (AutoarExtract *arextract);
 
 void            autoar_extract_set_output_is_dest  (AutoarExtract *arextract,
                                                     gboolean output_is_dest);
 void            autoar_extract_set_notify_interval (AutoarExtract *arextract,
                                                     gint64 notify_interval);
+void            autoar_extract_set_single_pass     (AutoarExtract *arextract,
+                                                    gboolean single_pass);
+void            autoar_extract_set_use_scan_cache  (AutoarExtract *arextract,
+                                                    gboolean use_scan_cache);
+void            autoar_extract_set_n_threads       (AutoarExtract *arextract,
+                                                    guint n_threads);
+void            autoar_extract_set_small_file_size (AutoarExtract *arextract,
+                                                    guint64 small_file_size);
+void            autoar_extract_set_preallocate     (AutoarExtract *arextract,
+                                                    gboolean preallocate);
+void            autoar_extract_set_include_patterns
+                                                   (AutoarExtract *arextract,
+                                                    const char **patterns);
+void            autoar_extract_set_sink            (AutoarExtract *arextract,
+                                                    const AutoarExtractSink *sink,
+                                                    gpointer user_data,
+                                                    GDestroyNotify user_data_free);
+void            autoar_extract_set_sink_bytes      (AutoarExtract *arextract);
+void            autoar_extract_set_verify          (AutoarExtract *arextract,
+                                                    gboolean verify);
 
 G_END_DECLS
 
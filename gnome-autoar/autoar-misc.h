@@ -42,6 +42,36 @@ G_BEGIN_DECLS
 
 GQuark    autoar_libarchive_quark                      (void);
 
+/**
+ * AutoarEntryInfo:
+ * @pathname: path name of the entry, normalized to a relative path which
+ * cannot refer to a location outside the archive. Dots starting a name, as in
+ * ".env", are kept.
+ * @hardlink: normalized path name of the entry this entry is a hard link to,
+ * or %NULL
+ * @symlink: target of the symbolic link as stored in the archive, or %NULL
+ * @size: size of the entry in bytes, or -1 if the archive does not record it
+ * @mode: file type and permission bits in the format of st_mode
+ * @mtime: modification time in seconds since the epoch
+ * @ordinal: position of the entry in the archive, starting from 0
+ *
+ * Information about an entry of an archive. The strings are owned by
+ * gnome-autoar and they are only valid during the call receiving the
+ * structure.
+ **/
+typedef struct _AutoarEntryInfo AutoarEntryInfo;
+
+struct _AutoarEntryInfo
+{
+  const char *pathname;
+  const char *hardlink;
+  const char *symlink;
+  gint64      size;
+  guint32     mode;
+  gint64      mtime;
+  guint       ordinal;
+};
+
 G_END_DECLS
 
 #endif /* AUTOAR_COMMON_H */
@@ -30,9 +30,36 @@
 
 #include "autoar-misc.h"
 
+#include <errno.h>
 #include <glib.h>
 #include <gobject/gvaluecollector.h>
 #include <string.h>
+#include <sys/types.h>
+
+#if defined HAVE_GETPWNAM || defined HAVE_GETPWUID
+# include <pwd.h>
+#endif
+
+#if defined HAVE_GETGRNAM || defined HAVE_GETGRGID
+# include <grp.h>
+#endif
+
+/* Results of user and group lookups, including failed ones, are kept for
+ * this long. */
+#define ID_CACHE_TTL (5 * G_TIME_SPAN_MINUTE)
+#define ID_BUFFER_SIZE 1024
+
+/* Signals emitted from other threads */
+#define SIGNAL_MAX_PARAMS 2
+#define SIGNAL_POOL_SIZE 8
+
+/* 64-bit counters are updated with compiler builtins if the target can do it
+ * without a lock. GLib does not provide 64-bit atomic operations. */
+#if defined __GCC_HAVE_SYNC_COMPARE_AND_SWAP_8 && defined __ATOMIC_RELAXED
+# define HAVE_ATOMIC_64 1
+#else
+G_LOCK_DEFINE_STATIC (progress);
+#endif
 
 /**
  * SECTION:autoar-common
@@ -44,15 +71,61 @@
  **/
 
 typedef struct _AutoarCommonSignalData AutoarCommonSignalData;
+typedef struct _AutoarCommonSignalInfo AutoarCommonSignalInfo;
+typedef struct _AutoarCommonSignalSource AutoarCommonSignalSource;
+typedef struct _AutoarCommonIdEntry AutoarCommonIdEntry;
+typedef struct _AutoarCommonProgressSource AutoarCommonProgressSource;
+
+typedef enum
+{
+  AUTOAR_COMMON_ID_USER,
+  AUTOAR_COMMON_ID_GROUP
+} AutoarCommonIdType;
 
 struct _AutoarCommonSignalData
 {
-  GValue instance_and_params[3]; /* Maximum number of parameters + 1 */
+  GValue instance_and_params[SIGNAL_MAX_PARAMS + 1];
   gssize used_values; /* Number of GValues to be unset */
   guint signal_id;
   GQuark detail;
+  AutoarCommonSignalData *next; /* In the queue or the free list */
+};
+
+struct _AutoarCommonSignalInfo
+{
+  guint n_params;
+  const GType *param_types;
+};
+
+struct _AutoarCommonSignalSource
+{
+  GSource source;
+  AutoarCommonSignalPool *pool;
+};
+
+struct _AutoarCommonProgressSource
+{
+  GSource source;
+  AutoarCommonProgress *progress;
+};
+
+struct _AutoarCommonIdEntry
+{
+  gint64 expiry;
+  guint32 id;
+  const char *name; /* Interned, or NULL if the lookup failed */
 };
 
+/* Parameter types of signals, filled in class_init functions */
+static GRWLock signal_cache_lock;
+static GHashTable *signal_cache;
+
+/* Shared by all objects in the process. Lookups may query NSS modules which
+ * are slow, so they are done without holding the lock. */
+G_LOCK_DEFINE_STATIC (id_cache);
+static GHashTable *id_cache_by_name[2];
+static GHashTable *id_cache_by_id[2];
+
 /**
  * autoar_common_get_filename_extension:
  * @filename: a filename
@@ -112,12 +185,54 @@ autoar_common_get_basename_remove_extension (const char *filename)
 }
 
 static void
-autoar_common_signal_data_free (AutoarCommonSignalData *signal_data)
+autoar_common_signal_data_unset (AutoarCommonSignalData *signal_data)
 {
   int i;
 
   for (i = 0; i < signal_data->used_values; i++)
     g_value_unset (signal_data->instance_and_params + i);
+  signal_data->used_values = 0;
+}
+
+static AutoarCommonSignalData*
+autoar_common_signal_data_new (AutoarCommonSignalPool *pool)
+{
+  AutoarCommonSignalData *signal_data;
+
+  signal_data = NULL;
+  if (pool != NULL) {
+    g_mutex_lock (&(pool->mutex));
+    if ((signal_data = pool->free_list) != NULL) {
+      pool->free_list = signal_data->next;
+      pool->n_free--;
+    }
+    g_mutex_unlock (&(pool->mutex));
+  }
+
+  /* GValues must be zero-filled before g_value_init() */
+  if (signal_data == NULL)
+    signal_data = g_new0 (AutoarCommonSignalData, 1);
+
+  signal_data->next = NULL;
+  return signal_data;
+}
+
+static void
+autoar_common_signal_data_free (AutoarCommonSignalPool *pool,
+                                AutoarCommonSignalData *signal_data)
+{
+  autoar_common_signal_data_unset (signal_data);
+
+  if (pool != NULL) {
+    g_mutex_lock (&(pool->mutex));
+    if (pool->n_free < SIGNAL_POOL_SIZE) {
+      signal_data->next = pool->free_list;
+      pool->free_list = signal_data;
+      pool->n_free++;
+      signal_data = NULL;
+    }
+    g_mutex_unlock (&(pool->mutex));
+  }
 
   g_free (signal_data);
 }
@@ -130,13 +245,173 @@ autoar_common_g_signal_emit_main_context (void *data)
                   signal_data->signal_id,
                   signal_data->detail,
                   NULL);
-  autoar_common_signal_data_free (signal_data);
+  autoar_common_signal_data_free (NULL, signal_data);
   return FALSE;
 }
 
+static gboolean
+autoar_common_signal_source_dispatch (GSource *source,
+                                      GSourceFunc callback,
+                                      gpointer user_data)
+{
+  AutoarCommonSignalPool *pool;
+  AutoarCommonSignalData *signal_data, *next;
+  GObject *instance;
+
+  pool = ((AutoarCommonSignalSource*)source)->pool;
+
+  g_mutex_lock (&(pool->mutex));
+  signal_data = pool->queue_head;
+  pool->queue_head = NULL;
+  pool->queue_tail = NULL;
+  g_source_set_ready_time (source, -1);
+  g_mutex_unlock (&(pool->mutex));
+
+  if (signal_data == NULL)
+    return G_SOURCE_CONTINUE;
+
+  /* Each queued signal holds a reference to the instance, and the last one
+   * may be dropped here. The pool belongs to the instance, so it must not
+   * be finalized until all signals are returned to the pool. */
+  instance = g_value_dup_object (signal_data->instance_and_params);
+
+  for (; signal_data != NULL; signal_data = next) {
+    next = signal_data->next;
+    g_signal_emitv (signal_data->instance_and_params,
+                    signal_data->signal_id,
+                    signal_data->detail,
+                    NULL);
+    autoar_common_signal_data_free (pool, signal_data);
+  }
+
+  g_object_unref (instance);
+  return G_SOURCE_CONTINUE;
+}
+
+static GSourceFuncs autoar_common_signal_source_funcs = {
+  NULL,
+  NULL,
+  autoar_common_signal_source_dispatch,
+  NULL,
+};
+
+/**
+ * autoar_common_signal_pool_init:
+ * @pool: an #AutoarCommonSignalPool
+ *
+ * Initializes the storage used by autoar_common_g_signal_emit() for signals
+ * which are emitted from other threads. A pool should be stored in the
+ * object which emits the signals.
+ **/
+G_GNUC_INTERNAL void
+autoar_common_signal_pool_init (AutoarCommonSignalPool *pool)
+{
+  g_mutex_init (&(pool->mutex));
+  pool->free_list = NULL;
+  pool->n_free = 0;
+  pool->queue_head = NULL;
+  pool->queue_tail = NULL;
+  pool->source = NULL;
+}
+
+/**
+ * autoar_common_signal_pool_clear:
+ * @pool: an #AutoarCommonSignalPool
+ *
+ * Frees the resources of @pool. This must be called when the object which
+ * owns @pool is finalized. Queued signals hold a reference to the object, so
+ * no signal can be pending at this point.
+ **/
+G_GNUC_INTERNAL void
+autoar_common_signal_pool_clear (AutoarCommonSignalPool *pool)
+{
+  AutoarCommonSignalData *signal_data, *next;
+
+  g_warn_if_fail (pool->queue_head == NULL);
+
+  if (pool->source != NULL) {
+    g_source_destroy (pool->source);
+    g_source_unref (pool->source);
+    pool->source = NULL;
+  }
+
+  for (signal_data = pool->free_list; signal_data != NULL; signal_data = next) {
+    next = signal_data->next;
+    g_free (signal_data);
+  }
+  pool->free_list = NULL;
+  pool->n_free = 0;
+
+  g_mutex_clear (&(pool->mutex));
+}
+
+static void
+autoar_common_signal_pool_push (AutoarCommonSignalPool *pool,
+                                AutoarCommonSignalData *signal_data)
+{
+  g_mutex_lock (&(pool->mutex));
+
+  if (pool->source == NULL) {
+    pool->source = g_source_new (&autoar_common_signal_source_funcs,
+                                 sizeof (AutoarCommonSignalSource));
+    ((AutoarCommonSignalSource*)(pool->source))->pool = pool;
+    g_source_set_name (pool->source, "autoar signals");
+    g_source_attach (pool->source, NULL);
+  }
+
+  /* Signals are emitted in order, and the source only has to be woken up
+   * when the queue becomes non-empty. */
+  if (pool->queue_tail == NULL) {
+    pool->queue_head = signal_data;
+    g_source_set_ready_time (pool->source, 0);
+  } else {
+    ((AutoarCommonSignalData*)(pool->queue_tail))->next = signal_data;
+  }
+  pool->queue_tail = signal_data;
+
+  g_mutex_unlock (&(pool->mutex));
+}
+
+/**
+ * autoar_common_g_signal_cache:
+ * @signal_ids: an array of signal IDs
+ * @n_signals: the length of @signal_ids
+ *
+ * Remembers the parameter types of signals, so autoar_common_g_signal_emit()
+ * does not have to query them every time. This should be called in the
+ * class_init function after all signals are created.
+ **/
+G_GNUC_INTERNAL void
+autoar_common_g_signal_cache (const guint *signal_ids,
+                              guint n_signals)
+{
+  guint i;
+
+  g_rw_lock_writer_lock (&signal_cache_lock);
+  if (signal_cache == NULL)
+    signal_cache = g_hash_table_new_full (NULL, NULL, NULL, g_free);
+
+  for (i = 0; i < n_signals; i++) {
+    AutoarCommonSignalInfo *info;
+    GSignalQuery query;
+
+    g_signal_query (signal_ids[i], &query);
+    if (query.signal_id == 0 || query.n_params > SIGNAL_MAX_PARAMS)
+      continue;
+
+    /* The parameter types are owned by GObject and never freed */
+    info = g_new (AutoarCommonSignalInfo, 1);
+    info->n_params = query.n_params;
+    info->param_types = query.param_types;
+    g_hash_table_replace (signal_cache, GUINT_TO_POINTER (signal_ids[i]), info);
+  }
+  g_rw_lock_writer_unlock (&signal_cache_lock);
+}
+
 /**
  * autoar_common_g_signal_emit:
  * @instance: the instance the signal is being emitted on.
+ * @pool: (allow-none): the #AutoarCommonSignalPool of @instance, or %NULL
  * @in_thread: %TRUE if you are not call this function inside the main thread.
  * @signal_id: the signal id
  * @detail: the detail
@@ -144,13 +419,18 @@ autoar_common_g_signal_emit_main_context (void *data)
  *
  * This is a wrapper for g_signal_emit(). If @in_thread is %FALSE, this
  * function is the same as g_signal_emit(). If @in_thread is %TRUE, the
- * signal will be emitted from the main thread. This function will send
- * the signal emission job via g_main_context_invoke(), but it does not
+ * signal will be emitted from the main thread, but this function does not
  * wait for the signal emission job to be completed. Hence, the signal
  * may emitted after autoar_common_g_signal_emit() is returned.
+ *
+ * If @pool is not %NULL, signals are queued in @pool and delivered in order
+ * by a single source, and their storage is reused. Otherwise, each signal is
+ * sent with g_main_context_invoke(). Signals registered with
+ * autoar_common_g_signal_cache() are not queried again.
  **/
 G_GNUC_INTERNAL void
 autoar_common_g_signal_emit (gpointer instance,
+                             AutoarCommonSignalPool *pool,
                              gboolean in_thread,
                              guint signal_id,
                              GQuark detail,
@@ -162,27 +442,43 @@ autoar_common_g_signal_emit (gpointer instance,
   if (in_thread) {
     int i;
     gchar *error;
-    GSignalQuery query;
+    guint n_params;
+    const GType *param_types;
+    AutoarCommonSignalInfo *info;
     AutoarCommonSignalData *data;
 
+    g_rw_lock_reader_lock (&signal_cache_lock);
+    info = signal_cache != NULL ?
+           g_hash_table_lookup (signal_cache, GUINT_TO_POINTER (signal_id)) :
+           NULL;
+    g_rw_lock_reader_unlock (&signal_cache_lock);
+
+    if (info != NULL) {
+      n_params = info->n_params;
+      param_types = info->param_types;
+    } else {
+      GSignalQuery query;
+
+      g_signal_query (signal_id, &query);
+      if (query.signal_id == 0 || query.n_params > SIGNAL_MAX_PARAMS) {
+        va_end (ap);
+        return;
+      }
+      n_params = query.n_params;
+      param_types = query.param_types;
+    }
+
     error = NULL;
-    data = g_new0 (AutoarCommonSignalData, 1);
+    data = autoar_common_signal_data_new (pool);
     data->signal_id = signal_id;
     data->detail = detail;
     data->used_values = 1;
     g_value_init (data->instance_and_params, G_TYPE_FROM_INSTANCE (instance));
     g_value_set_instance (data->instance_and_params, instance);
 
-    g_signal_query (signal_id, &query);
-    if (query.signal_id == 0) {
-      autoar_common_signal_data_free (data);
-      va_end (ap);
-      return;
-    }
-
-    for (i = 0; i < query.n_params; i++) {
+    for (i = 0; i < n_params; i++) {
       G_VALUE_COLLECT_INIT (data->instance_and_params + i + 1,
-                            query.param_types[i],
+                            param_types[i],
                             ap,
                             0,
                             &error);
@@ -192,9 +488,12 @@ autoar_common_g_signal_emit (gpointer instance,
     }
 
     if (error == NULL) {
-      g_main_context_invoke (NULL, autoar_common_g_signal_emit_main_context, data);
+      if (pool != NULL)
+        autoar_common_signal_pool_push (pool, data);
+      else
+        g_main_context_invoke (NULL, autoar_common_g_signal_emit_main_context, data);
     } else {
-      autoar_common_signal_data_free (data);
+      autoar_common_signal_data_free (pool, data);
       g_debug ("G_VALUE_COLLECT_INIT: Error: %s", error);
       g_free (error);
       va_end (ap);
@@ -279,3 +578,610 @@ autoar_common_g_file_get_name (GFile *file)
     name = g_file_get_uri (file);
   return name;
 }
+
+/**
+ * autoar_common_sanitize_pathname:
+ * @pathname: a path name read from an archive
+ * @skip_dots: %TRUE if leading dots and slashes should be skipped
+ * @buffer: a #GString to store the result
+ *
+ * Normalizes @pathname to a relative path which cannot refer to a location
+ * outside the directory it is resolved against. Empty components and "."
+ * are removed, and ".." removes the previous component, or it is dropped if
+ * there is no previous component. The same @buffer can be used for many path
+ * names, so no memory is allocated once it is large enough.
+ *
+ * Returns: (transfer none): the content of @buffer, which is empty if
+ * @pathname refers to the directory itself
+ **/
+G_GNUC_INTERNAL const char*
+autoar_common_sanitize_pathname (const char *pathname,
+                                 gboolean skip_dots,
+                                 GString *buffer)
+{
+  const char *component, *end;
+  gsize len;
+
+  g_string_truncate (buffer, 0);
+
+  if (skip_dots)
+    pathname += strspn (pathname, "./");
+
+  for (component = pathname; *component != '\0'; component = end) {
+    end = strchr (component, '/');
+    if (end == NULL)
+      end = component + strlen (component);
+    len = end - component;
+    if (*end == '/')
+      end++;
+
+    if (len == 0 || (len == 1 && component[0] == '.'))
+      continue;
+
+    if (len == 2 && component[0] == '.' && component[1] == '.') {
+      char *slash = strrchr (buffer->str, '/');
+      g_string_truncate (buffer, slash != NULL ? slash - buffer->str : 0);
+      continue;
+    }
+
+    if (buffer->len > 0)
+      g_string_append_c (buffer, '/');
+    g_string_append_len (buffer, component, len);
+  }
+
+  return buffer->str;
+}
+
+/**
+ * autoar_common_entry_info_fill:
+ * @info: an #AutoarEntryInfo to fill
+ * @entry: the entry read from an archive
+ * @pathname: the normalized path name of @entry
+ * @hardlink: (allow-none): the normalized target of the hard link, or %NULL
+ * @ordinal: position of @entry in the archive
+ *
+ * Fills @info with information of @entry. Strings in @info point to the
+ * arguments and to @entry, so they are valid as long as both are.
+ **/
+G_GNUC_INTERNAL void
+autoar_common_entry_info_fill (AutoarEntryInfo *info,
+                               struct archive_entry *entry,
+                               const char *pathname,
+                               const char *hardlink,
+                               guint ordinal)
+{
+  info->pathname = pathname;
+  info->hardlink = hardlink;
+  info->symlink = archive_entry_symlink (entry);
+  info->size = archive_entry_size_is_set (entry) ?
+               archive_entry_size (entry) : -1;
+  info->mode = archive_entry_mode (entry);
+  info->mtime = archive_entry_mtime (entry);
+  info->ordinal = ordinal;
+}
+
+static gboolean
+autoar_common_id_query_name (AutoarCommonIdType type,
+                             const char *name,
+                             guint32 *id,
+                             gboolean *found)
+{
+  /* Returns FALSE if the result should not be cached, which happens if the
+   * lookup fails with an error instead of not finding the name. */
+
+  char stack_buffer[ID_BUFFER_SIZE];
+  char *buffer;
+  size_t size;
+  int r;
+
+  buffer = stack_buffer;
+  size = sizeof (stack_buffer);
+  r = 0;
+  *found = FALSE;
+
+  for (;;) {
+    if (type == AUTOAR_COMMON_ID_USER) {
+#if defined HAVE_GETPWNAM_R
+      struct passwd pwd, *result;
+      r = getpwnam_r (name, &pwd, buffer, size, &result);
+      if (r == 0 && result != NULL) {
+        *id = pwd.pw_uid;
+        *found = TRUE;
+      }
+#elif defined HAVE_GETPWNAM
+      struct passwd *result;
+      G_LOCK (id_cache);
+      if ((result = getpwnam (name)) != NULL) {
+        *id = result->pw_uid;
+        *found = TRUE;
+      }
+      G_UNLOCK (id_cache);
+#endif
+    } else {
+#if defined HAVE_GETGRNAM_R
+      struct group grp, *result;
+      r = getgrnam_r (name, &grp, buffer, size, &result);
+      if (r == 0 && result != NULL) {
+        *id = grp.gr_gid;
+        *found = TRUE;
+      }
+#elif defined HAVE_GETGRNAM
+      struct group *result;
+      G_LOCK (id_cache);
+      if ((result = getgrnam (name)) != NULL) {
+        *id = result->gr_gid;
+        *found = TRUE;
+      }
+      G_UNLOCK (id_cache);
+#endif
+    }
+
+    if (r != ERANGE)
+      break;
+
+    size *= 2;
+    if (buffer != stack_buffer)
+      g_free (buffer);
+    buffer = g_malloc (size);
+  }
+
+  if (buffer != stack_buffer)
+    g_free (buffer);
+
+  return r == 0;
+}
+
+static gboolean
+autoar_common_id_query_id (AutoarCommonIdType type,
+                           guint32 id,
+                           const char **name)
+{
+  /* Returns FALSE if the result should not be cached */
+
+  char stack_buffer[ID_BUFFER_SIZE];
+  char *buffer;
+  size_t size;
+  int r;
+
+  buffer = stack_buffer;
+  size = sizeof (stack_buffer);
+  r = 0;
+  *name = NULL;
+
+  for (;;) {
+    if (type == AUTOAR_COMMON_ID_USER) {
+#if defined HAVE_GETPWUID_R
+      struct passwd pwd, *result;
+      r = getpwuid_r (id, &pwd, buffer, size, &result);
+      if (r == 0 && result != NULL)
+        *name = g_intern_string (pwd.pw_name);
+#elif defined HAVE_GETPWUID
+      struct passwd *result;
+      G_LOCK (id_cache);
+      if ((result = getpwuid (id)) != NULL)
+        *name = g_intern_string (result->pw_name);
+      G_UNLOCK (id_cache);
+#endif
+    } else {
+#if defined HAVE_GETGRGID_R
+      struct group grp, *result;
+      r = getgrgid_r (id, &grp, buffer, size, &result);
+      if (r == 0 && result != NULL)
+        *name = g_intern_string (grp.gr_name);
+#elif defined HAVE_GETGRGID
+      struct group *result;
+      G_LOCK (id_cache);
+      if ((result = getgrgid (id)) != NULL)
+        *name = g_intern_string (result->gr_name);
+      G_UNLOCK (id_cache);
+#endif
+    }
+
+    if (r != ERANGE)
+      break;
+
+    size *= 2;
+    if (buffer != stack_buffer)
+      g_free (buffer);
+    buffer = g_malloc (size);
+  }
+
+  if (buffer != stack_buffer)
+    g_free (buffer);
+
+  return r == 0;
+}
+
+static gboolean
+autoar_common_id_from_name (AutoarCommonIdType type,
+                            const char *name,
+                            guint32 *id)
+{
+  AutoarCommonIdEntry *entry;
+  gint64 now;
+  gboolean found;
+
+  now = g_get_monotonic_time ();
+
+  G_LOCK (id_cache);
+  if (id_cache_by_name[type] == NULL)
+    id_cache_by_name[type] = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                    g_free, g_free);
+  entry = g_hash_table_lookup (id_cache_by_name[type], name);
+  if (entry != NULL && entry->expiry > now) {
+    found = entry->name != NULL;
+    *id = entry->id;
+    G_UNLOCK (id_cache);
+    return found;
+  }
+  G_UNLOCK (id_cache);
+
+  if (!autoar_common_id_query_name (type, name, id, &found))
+    return found;
+
+  G_LOCK (id_cache);
+  entry = g_new (AutoarCommonIdEntry, 1);
+  entry->expiry = now + ID_CACHE_TTL;
+  entry->id = found ? *id : 0;
+  entry->name = found ? g_intern_string (name) : NULL;
+  g_hash_table_replace (id_cache_by_name[type], g_strdup (name), entry);
+  G_UNLOCK (id_cache);
+
+  return found;
+}
+
+static const char*
+autoar_common_id_to_name (AutoarCommonIdType type,
+                          guint32 id)
+{
+  AutoarCommonIdEntry *entry;
+  const char *name;
+  gint64 now;
+
+  now = g_get_monotonic_time ();
+
+  G_LOCK (id_cache);
+  if (id_cache_by_id[type] == NULL)
+    id_cache_by_id[type] = g_hash_table_new_full (NULL, NULL, NULL, g_free);
+  entry = g_hash_table_lookup (id_cache_by_id[type], GUINT_TO_POINTER (id));
+  if (entry != NULL && entry->expiry > now) {
+    name = entry->name;
+    G_UNLOCK (id_cache);
+    return name;
+  }
+  G_UNLOCK (id_cache);
+
+  if (!autoar_common_id_query_id (type, id, &name))
+    return name;
+
+  G_LOCK (id_cache);
+  entry = g_new (AutoarCommonIdEntry, 1);
+  entry->expiry = now + ID_CACHE_TTL;
+  entry->id = id;
+  entry->name = name;
+  g_hash_table_replace (id_cache_by_id[type], GUINT_TO_POINTER (id), entry);
+  G_UNLOCK (id_cache);
+
+  return name;
+}
+
+/**
+ * autoar_common_get_uid_from_name:
+ * @name: a user name
+ * @uid: (out): the location to store the user ID
+ *
+ * Looks up a user name through a cache shared by all objects in the process.
+ * Both successful and failed lookups are cached for a few minutes. This
+ * function can be called from any thread.
+ *
+ * Returns: %TRUE if the user is found
+ **/
+G_GNUC_INTERNAL gboolean
+autoar_common_get_uid_from_name (const char *name,
+                                 guint32 *uid)
+{
+  return autoar_common_id_from_name (AUTOAR_COMMON_ID_USER, name, uid);
+}
+
+/**
+ * autoar_common_get_gid_from_name:
+ * @name: a group name
+ * @gid: (out): the location to store the group ID
+ *
+ * Like autoar_common_get_uid_from_name(), but looks up a group.
+ *
+ * Returns: %TRUE if the group is found
+ **/
+G_GNUC_INTERNAL gboolean
+autoar_common_get_gid_from_name (const char *name,
+                                 guint32 *gid)
+{
+  return autoar_common_id_from_name (AUTOAR_COMMON_ID_GROUP, name, gid);
+}
+
+/**
+ * autoar_common_get_user_name:
+ * @uid: a user ID
+ *
+ * Looks up the name of a user through the cache used by
+ * autoar_common_get_uid_from_name().
+ *
+ * Returns: (transfer none): an interned string, or %NULL if the user is not
+ * found
+ **/
+G_GNUC_INTERNAL const char*
+autoar_common_get_user_name (guint32 uid)
+{
+  return autoar_common_id_to_name (AUTOAR_COMMON_ID_USER, uid);
+}
+
+/**
+ * autoar_common_get_group_name:
+ * @gid: a group ID
+ *
+ * Like autoar_common_get_user_name(), but looks up a group.
+ *
+ * Returns: (transfer none): an interned string, or %NULL if the group is not
+ * found
+ **/
+G_GNUC_INTERNAL const char*
+autoar_common_get_group_name (guint32 gid)
+{
+  return autoar_common_id_to_name (AUTOAR_COMMON_ID_GROUP, gid);
+}
+
+/**
+ * autoar_common_progress_init:
+ * @progress: an #AutoarCommonProgress
+ * @instance: the object which emits the progress signal
+ * @pool: (allow-none): the #AutoarCommonSignalPool of @instance
+ * @signal_id: the progress signal, which takes a #guint64 and a #guint
+ *
+ * Initializes the progress counters of an object. @progress must be stored
+ * inside @instance.
+ **/
+G_GNUC_INTERNAL void
+autoar_common_progress_init (AutoarCommonProgress *progress,
+                             gpointer instance,
+                             AutoarCommonSignalPool *pool,
+                             guint signal_id)
+{
+  memset (progress, 0, sizeof (AutoarCommonProgress));
+  progress->instance = instance;
+  progress->pool = pool;
+  progress->signal_id = signal_id;
+}
+
+/**
+ * autoar_common_progress_set:
+ * @progress: an #AutoarCommonProgress
+ * @completed_size: the new number of completed bytes
+ * @completed_files: the new number of completed files
+ *
+ * Sets the progress counters. This function can be called from any thread.
+ **/
+G_GNUC_INTERNAL void
+autoar_common_progress_set (AutoarCommonProgress *progress,
+                            guint64 completed_size,
+                            guint completed_files)
+{
+#ifdef HAVE_ATOMIC_64
+  __atomic_store_n (&(progress->completed_size), completed_size,
+                    __ATOMIC_RELAXED);
+#else
+  G_LOCK (progress);
+  progress->completed_size = completed_size;
+  G_UNLOCK (progress);
+#endif
+  g_atomic_int_set (&(progress->completed_files), completed_files);
+}
+
+/**
+ * autoar_common_progress_add:
+ * @progress: an #AutoarCommonProgress
+ * @completed_size: the number of bytes to add
+ * @completed_files: the number of files to add
+ *
+ * Adds to the progress counters without taking a lock. This function can be
+ * called from any thread. It does not emit the progress signal.
+ **/
+G_GNUC_INTERNAL void
+autoar_common_progress_add (AutoarCommonProgress *progress,
+                            guint64 completed_size,
+                            guint completed_files)
+{
+  if (completed_size > 0) {
+#ifdef HAVE_ATOMIC_64
+    __atomic_add_fetch (&(progress->completed_size), completed_size,
+                        __ATOMIC_RELAXED);
+#else
+    G_LOCK (progress);
+    progress->completed_size += completed_size;
+    G_UNLOCK (progress);
+#endif
+  }
+
+  if (completed_files > 0)
+    g_atomic_int_add (&(progress->completed_files), completed_files);
+}
+
+/**
+ * autoar_common_progress_get_size:
+ * @progress: an #AutoarCommonProgress
+ *
+ * Gets the number of completed bytes. This function can be called from any
+ * thread.
+ *
+ * Returns: the number of completed bytes
+ **/
+G_GNUC_INTERNAL guint64
+autoar_common_progress_get_size (AutoarCommonProgress *progress)
+{
+  guint64 completed_size;
+
+#ifdef HAVE_ATOMIC_64
+  completed_size = __atomic_load_n (&(progress->completed_size),
+                                    __ATOMIC_RELAXED);
+#else
+  G_LOCK (progress);
+  completed_size = progress->completed_size;
+  G_UNLOCK (progress);
+#endif
+
+  return completed_size;
+}
+
+/**
+ * autoar_common_progress_get_files:
+ * @progress: an #AutoarCommonProgress
+ *
+ * Gets the number of completed files. This function can be called from any
+ * thread.
+ *
+ * Returns: the number of completed files
+ **/
+G_GNUC_INTERNAL guint
+autoar_common_progress_get_files (AutoarCommonProgress *progress)
+{
+  return g_atomic_int_get (&(progress->completed_files));
+}
+
+static gboolean
+autoar_common_progress_source_dispatch (GSource *source,
+                                        GSourceFunc callback,
+                                        gpointer user_data)
+{
+  AutoarCommonProgress *progress;
+  gint64 now;
+
+  progress = ((AutoarCommonProgressSource*)source)->progress;
+  now = g_source_get_time (source);
+
+  /* Too early. The pending flag is kept set, so workers do not wake us. */
+  if (now - progress->last < progress->interval) {
+    g_source_set_ready_time (source, progress->last + progress->interval);
+    return G_SOURCE_CONTINUE;
+  }
+
+  /* Clear the flag before reading the counters. Updates made after this
+   * point arm the source again. */
+  g_source_set_ready_time (source, -1);
+  g_atomic_int_set (&(progress->pending), 0);
+  progress->last = now;
+
+  g_signal_emit (progress->instance, progress->signal_id, 0,
+                 autoar_common_progress_get_size (progress),
+                 autoar_common_progress_get_files (progress));
+
+  return G_SOURCE_CONTINUE;
+}
+
+static void
+autoar_common_progress_source_finalize (GSource *source)
+{
+  g_object_unref (((AutoarCommonProgressSource*)source)->progress->instance);
+}
+
+static GSourceFuncs autoar_common_progress_source_funcs = {
+  NULL,
+  NULL,
+  autoar_common_progress_source_dispatch,
+  autoar_common_progress_source_finalize,
+};
+
+/**
+ * autoar_common_progress_start:
+ * @progress: an #AutoarCommonProgress
+ * @in_thread: %TRUE if the work does not run in the main thread
+ * @interval: the minimal interval between progress signals in microseconds
+ *
+ * Prepares to emit progress signals. If @in_thread is %TRUE, a single
+ * #GSource is attached to the main context. Worker threads only mark it
+ * ready, and it emits at most one signal per @interval with the latest
+ * values, no matter how many times autoar_common_progress_notify() is
+ * called. Call autoar_common_progress_stop() when the work is done.
+ **/
+G_GNUC_INTERNAL void
+autoar_common_progress_start (AutoarCommonProgress *progress,
+                              gboolean in_thread,
+                              gint64 interval)
+{
+  AutoarCommonProgressSource *source;
+
+  progress->in_thread = in_thread;
+  progress->interval = interval;
+  progress->last = 0;
+  progress->pending = 0;
+
+  if (!in_thread || progress->source != NULL)
+    return;
+
+  source = (AutoarCommonProgressSource*)
+    g_source_new (&autoar_common_progress_source_funcs,
+                  sizeof (AutoarCommonProgressSource));
+  source->progress = progress;
+  g_object_ref (progress->instance);
+
+  /* Signals queued by autoar_common_g_signal_emit() go first */
+  g_source_set_priority ((GSource*)source, G_PRIORITY_DEFAULT_IDLE);
+  g_source_set_name ((GSource*)source, "autoar progress");
+  g_source_attach ((GSource*)source, NULL);
+
+  progress->source = (GSource*)source;
+}
+
+/**
+ * autoar_common_progress_notify:
+ * @progress: an #AutoarCommonProgress
+ * @force: %TRUE to emit the signal even if the interval is not over
+ *
+ * Tells @progress that the counters have changed. In the main thread, the
+ * signal is emitted directly if the interval is over. In other threads, the
+ * source created by autoar_common_progress_start() is marked ready, which is
+ * a single atomic operation if it is already pending. If @force is %TRUE,
+ * the latest values are queued in order with the other signals.
+ **/
+G_GNUC_INTERNAL void
+autoar_common_progress_notify (AutoarCommonProgress *progress,
+                               gboolean force)
+{
+  if (progress->in_thread && !force) {
+    if (progress->source != NULL &&
+        g_atomic_int_compare_and_exchange (&(progress->pending), 0, 1))
+      g_source_set_ready_time (progress->source, 0);
+    return;
+  }
+
+  if (!(progress->in_thread)) {
+    gint64 now;
+
+    now = g_get_monotonic_time ();
+    if (!force && now - progress->last < progress->interval)
+      return;
+    progress->last = now;
+  }
+
+  autoar_common_g_signal_emit (progress->instance, progress->pool,
+                               progress->in_thread,
+                               progress->signal_id, 0,
+                               autoar_common_progress_get_size (progress),
+                               autoar_common_progress_get_files (progress));
+}
+
+/**
+ * autoar_common_progress_stop:
+ * @progress: an #AutoarCommonProgress
+ *
+ * Removes the source created by autoar_common_progress_start(), so no
+ * progress signal is emitted after the signal which ends the work.
+ **/
+G_GNUC_INTERNAL void
+autoar_common_progress_stop (AutoarCommonProgress *progress)
+{
+  if (progress->source == NULL)
+    return;
+
+  g_source_destroy (progress->source);
+  g_source_unref (progress->source);
+  progress->source = NULL;
+}
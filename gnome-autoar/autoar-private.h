@@ -37,12 +37,53 @@
 #include <glib.h>
 #include <glib-object.h>
 
+#include "autoar-misc.h"
+
 G_BEGIN_DECLS
 
+typedef struct _AutoarCommonSignalPool AutoarCommonSignalPool;
+typedef struct _AutoarCommonProgress AutoarCommonProgress;
+
+struct _AutoarCommonSignalPool
+{
+  GMutex mutex;
+
+  /* Storage of delivered signals, kept for reuse */
+  gpointer free_list;
+  guint n_free;
+
+  /* Signals waiting for the main thread */
+  gpointer queue_head;
+  gpointer queue_tail;
+  GSource *source;
+};
+
+struct _AutoarCommonProgress
+{
+  /* Counters are updated atomically, so they can be read from any thread */
+  volatile guint64 completed_size;
+  volatile gint completed_files;
+
+  /* Delivery of the progress signal */
+  gpointer instance;
+  AutoarCommonSignalPool *pool;
+  guint signal_id;
+  gboolean in_thread;
+  gint64 interval;
+  gint64 last;
+  GSource *source;
+  volatile gint pending;
+};
+
 char*     autoar_common_get_basename_remove_extension  (const char *filename);
 char*     autoar_common_get_filename_extension         (const char *filename);
 
+void      autoar_common_signal_pool_init               (AutoarCommonSignalPool *pool);
+void      autoar_common_signal_pool_clear              (AutoarCommonSignalPool *pool);
+void      autoar_common_g_signal_cache                 (const guint *signal_ids,
+                                                        guint n_signals);
 void      autoar_common_g_signal_emit                  (gpointer instance,
+                                                        AutoarCommonSignalPool *pool,
                                                         gboolean in_thread,
                                                         guint signal_id,
                                                         GQuark detail,
@@ -56,6 +97,42 @@ GError*   autoar_common_g_error_new_a_entry            (struct archive *a,
 
 char*     autoar_common_g_file_get_name                (GFile *file);
 
+const char* autoar_common_sanitize_pathname            (const char *pathname,
+                                                        gboolean skip_dots,
+                                                        GString *buffer);
+
+void      autoar_common_entry_info_fill                (AutoarEntryInfo *info,
+                                                        struct archive_entry *entry,
+                                                        const char *pathname,
+                                                        const char *hardlink,
+                                                        guint ordinal);
+
+gboolean  autoar_common_get_uid_from_name              (const char *name,
+                                                        guint32 *uid);
+gboolean  autoar_common_get_gid_from_name              (const char *name,
+                                                        guint32 *gid);
+const char* autoar_common_get_user_name                (guint32 uid);
+const char* autoar_common_get_group_name               (guint32 gid);
+
+void      autoar_common_progress_init                  (AutoarCommonProgress *progress,
+                                                        gpointer instance,
+                                                        AutoarCommonSignalPool *pool,
+                                                        guint signal_id);
+void      autoar_common_progress_set                   (AutoarCommonProgress *progress,
+                                                        guint64 completed_size,
+                                                        guint completed_files);
+void      autoar_common_progress_add                   (AutoarCommonProgress *progress,
+                                                        guint64 completed_size,
+                                                        guint completed_files);
+guint64   autoar_common_progress_get_size              (AutoarCommonProgress *progress);
+guint     autoar_common_progress_get_files             (AutoarCommonProgress *progress);
+void      autoar_common_progress_start                 (AutoarCommonProgress *progress,
+                                                        gboolean in_thread,
+                                                        gint64 interval);
+void      autoar_common_progress_notify                (AutoarCommonProgress *progress,
+                                                        gboolean force);
+void      autoar_common_progress_stop                  (AutoarCommonProgress *progress);
+
 G_END_DECLS
 
 #endif /* AUTOAR_COMMON_H */
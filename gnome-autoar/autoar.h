@@ -23,6 +23,7 @@
 #ifndef AUTOARCHIVE_H
 #define AUTOARHICVE_H
 
+#include <gnome-autoar/autoar-archive.h>
 #include <gnome-autoar/autoar-create.h>
 #include <gnome-autoar/autoar-format-filter.h>
 #include <gnome-autoar/autoar-extract.h>
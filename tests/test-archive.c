@@ -0,0 +1,234 @@
+/* vim: set sw=2 ts=2 sts=2 et: */
+
+#include <gnome-autoar/autoar.h>
+#include <archive.h>
+#include <archive_entry.h>
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+#include <locale.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct
+{
+  GMainLoop *loop;
+  guint pending;
+} ReadRun;
+
+static void
+my_read_entry_done (GObject *source_object,
+                    GAsyncResult *result,
+                    gpointer user_data)
+{
+  ReadRun *run = user_data;
+  GBytes *bytes;
+  GError *error;
+
+  error = NULL;
+  bytes = autoar_archive_read_entry_finish (AUTOAR_ARCHIVE (source_object),
+                                            result, &error);
+  if (bytes == NULL) {
+    g_printerr ("Error %d: %s\n", error->code, error->message);
+    g_error_free (error);
+  } else {
+    g_print ("Read %" G_GSIZE_FORMAT " bytes\n", g_bytes_get_size (bytes));
+    g_bytes_unref (bytes);
+  }
+
+  if (--(run->pending) == 0)
+    g_main_loop_quit (run->loop);
+}
+
+/* Names starting with dots must be listed as they are, and must not be
+ * confused with the same names without dots. Sizes tell entries apart. */
+typedef struct
+{
+  const char *pathname;
+  const char *expected;
+  gsize size;
+} DotCase;
+
+static const DotCase dot_cases[] = {
+  { ".gitignore",     ".gitignore",  1 },
+  { "gitignore",      "gitignore",   2 },
+  { "..foo",          "..foo",       3 },
+  { "foo",            "foo",         4 },
+  { "./.config/app",  ".config/app", 5 },
+  { "/config/app",    "config/app",  6 },
+  { NULL, NULL, 0 }
+};
+
+static gboolean
+check_dotfiles (void)
+{
+  struct archive *a;
+  struct archive_entry *entry;
+  AutoarArchive *archive;
+  GFile *file;
+  GError *error;
+  char *tmp_dir, *archive_path;
+  char content[8];
+  gboolean success;
+  guint i;
+
+  error = NULL;
+  tmp_dir = g_dir_make_tmp ("autoar-archive-XXXXXX", &error);
+  if (tmp_dir == NULL) {
+    g_printerr ("Error %d: %s\n", error->code, error->message);
+    g_error_free (error);
+    return FALSE;
+  }
+  archive_path = g_build_filename (tmp_dir, "dots.tar", NULL);
+
+  memset (content, 'x', sizeof (content));
+  a = archive_write_new ();
+  archive_write_set_format_pax_restricted (a);
+  archive_write_open_filename (a, archive_path);
+  entry = archive_entry_new ();
+  for (i = 0; dot_cases[i].pathname != NULL; i++) {
+    archive_entry_clear (entry);
+    archive_entry_set_pathname (entry, dot_cases[i].pathname);
+    archive_entry_set_filetype (entry, AE_IFREG);
+    archive_entry_set_perm (entry, 0644);
+    archive_entry_set_size (entry, dot_cases[i].size);
+    archive_write_header (a, entry);
+    archive_write_data (a, content, dot_cases[i].size);
+  }
+  archive_entry_free (entry);
+  archive_write_close (a);
+  archive_write_free (a);
+
+  file = g_file_new_for_path (archive_path);
+  archive = autoar_archive_new (file);
+  g_object_unref (file);
+
+  success = autoar_archive_open (archive, NULL, &error);
+  if (!success) {
+    g_printerr ("Error %d: %s\n", error->code, error->message);
+    g_error_free (error);
+  }
+
+  for (i = 0; success && dot_cases[i].pathname != NULL; i++) {
+    const AutoarEntryInfo *info;
+    GBytes *bytes;
+
+    info = i < autoar_archive_get_n_entries (archive) ?
+           autoar_archive_get_entry (archive, i) : NULL;
+    if (info == NULL || strcmp (info->pathname, dot_cases[i].expected) != 0) {
+      g_printerr ("%s: listed as %s, expected %s\n", dot_cases[i].pathname,
+                  info != NULL ? info->pathname : "(none)", dot_cases[i].expected);
+      success = FALSE;
+      break;
+    }
+
+    info = autoar_archive_lookup (archive, dot_cases[i].pathname);
+    if (info == NULL || info->size != dot_cases[i].size) {
+      g_printerr ("%s: lookup found the wrong entry\n", dot_cases[i].pathname);
+      success = FALSE;
+      break;
+    }
+
+    bytes = autoar_archive_read_entry (archive, dot_cases[i].pathname, NULL, &error);
+    if (bytes == NULL) {
+      g_printerr ("%s: Error %d: %s\n", dot_cases[i].pathname, error->code, error->message);
+      g_error_free (error);
+      error = NULL;
+      success = FALSE;
+      break;
+    }
+    if (g_bytes_get_size (bytes) != dot_cases[i].size) {
+      g_printerr ("%s: read %" G_GSIZE_FORMAT " bytes\n", dot_cases[i].pathname,
+                  g_bytes_get_size (bytes));
+      success = FALSE;
+    }
+    g_bytes_unref (bytes);
+  }
+
+  g_object_unref (archive);
+  g_unlink (archive_path);
+  g_rmdir (tmp_dir);
+  g_free (archive_path);
+  g_free (tmp_dir);
+
+  return success;
+}
+
+static void
+my_handler_entries_indexed (AutoarArchive *archive,
+                            guint first,
+                            guint n_entries,
+                            gpointer user_data)
+{
+  guint i;
+
+  for (i = first; i < first + n_entries; i++) {
+    const AutoarEntryInfo *info = autoar_archive_get_entry (archive, i);
+    g_print ("%10" G_GINT64_FORMAT "  %s\n", info->size, info->pathname);
+  }
+}
+
+int
+main (int argc,
+      char *argv[])
+{
+  AutoarArchive *archive;
+  GFile *file;
+  GError *error;
+  ReadRun run;
+  gint64 start;
+  guint i;
+
+  /* Names starting with dots are checked if no archive is given */
+  if (argc < 2) {
+    if (!check_dotfiles ())
+      return 1;
+    g_print ("Names starting with dots are indexed correctly\n");
+    return 0;
+  }
+
+  setlocale (LC_ALL, "");
+
+  file = g_file_new_for_commandline_arg (argv[1]);
+  archive = autoar_archive_new (file);
+  g_object_unref (file);
+
+  /* Entries are listed while the archive is being indexed */
+  if (argc < 3)
+    g_signal_connect (archive, "entries-indexed",
+                      G_CALLBACK (my_handler_entries_indexed), NULL);
+
+  error = NULL;
+  start = g_get_monotonic_time ();
+  if (!autoar_archive_open (archive, NULL, &error)) {
+    g_printerr ("Error %d: %s\n", error->code, error->message);
+    g_error_free (error);
+    g_object_unref (archive);
+    return 1;
+  }
+
+  g_print ("Indexed %u entries in %.3f s\n",
+           autoar_archive_get_n_entries (archive),
+           (g_get_monotonic_time () - start) / (double)G_USEC_PER_SEC);
+
+  if (argc < 3) {
+    g_object_unref (archive);
+    return 0;
+  }
+
+  /* All entries are read at the same time */
+  run.loop = g_main_loop_new (NULL, FALSE);
+  run.pending = argc - 2;
+  start = g_get_monotonic_time ();
+  for (i = 2; i < argc; i++)
+    autoar_archive_read_entry_async (archive, argv[i], NULL,
+                                     my_read_entry_done, &run);
+  g_main_loop_run (run.loop);
+
+  g_print ("Read %d entries in %.3f s\n", argc - 2,
+           (g_get_monotonic_time () - start) / (double)G_USEC_PER_SEC);
+
+  g_main_loop_unref (run.loop);
+  g_object_unref (archive);
+
+  return 0;
+}
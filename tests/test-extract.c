@@ -45,11 +45,37 @@ my_handler_error (AutoarExtract *arextract,
   g_printerr ("\nError %d: %s\n", error->code, error->message);
 }
 
+static void
+my_handler_entry_failed (AutoarExtract *arextract,
+                         const char *pathname,
+                         GError *error,
+                         gpointer data)
+{
+  g_printerr ("\n%s: Error %d: %s\n", pathname, error->code, error->message);
+}
+
 static void
 my_handler_completed (AutoarExtract *arextract,
                       gpointer data)
 {
+  GHashTable *sink_bytes;
+
   g_print ("\nCompleted!\n");
+
+  if (autoar_extract_get_verify (arextract))
+    g_print ("Tested at %.2lf MiB/s\n",
+             autoar_extract_get_throughput (arextract) / (1024 * 1024));
+
+  sink_bytes = autoar_extract_get_sink_bytes (arextract);
+  if (sink_bytes != NULL) {
+    GHashTableIter iter;
+    gpointer key, value;
+
+    g_hash_table_iter_init (&iter, sink_bytes);
+    while (g_hash_table_iter_next (&iter, &key, &value))
+      g_print ("%s: %" G_GSIZE_FORMAT " bytes\n",
+               (char*)key, g_bytes_get_size (value));
+  }
 }
 
 int
@@ -102,10 +128,19 @@ main (int argc,
     arextract = autoar_extract_new (argv[1], argv[2], arpref);
   }
 
+  /* Regular files are kept in memory, so the output directory is unused */
+  if (g_str_has_suffix (argv[0], "test-extract-bytes"))
+    autoar_extract_set_sink_bytes (arextract);
+
+  /* Data are decoded and discarded, so the output directory is unused */
+  if (g_str_has_suffix (argv[0], "test-extract-verify"))
+    autoar_extract_set_verify (arextract, TRUE);
+
   g_signal_connect (arextract, "scanned", G_CALLBACK (my_handler_scanned), NULL);
   g_signal_connect (arextract, "decide-dest", G_CALLBACK (my_handler_decide_dest), NULL);
   g_signal_connect (arextract, "progress", G_CALLBACK (my_handler_progress), NULL);
   g_signal_connect (arextract, "error", G_CALLBACK (my_handler_error), NULL);
+  g_signal_connect (arextract, "entry-failed", G_CALLBACK (my_handler_entry_failed), NULL);
   g_signal_connect (arextract, "completed", G_CALLBACK (my_handler_completed), NULL);
 
   autoar_extract_start (arextract, NULL);
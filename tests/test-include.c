@@ -0,0 +1,207 @@
+/* vim: set sw=2 ts=2 sts=2 et: */
+
+#include <gnome-autoar/autoar.h>
+#include <archive.h>
+#include <archive_entry.h>
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Extracts a single literal path from a tar archive containing several
+ * entries and checks that all of its data are written. Reading stops right
+ * after the included entry, which must not drop the data still waiting to be
+ * written. */
+
+#define INCLUDED_PATH "etc/app.conf"
+#define INCLUDED_SIZE (512 * 1024 + 123)
+
+typedef struct
+{
+  const char *pathname;
+  gsize size;
+} TestEntry;
+
+static const TestEntry entries[] = {
+  { "README",      1000 },
+  { INCLUDED_PATH, INCLUDED_SIZE },
+  { "etc/other",   2000 },
+  { "zzz",         3000 },
+  { NULL, 0 }
+};
+
+static char*
+make_content (const char *pathname,
+              gsize size)
+{
+  char *content;
+  guint32 seed;
+  gsize i;
+
+  content = g_malloc (size);
+  seed = g_str_hash (pathname);
+  for (i = 0; i < size; i++) {
+    seed = seed * 1103515245 + 12345;
+    content[i] = 'a' + (seed >> 16) % 26;
+  }
+
+  return content;
+}
+
+static gboolean
+write_archive (const char *filename)
+{
+  struct archive *a;
+  struct archive_entry *entry;
+  gboolean success;
+  int i;
+
+  a = archive_write_new ();
+  archive_write_set_format_pax_restricted (a);
+  if (archive_write_open_filename (a, filename) != ARCHIVE_OK) {
+    g_printerr ("%s: %s\n", filename, archive_error_string (a));
+    archive_write_free (a);
+    return FALSE;
+  }
+
+  success = TRUE;
+  entry = archive_entry_new ();
+  for (i = 0; success && entries[i].pathname != NULL; i++) {
+    char *content = make_content (entries[i].pathname, entries[i].size);
+
+    archive_entry_clear (entry);
+    archive_entry_set_pathname (entry, entries[i].pathname);
+    archive_entry_set_filetype (entry, AE_IFREG);
+    archive_entry_set_perm (entry, 0644);
+    archive_entry_set_size (entry, entries[i].size);
+
+    if (archive_write_header (a, entry) != ARCHIVE_OK ||
+        archive_write_data (a, content, entries[i].size) != (la_ssize_t)entries[i].size) {
+      g_printerr ("%s: %s\n", entries[i].pathname, archive_error_string (a));
+      success = FALSE;
+    }
+
+    g_free (content);
+  }
+  archive_entry_free (entry);
+
+  if (archive_write_close (a) != ARCHIVE_OK)
+    success = FALSE;
+  archive_write_free (a);
+
+  return success;
+}
+
+static void
+my_handler_error (AutoarExtract *arextract,
+                  GError *error,
+                  gpointer data)
+{
+  gboolean *failed = data;
+
+  g_printerr ("Error %d: %s\n", error->code, error->message);
+  *failed = TRUE;
+}
+
+static void
+my_handler_completed (AutoarExtract *arextract,
+                      gpointer data)
+{
+  gboolean *completed = data;
+  *completed = TRUE;
+}
+
+static gboolean
+check_extract (const char *archive_path,
+               const char *output_path,
+               guint n_threads)
+{
+  const char *patterns[] = { INCLUDED_PATH, NULL };
+  AutoarExtract *arextract;
+  AutoarPref *arpref;
+  gboolean failed, completed, success;
+  char *expected, *content;
+  gsize length;
+
+  arpref = autoar_pref_new ();
+  autoar_pref_set_delete_if_succeed (arpref, FALSE);
+
+  /* The only extracted file is written to the output itself */
+  arextract = autoar_extract_new (archive_path, output_path, arpref);
+  autoar_extract_set_output_is_dest (arextract, TRUE);
+  autoar_extract_set_n_threads (arextract, n_threads);
+  autoar_extract_set_include_patterns (arextract, patterns);
+
+  failed = FALSE;
+  completed = FALSE;
+  g_signal_connect (arextract, "error", G_CALLBACK (my_handler_error), &failed);
+  g_signal_connect (arextract, "completed", G_CALLBACK (my_handler_completed), &completed);
+
+  autoar_extract_start (arextract, NULL);
+
+  g_object_unref (arextract);
+  g_object_unref (arpref);
+
+  if (failed || !completed) {
+    g_printerr ("%u threads: extraction is not completed\n", n_threads);
+    return FALSE;
+  }
+
+  content = NULL;
+  if (!g_file_get_contents (output_path, &content, &length, NULL)) {
+    g_printerr ("%u threads: %s is not extracted\n", n_threads, INCLUDED_PATH);
+    return FALSE;
+  }
+
+  expected = make_content (INCLUDED_PATH, INCLUDED_SIZE);
+  success = length == INCLUDED_SIZE && memcmp (content, expected, length) == 0;
+  if (!success)
+    g_printerr ("%u threads: %s: got %" G_GSIZE_FORMAT " bytes, expected %d bytes\n",
+                n_threads, INCLUDED_PATH, length, INCLUDED_SIZE);
+
+  g_free (expected);
+  g_free (content);
+  g_unlink (output_path);
+
+  return success;
+}
+
+int
+main (int argc,
+      char *argv[])
+{
+  char *tmp_dir, *archive_path, *output_path;
+  gboolean success;
+  GError *error;
+
+  error = NULL;
+  tmp_dir = g_dir_make_tmp ("autoar-include-XXXXXX", &error);
+  if (tmp_dir == NULL) {
+    g_printerr ("Error %d: %s\n", error->code, error->message);
+    g_error_free (error);
+    return 1;
+  }
+
+  archive_path = g_build_filename (tmp_dir, "test.tar", NULL);
+  output_path = g_build_filename (tmp_dir, "app.conf", NULL);
+
+  success = write_archive (archive_path);
+  /* One writer thread uses the pipeline, and more use the thread pool */
+  success = success && check_extract (archive_path, output_path, 1);
+  success = success && check_extract (archive_path, output_path, 4);
+
+  g_unlink (output_path);
+  g_unlink (archive_path);
+  g_rmdir (tmp_dir);
+
+  g_free (output_path);
+  g_free (archive_path);
+  g_free (tmp_dir);
+
+  if (!success)
+    return 1;
+
+  g_print ("%s is extracted completely\n", INCLUDED_PATH);
+
+  return 0;
+}
@@ -0,0 +1,127 @@
+/* vim: set sw=2 ts=2 sts=2 et: */
+
+#include <gnome-autoar/autoar-private.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct
+{
+  const char *pathname;
+  gboolean skip_dots;
+  const char *expected;
+} SanitizeCase;
+
+static const SanitizeCase cases[] = {
+  { "a/b/c",                 FALSE, "a/b/c" },
+  { "a//b///c/",             FALSE, "a/b/c" },
+  { "./a/./b/.",             FALSE, "a/b" },
+  { "a/../b",                FALSE, "b" },
+  { "a/b/../../c",           FALSE, "c" },
+  { "..",                    FALSE, "" },
+  { "../../../etc/passwd",   FALSE, "etc/passwd" },
+  { "/etc/passwd",           FALSE, "etc/passwd" },
+  { "//etc//passwd",         FALSE, "etc/passwd" },
+  { "a/../../../b",          FALSE, "b" },
+  { "a/b/../../../../c/d",   FALSE, "c/d" },
+  { "a/.../b",               FALSE, "a/.../b" },
+  { "a/..b/c",               FALSE, "a/..b/c" },
+  { "a/b..",                 FALSE, "a/b.." },
+  { ".hidden/file",          FALSE, ".hidden/file" },
+  { "",                      FALSE, "" },
+  { "/",                     FALSE, "" },
+  { "./",                    TRUE,  "" },
+  { "./a/b",                 TRUE,  "a/b" },
+  { "../../a",               TRUE,  "a" },
+  { "/../a/../../b",         TRUE,  "b" },
+  { "..hidden",              TRUE,  "hidden" },
+  { "a/./../../b/./c/..",    TRUE,  "b" },
+  { NULL, FALSE, NULL }
+};
+
+static gboolean
+check_confined (const char *sanitized)
+{
+  /* The result must be relative and must not contain empty, "." or ".."
+   * components, so it cannot refer to anything outside the directory. */
+
+  GFile *top, *child;
+  gboolean confined;
+  char **components;
+  int i;
+
+  if (sanitized[0] == '/')
+    return FALSE;
+
+  components = g_strsplit (sanitized, "/", -1);
+  for (i = 0; sanitized[0] != '\0' && components[i] != NULL; i++) {
+    if (components[i][0] == '\0' ||
+        strcmp (components[i], ".") == 0 ||
+        strcmp (components[i], "..") == 0) {
+      g_strfreev (components);
+      return FALSE;
+    }
+  }
+  g_strfreev (components);
+
+  top = g_file_new_for_path ("/tmp/autoar-top");
+  child = g_file_get_child (top, sanitized);
+  confined = g_file_equal (child, top) || g_file_has_prefix (child, top);
+  g_object_unref (child);
+  g_object_unref (top);
+
+  return confined;
+}
+
+int
+main (int argc,
+      char *argv[])
+{
+  GString *buffer;
+  int i, failed;
+
+  buffer = g_string_new (NULL);
+  failed = 0;
+
+  for (i = 0; cases[i].pathname != NULL; i++) {
+    const char *sanitized;
+
+    sanitized = autoar_common_sanitize_pathname (cases[i].pathname,
+                                                 cases[i].skip_dots,
+                                                 buffer);
+    if (strcmp (sanitized, cases[i].expected) != 0 || !check_confined (sanitized)) {
+      g_printerr ("FAIL: \"%s\" (skip_dots = %d): \"%s\", expected \"%s\"\n",
+                  cases[i].pathname, cases[i].skip_dots, sanitized, cases[i].expected);
+      failed++;
+    } else {
+      g_print ("PASS: \"%s\" => \"%s\"\n", cases[i].pathname, sanitized);
+    }
+  }
+
+  /* Random strings made of dots and slashes are the most hostile input */
+  for (i = 0; i < 100000; i++) {
+    char pathname[16];
+    const char *sanitized;
+    int j, len;
+
+    len = g_random_int_range (0, sizeof (pathname));
+    for (j = 0; j < len; j++)
+      pathname[j] = "./a"[g_random_int_range (0, 3)];
+    pathname[len] = '\0';
+
+    sanitized = autoar_common_sanitize_pathname (pathname, i % 2, buffer);
+    if (!check_confined (sanitized)) {
+      g_printerr ("FAIL: \"%s\" => \"%s\" is not confined\n", pathname, sanitized);
+      failed++;
+    }
+  }
+
+  g_string_free (buffer, TRUE);
+
+  if (failed > 0) {
+    g_printerr ("%d cases failed\n", failed);
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
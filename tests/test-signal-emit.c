@@ -0,0 +1,160 @@
+/* vim: set sw=2 ts=2 sts=2 et: */
+
+#include <gnome-autoar/autoar-private.h>
+
+#include <stdlib.h>
+
+/* Measures how many signals per second can be sent from a worker thread to
+ * the main thread with autoar_common_g_signal_emit(). */
+
+#define DEFAULT_EMISSIONS 1000000
+
+typedef struct _BenchObject BenchObject;
+typedef struct _BenchObjectClass BenchObjectClass;
+
+struct _BenchObject
+{
+  GObject parent_instance;
+  AutoarCommonSignalPool signal_pool;
+};
+
+struct _BenchObjectClass
+{
+  GObjectClass parent_class;
+};
+
+enum
+{
+  PROGRESS,
+  LAST_SIGNAL
+};
+
+static guint bench_object_signals[LAST_SIGNAL] = { 0 };
+
+GType bench_object_get_type (void);
+
+G_DEFINE_TYPE (BenchObject, bench_object, G_TYPE_OBJECT)
+
+static void
+bench_object_finalize (GObject *object)
+{
+  BenchObject *bench = (BenchObject*)object;
+  autoar_common_signal_pool_clear (&(bench->signal_pool));
+  G_OBJECT_CLASS (bench_object_parent_class)->finalize (object);
+}
+
+static void
+bench_object_class_init (BenchObjectClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = bench_object_finalize;
+
+  bench_object_signals[PROGRESS] =
+    g_signal_new ("progress",
+                  G_TYPE_FROM_CLASS (klass),
+                  G_SIGNAL_RUN_LAST,
+                  0, NULL, NULL,
+                  g_cclosure_marshal_generic,
+                  G_TYPE_NONE,
+                  2,
+                  G_TYPE_UINT64,
+                  G_TYPE_UINT);
+}
+
+static void
+bench_object_init (BenchObject *bench)
+{
+  autoar_common_signal_pool_init (&(bench->signal_pool));
+}
+
+typedef struct
+{
+  BenchObject *bench;
+  gboolean use_pool;
+  guint emissions;
+  guint received;
+  GMainLoop *loop;
+} BenchRun;
+
+static void
+progress_cb (BenchObject *bench,
+             guint64 completed_size,
+             guint completed_files,
+             BenchRun *run)
+{
+  if (++(run->received) == run->emissions)
+    g_main_loop_quit (run->loop);
+}
+
+static gpointer
+emit_thread (gpointer data)
+{
+  BenchRun *run = data;
+  guint i;
+
+  for (i = 0; i < run->emissions; i++)
+    autoar_common_g_signal_emit (run->bench,
+                                 run->use_pool ? &(run->bench->signal_pool) : NULL,
+                                 TRUE,
+                                 bench_object_signals[PROGRESS], 0,
+                                 (guint64)i, i);
+
+  return NULL;
+}
+
+static void
+bench (guint emissions,
+       gboolean use_pool,
+       gboolean use_cache)
+{
+  BenchRun run;
+  GThread *thread;
+  gint64 start, elapsed;
+
+  run.bench = g_object_new (bench_object_get_type (), NULL);
+  run.use_pool = use_pool;
+  run.emissions = emissions;
+  run.received = 0;
+  run.loop = g_main_loop_new (NULL, FALSE);
+
+  if (use_cache)
+    autoar_common_g_signal_cache (bench_object_signals, LAST_SIGNAL);
+
+  g_signal_connect (run.bench, "progress", G_CALLBACK (progress_cb), &run);
+
+  start = g_get_monotonic_time ();
+  thread = g_thread_new ("emit", emit_thread, &run);
+  g_main_loop_run (run.loop);
+  g_thread_join (thread);
+  elapsed = MAX (g_get_monotonic_time () - start, 1);
+
+  g_print ("%-22s %10u signals  %8.3f s  %12.0f signals/s\n",
+           use_pool ? "pool, cached query" :
+           use_cache ? "invoke, cached query" : "invoke, g_signal_query",
+           emissions, elapsed / (double)G_USEC_PER_SEC,
+           emissions * (double)G_USEC_PER_SEC / elapsed);
+
+  g_main_loop_unref (run.loop);
+  g_object_unref (run.bench);
+}
+
+int
+main (int argc,
+      char *argv[])
+{
+  guint emissions;
+
+  emissions = argc > 1 ? strtoul (argv[1], NULL, 10) : DEFAULT_EMISSIONS;
+  if (emissions == 0) {
+    g_printerr ("Usage: %s [EMISSIONS]\n", argv[0]);
+    return 255;
+  }
+
+  /* The uncached run must go first because the cache is process-wide */
+  bench (emissions, FALSE, FALSE);
+  bench (emissions, FALSE, TRUE);
+  bench (emissions, TRUE, TRUE);
+
+  return 0;
+}